@@ -20,6 +20,7 @@
 
 #include "config.h"
 #include "schemes-application.h"
+#include "schemes-cli.h"
 
 int
 main (int   argc,
@@ -32,6 +33,9 @@ main (int   argc,
 	bind_textdomain_codeset (GETTEXT_PACKAGE, "UTF-8");
 	textdomain (GETTEXT_PACKAGE);
 
+	if (schemes_cli_handles (argc, argv))
+		return schemes_cli_run (argc, argv);
+
 	app = schemes_application_new (APP_ID, G_APPLICATION_HANDLES_OPEN);
 	ret = g_application_run (G_APPLICATION (app), argc, argv);
 
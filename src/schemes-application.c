@@ -125,11 +125,47 @@ static const GActionEntry action_entries[] = {
   { "about", about_cb, }
 };
 
+static const char *
+get_language_name (const char *language_id)
+{
+  GtkSourceLanguageManager *manager = gtk_source_language_manager_get_default ();
+  GtkSourceLanguage *language = gtk_source_language_manager_get_language (manager, language_id);
+
+  return language ? gtk_source_language_get_name (language) : NULL;
+}
+
+static void
+schemes_rgba_to_gdk_rgba (const GValue *src_value,
+                          GValue       *dest_value)
+{
+  const SchemesRGBA *rgba = g_value_get_boxed (src_value);
+
+  if (rgba != NULL)
+    {
+      GdkRGBA gdk_rgba = { rgba->red, rgba->green, rgba->blue, rgba->alpha };
+      g_value_set_boxed (dest_value, &gdk_rgba);
+    }
+}
+
+static void
+gdk_rgba_to_schemes_rgba (const GValue *src_value,
+                          GValue       *dest_value)
+{
+  const GdkRGBA *gdk_rgba = g_value_get_boxed (src_value);
+
+  if (gdk_rgba != NULL)
+    {
+      SchemesRGBA rgba = { gdk_rgba->red, gdk_rgba->green, gdk_rgba->blue, gdk_rgba->alpha };
+      g_value_set_boxed (dest_value, &rgba);
+    }
+}
+
 static void
 schemes_application_startup (GApplication *app)
 {
   SchemesApplication *self = (SchemesApplication *)app;
   g_autoptr(GAction) theme = NULL;
+  g_autoptr(GAction) backups = NULL;
   AdwStyleManager *style_manager;
 
   g_assert (SCHEMES_IS_APPLICATION (self));
@@ -139,10 +175,14 @@ schemes_application_startup (GApplication *app)
   gtk_source_init ();
   panel_init ();
 
+  schemes_scheme_set_language_name_func (get_language_name);
+
   self->settings = g_settings_new ("me.hergert.Schemes");
 
   theme = g_settings_create_action (self->settings, "style-variant");
   g_action_map_add_action (G_ACTION_MAP (self), theme);
+  backups = g_settings_create_action (self->settings, "create-backups");
+  g_action_map_add_action (G_ACTION_MAP (self), backups);
   g_action_map_add_action_entries (G_ACTION_MAP (self),
                                    action_entries,
                                    G_N_ELEMENTS (action_entries),
@@ -156,6 +196,37 @@ schemes_application_startup (GApplication *app)
                                 NULL, NULL, NULL);
 }
 
+static void
+schemes_application_open_cb (GObject      *object,
+                             GAsyncResult *result,
+                             gpointer      user_data)
+{
+  SchemesScheme *scheme = (SchemesScheme *)object;
+  SchemesApplication *self = user_data;
+  g_autoptr(GError) error = NULL;
+  SchemesWindow *window;
+
+  g_assert (SCHEMES_IS_SCHEME (scheme));
+  g_assert (G_IS_ASYNC_RESULT (result));
+  g_assert (SCHEMES_IS_APPLICATION (self));
+
+  if (!schemes_scheme_load_from_file_finish (scheme, result, &error))
+    {
+      g_warning ("%s", error->message);
+      goto release;
+    }
+
+  window = g_object_new (SCHEMES_TYPE_WINDOW,
+                         "application", self,
+                         "scheme", scheme,
+                         NULL);
+
+  gtk_window_present (GTK_WINDOW (window));
+
+release:
+  g_application_release (G_APPLICATION (self));
+}
+
 static void
 schemes_application_open (GApplication  *app,
                           GFile        **files,
@@ -170,27 +241,20 @@ schemes_application_open (GApplication  *app,
   if (n_files <= 0)
     return;
 
+  /* Files are loaded concurrently and each window is presented as soon
+   * as its scheme is ready. The application is held until then.
+   */
   for (guint i = 0; i < n_files; i++)
     {
-      g_autoptr(SchemesScheme) scheme = NULL;
-      g_autoptr(GError) error = NULL;
-      SchemesWindow *window;
-      GFile *file = files[i];
-
-      scheme = schemes_scheme_new ();
-
-      if (!schemes_scheme_load_from_file (scheme, file, &error))
-        {
-          g_warning ("%s", error->message);
-          continue;
-        }
-
-      window = g_object_new (SCHEMES_TYPE_WINDOW,
-                             "application", app,
-                             "scheme", scheme,
-                             NULL);
-
-      gtk_window_present (GTK_WINDOW (window));
+      g_autoptr(SchemesScheme) scheme = schemes_scheme_new ();
+
+      g_application_hold (app);
+      schemes_scheme_load_from_file_async (scheme,
+                                           files[i],
+                                           NULL, NULL,
+                                           NULL,
+                                           schemes_application_open_cb,
+                                           self);
     }
 }
 
@@ -205,6 +269,10 @@ schemes_application_class_init (SchemesApplicationClass *klass)
   app_class->activate = schemes_application_activate;
   app_class->startup = schemes_application_startup;
   app_class->open = schemes_application_open;
+
+  /* Allow binding model colors directly to GTK widgets */
+  g_value_register_transform_func (SCHEMES_TYPE_RGBA, GDK_TYPE_RGBA, schemes_rgba_to_gdk_rgba);
+  g_value_register_transform_func (GDK_TYPE_RGBA, SCHEMES_TYPE_RGBA, gdk_rgba_to_schemes_rgba);
 }
 
 static void
@@ -218,6 +286,8 @@ schemes_application_init (SchemesApplication *self)
     { "scheme.save", { "<Control>s", NULL }},
     { "scheme.save-as", { "<Control><Shift>s", NULL }},
     { "scheme.new", { "<Control>n", NULL }},
+    { "scheme.undo", { "<Control>z", NULL }},
+    { "scheme.redo", { "<Control><Shift>z", NULL }},
   };
 
   for (guint i = 0; i < G_N_ELEMENTS (accels); i++)
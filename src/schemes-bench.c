@@ -0,0 +1,372 @@
+/* schemes-bench.c
+ *
+ * Copyright 2022 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+
+#include "config.h"
+
+#include <glib/gstdio.h>
+#include <gtksourceview/gtksource.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+
+#include "schemes-generator.h"
+#include "schemes-preview.h"
+#include "schemes-scheme.h"
+
+/* Results are printed as one JSON object per line so that they can be
+ * collected by scripts and compared between runs.
+ */
+
+typedef struct
+{
+  const char *name;
+  guint       n_colors;
+  guint       n_styles;
+  guint       n_swatches;
+} BenchSize;
+
+typedef struct
+{
+  const BenchSize *size;
+  SchemesScheme   *scheme;
+  SchemesScheme   *loaded;
+  GFile           *file;
+  SchemesPreview  *preview;
+  char            *palette;
+  gsize            palette_len;
+  gboolean         toggle;
+} BenchInput;
+
+typedef void (*BenchFunc) (BenchInput *input);
+
+static const BenchSize sizes[] = {
+  { "small",     8,    16,    16 },
+  { "typical",  32,   250,   256 },
+  { "huge",   1024, 10000, 32768 },
+};
+
+static double min_time = 1.0;
+static int min_iterations = 5;
+static char *filter;
+static int seed = 1234;
+
+static const GOptionEntry entries[] = {
+  { "min-time", 't', 0, G_OPTION_ARG_DOUBLE, &min_time, "Minimum seconds to run each benchmark", "SECONDS" },
+  { "min-iterations", 'n', 0, G_OPTION_ARG_INT, &min_iterations, "Minimum iterations of each benchmark", "N" },
+  { "filter", 'f', 0, G_OPTION_ARG_STRING, &filter, "Only run benchmarks containing NAME", "NAME" },
+  { "seed", 's', 0, G_OPTION_ARG_INT, &seed, "Seed for generated schemes", "SEED" },
+  { NULL }
+};
+
+static void
+bench_input_init (BenchInput      *input,
+                  const BenchSize *size,
+                  const char      *tmpdir)
+{
+  g_autofree char *contents = NULL;
+  g_autofree char *path = NULL;
+  g_autofree char *basename = NULL;
+  g_autoptr(GError) error = NULL;
+  g_autoptr(SchemesGenerator) generator = NULL;
+
+  generator = schemes_generator_new (seed);
+  schemes_generator_set_n_colors (generator, size->n_colors);
+  schemes_generator_set_n_styles (generator, size->n_styles);
+
+  input->size = size;
+  input->scheme = schemes_generator_create_scheme (generator);
+  input->palette = schemes_generator_create_palette (generator, size->n_swatches, &input->palette_len);
+  input->preview = schemes_preview_new ();
+
+  contents = schemes_scheme_to_string (input->scheme);
+  basename = g_strdup_printf ("%s.xml", size->name);
+  path = g_build_filename (tmpdir, basename, NULL);
+
+  if (!g_file_set_contents (path, contents, -1, &error))
+    g_error ("Failed to write %s: %s", path, error->message);
+
+  input->file = g_file_new_for_path (path);
+}
+
+static void
+bench_input_clear (BenchInput *input)
+{
+  g_autofree char *path = g_file_get_path (input->file);
+
+  g_unlink (path);
+
+  g_clear_object (&input->scheme);
+  g_clear_object (&input->loaded);
+  g_clear_object (&input->file);
+  g_clear_object (&input->preview);
+  g_clear_pointer (&input->palette, g_free);
+}
+
+static void
+bench_load (BenchInput *input)
+{
+  g_autoptr(SchemesScheme) scheme = schemes_scheme_new ();
+  g_autoptr(GError) error = NULL;
+
+  if (!schemes_scheme_load_from_file (scheme, input->file, &error))
+    g_error ("Failed to load: %s", error->message);
+}
+
+/* Same as bench_load() but without the tokenizer, for comparison */
+static void
+bench_load_markup (BenchInput *input)
+{
+  schemes_scheme_set_fast_parser_enabled (FALSE);
+  bench_load (input);
+  schemes_scheme_set_fast_parser_enabled (TRUE);
+}
+
+/* Toggles a style between iterations so that each one is a real edit
+ * rather than hitting the cached snapshot or unchanged-contents shortcut.
+ */
+static void
+bench_edit (BenchInput *input)
+{
+  g_autoptr(SchemesStyle) style = schemes_scheme_dup_style (input->scheme, "def:bench");
+
+  input->toggle = !input->toggle;
+  g_object_set (style, "bold", input->toggle, NULL);
+}
+
+static void
+bench_serialize (BenchInput *input)
+{
+  g_autofree char *str = NULL;
+
+  bench_edit (input);
+  str = schemes_scheme_to_string (input->scheme);
+}
+
+/* Not timed, so that serialize-cold only measures a scheme which has
+ * never been serialized.
+ */
+static void
+bench_reload (BenchInput *input)
+{
+  g_autoptr(GError) error = NULL;
+
+  g_clear_object (&input->loaded);
+  input->loaded = schemes_scheme_new ();
+
+  if (!schemes_scheme_load_from_file (input->loaded, input->file, &error))
+    g_error ("Failed to load: %s", error->message);
+}
+
+static void
+bench_serialize_cold (BenchInput *input)
+{
+  g_autofree char *str = schemes_scheme_to_string (input->loaded);
+}
+
+static void
+bench_preview (BenchInput *input)
+{
+  bench_edit (input);
+
+  if (schemes_preview_update (input->preview, input->scheme) == NULL)
+    g_error ("Failed to create preview");
+}
+
+static void
+bench_import_palette (BenchInput *input)
+{
+  g_autoptr(SchemesScheme) scheme = schemes_scheme_new ();
+  g_autoptr(GError) error = NULL;
+
+  if (!schemes_scheme_import_palette (scheme, input->palette, input->palette_len, &error))
+    g_error ("Failed to import palette: %s", error->message);
+}
+
+static int
+compare_int64 (gconstpointer a,
+               gconstpointer b)
+{
+  const gint64 *ia = a;
+  const gint64 *ib = b;
+
+  return *ia < *ib ? -1 : *ia > *ib ? 1 : 0;
+}
+
+static gint64
+percentile (GArray *samples,
+            double  p)
+{
+  guint pos = (guint)((samples->len - 1) * p + .5);
+
+  return g_array_index (samples, gint64, pos);
+}
+
+static long
+read_status_kib (const char *field)
+{
+  g_autofree char *contents = NULL;
+  const char *line;
+
+  if (!g_file_get_contents ("/proc/self/status", &contents, NULL, NULL) ||
+      !(line = strstr (contents, field)))
+    return -1;
+
+  return strtol (line + strlen (field), NULL, 10);
+}
+
+/* On Linux the peak can be reset so that each benchmark gets its own
+ * rather than the one of the whole process, which only ever grows.
+ */
+static void
+reset_peak_rss (void)
+{
+  FILE *fp;
+
+  if ((fp = fopen ("/proc/self/clear_refs", "w")))
+    {
+      fputs ("5", fp);
+      fclose (fp);
+    }
+}
+
+static long
+get_peak_rss (void)
+{
+  struct rusage usage;
+  long peak;
+
+  if ((peak = read_status_kib ("VmHWM:")) >= 0)
+    return peak;
+
+  if (getrusage (RUSAGE_SELF, &usage) != 0)
+    return 0;
+
+  /* Reported in kilobytes on Linux */
+  return usage.ru_maxrss;
+}
+
+/* @setup runs before each iteration, outside of the timing */
+static void
+run_benchmark (const char *name,
+               BenchFunc   setup,
+               BenchFunc   func,
+               BenchInput *input)
+{
+  g_autoptr(GArray) samples = NULL;
+  g_autofree char *full_name = g_strdup_printf ("%s/%s", name, input->size->name);
+  gint64 total = 0;
+  long baseline_rss;
+  char ops[G_ASCII_DTOSTR_BUF_SIZE];
+
+  if (filter != NULL && strstr (full_name, filter) == NULL)
+    return;
+
+  samples = g_array_new (FALSE, FALSE, sizeof (gint64));
+
+  /* Without a reset this is the growth of the process peak */
+  reset_peak_rss ();
+  baseline_rss = get_peak_rss ();
+
+  /* Warm up caches and lazily initialized state */
+  if (setup != NULL)
+    setup (input);
+  func (input);
+
+  while (samples->len < (guint)min_iterations || total < min_time * G_USEC_PER_SEC)
+    {
+      gint64 begin;
+      gint64 elapsed;
+
+      if (setup != NULL)
+        setup (input);
+
+      begin = g_get_monotonic_time ();
+      func (input);
+
+      elapsed = g_get_monotonic_time () - begin;
+      total += elapsed;
+
+      g_array_append_val (samples, elapsed);
+    }
+
+  g_array_sort (samples, compare_int64);
+
+  g_ascii_formatd (ops, sizeof ops, "%.2f",
+                   samples->len / MAX (total / (double)G_USEC_PER_SEC, 1e-9));
+
+  g_print ("{\"benchmark\": \"%s\", \"size\": \"%s\", \"iterations\": %u, "
+           "\"ops_per_sec\": %s, \"p50_usec\": %"G_GINT64_FORMAT", "
+           "\"p99_usec\": %"G_GINT64_FORMAT", \"peak_rss_delta_kib\": %ld}\n",
+           name,
+           input->size->name,
+           samples->len,
+           ops,
+           percentile (samples, .50),
+           percentile (samples, .99),
+           get_peak_rss () - baseline_rss);
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+  g_autoptr(GOptionContext) context = NULL;
+  g_autoptr(GError) error = NULL;
+  g_autofree char *tmpdir = NULL;
+
+  context = g_option_context_new ("- benchmark scheme loading and saving");
+  g_option_context_add_main_entries (context, entries, NULL);
+
+  if (!g_option_context_parse (context, &argc, &argv, &error))
+    {
+      g_printerr ("%s\n", error->message);
+      return EXIT_FAILURE;
+    }
+
+  gtk_source_init ();
+
+  if (!(tmpdir = g_dir_make_tmp ("schemes-bench-XXXXXX", &error)))
+    {
+      g_printerr ("%s\n", error->message);
+      return EXIT_FAILURE;
+    }
+
+  for (guint i = 0; i < G_N_ELEMENTS (sizes); i++)
+    {
+      BenchInput input = {0};
+
+      bench_input_init (&input, &sizes[i], tmpdir);
+
+      run_benchmark ("load", NULL, bench_load, &input);
+      run_benchmark ("load-markup", NULL, bench_load_markup, &input);
+      run_benchmark ("serialize", NULL, bench_serialize, &input);
+      run_benchmark ("serialize-cold", bench_reload, bench_serialize_cold, &input);
+      run_benchmark ("preview", NULL, bench_preview, &input);
+      run_benchmark ("import-palette", NULL, bench_import_palette, &input);
+
+      bench_input_clear (&input);
+    }
+
+  g_rmdir (tmpdir);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,530 @@
+/* schemes-cli.c
+ *
+ * Copyright 2022 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+
+#include "config.h"
+
+#include <glib/gi18n.h>
+#include <gtksourceview/gtksource.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "schemes-cli.h"
+#include "schemes-generator.h"
+#include "schemes-scheme.h"
+
+/* The command line tools never initialize GTK. Everything here runs
+ * on top of the schemes-core model which is safe to use from worker
+ * threads as long as each thread owns its own SchemesScheme.
+ */
+
+typedef enum
+{
+  SCHEMES_CLI_CONVERT,
+  SCHEMES_CLI_NORMALIZE,
+} SchemesCliMode;
+
+typedef struct
+{
+  SchemesCliMode  mode;
+  GFile          *output_dir;
+  GAsyncQueue    *results;
+} SchemesCli;
+
+typedef struct
+{
+  GFile  *file;
+  GFile  *output;
+  GError *error;
+  gsize   n_read;
+  gsize   n_written;
+  gint64  elapsed;
+} SchemesCliJob;
+
+static GHashTable *language_names;
+
+static void
+schemes_cli_job_free (SchemesCliJob *job)
+{
+  g_clear_object (&job->file);
+  g_clear_object (&job->output);
+  g_clear_error (&job->error);
+  g_free (job);
+}
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (SchemesCliJob, schemes_cli_job_free)
+
+static const char *
+get_language_name (const char *language_id)
+{
+  return g_hash_table_lookup (language_names, language_id);
+}
+
+/* GtkSourceLanguageManager is not thread-safe, so resolve all of the
+ * language names up front and only read from the table afterwards.
+ */
+static void
+load_language_names (void)
+{
+  GtkSourceLanguageManager *manager;
+  const char * const *ids;
+
+  language_names = g_hash_table_new (g_str_hash, g_str_equal);
+
+  manager = gtk_source_language_manager_get_default ();
+  ids = gtk_source_language_manager_get_language_ids (manager);
+
+  for (guint i = 0; ids != NULL && ids[i] != NULL; i++)
+    {
+      GtkSourceLanguage *language = gtk_source_language_manager_get_language (manager, ids[i]);
+
+      g_hash_table_insert (language_names,
+                           (char *)gtk_source_language_get_id (language),
+                           (char *)gtk_source_language_get_name (language));
+    }
+
+  schemes_scheme_set_language_name_func (get_language_name);
+}
+
+static gboolean
+is_palette (GFile *file)
+{
+  g_autofree char *name = g_file_get_basename (file);
+
+  return g_str_has_suffix (name, ".gpl");
+}
+
+static GFile *
+get_output_file (SchemesCli *cli,
+                 GFile      *file)
+{
+  g_autofree char *name = NULL;
+  char *dot;
+
+  if (cli->output_dir == NULL)
+    return g_object_ref (file);
+
+  name = g_file_get_basename (file);
+
+  if (is_palette (file) && (dot = strrchr (name, '.')))
+    {
+      g_autofree char *xml_name = NULL;
+
+      *dot = 0;
+      xml_name = g_strdup_printf ("%s.xml", name);
+
+      return g_file_get_child (cli->output_dir, xml_name);
+    }
+
+  return g_file_get_child (cli->output_dir, name);
+}
+
+static gboolean
+load_palette (SchemesScheme  *scheme,
+              GFile          *file,
+              gsize          *n_read,
+              GError        **error)
+{
+  g_autofree char *contents = NULL;
+  g_autofree char *name = NULL;
+  char *dot;
+
+  if (!g_file_load_contents (file, NULL, &contents, n_read, NULL, error))
+    return FALSE;
+
+  if (!schemes_scheme_import_palette (scheme, contents, *n_read, error))
+    return FALSE;
+
+  name = g_file_get_basename (file);
+  if ((dot = strrchr (name, '.')))
+    *dot = 0;
+
+  schemes_scheme_set_id (scheme, name);
+  schemes_scheme_set_name (scheme, name);
+
+  return TRUE;
+}
+
+static void
+schemes_cli_worker (gpointer data,
+                    gpointer user_data)
+{
+  SchemesCliJob *job = data;
+  SchemesCli *cli = user_data;
+  g_autoptr(SchemesScheme) scheme = NULL;
+  g_autoptr(SchemesSchemeSnapshot) snapshot = NULL;
+  g_autoptr(GFileOutputStream) stream = NULL;
+  gboolean existed;
+  gint64 begin;
+
+  begin = g_get_monotonic_time ();
+
+  scheme = schemes_scheme_new ();
+
+  if (cli->mode == SCHEMES_CLI_CONVERT && is_palette (job->file))
+    {
+      if (!load_palette (scheme, job->file, &job->n_read, &job->error))
+        goto finish;
+    }
+  else
+    {
+      g_autoptr(GFileInfo) info = NULL;
+
+      if (!schemes_scheme_load_from_file (scheme, job->file, &job->error))
+        goto finish;
+
+      if ((info = g_file_query_info (job->file,
+                                     G_FILE_ATTRIBUTE_STANDARD_SIZE,
+                                     G_FILE_QUERY_INFO_NONE,
+                                     NULL, NULL)))
+        job->n_read = g_file_info_get_size (info);
+    }
+
+  snapshot = schemes_scheme_snapshot (scheme);
+
+  /* A new file is written in place, so there is nothing to keep */
+  existed = g_file_query_exists (job->output, NULL);
+
+  if (!(stream = g_file_replace (job->output, NULL, FALSE, G_FILE_CREATE_NONE, NULL, &job->error)))
+    goto finish;
+
+  if (!schemes_scheme_snapshot_write (snapshot, G_OUTPUT_STREAM (stream), NULL, &job->error))
+    {
+      g_autoptr(GCancellable) cancellable = g_cancellable_new ();
+
+      /* Closing normally would replace the original with what was
+       * written so far, a cancelled close leaves it untouched.
+       */
+      g_cancellable_cancel (cancellable);
+      g_output_stream_close (G_OUTPUT_STREAM (stream), cancellable, NULL);
+
+      if (!existed)
+        g_file_delete (job->output, NULL, NULL);
+
+      goto finish;
+    }
+
+  job->n_written = g_seekable_tell (G_SEEKABLE (stream));
+
+  if (!g_output_stream_close (G_OUTPUT_STREAM (stream), NULL, &job->error) && !existed)
+    g_file_delete (job->output, NULL, NULL);
+
+finish:
+  job->elapsed = g_get_monotonic_time () - begin;
+  g_async_queue_push (cli->results, job);
+}
+
+static double
+mib_per_second (gsize  n_bytes,
+                gint64 usec)
+{
+  if (usec <= 0)
+    return 0;
+  return (n_bytes / (1024.0 * 1024.0)) / (usec / (double)G_USEC_PER_SEC);
+}
+
+gboolean
+schemes_cli_handles (int    argc,
+                     char **argv)
+{
+  return argc > 1 &&
+         (g_strcmp0 (argv[1], "convert") == 0 ||
+          g_strcmp0 (argv[1], "generate") == 0 ||
+          g_strcmp0 (argv[1], "normalize") == 0);
+}
+
+static char **
+get_all_style_ids (void)
+{
+  GtkSourceLanguageManager *manager = gtk_source_language_manager_get_default ();
+  const char * const *ids = gtk_source_language_manager_get_language_ids (manager);
+  GPtrArray *ar = g_ptr_array_new ();
+
+  for (guint i = 0; ids != NULL && ids[i] != NULL; i++)
+    {
+      GtkSourceLanguage *language = gtk_source_language_manager_get_language (manager, ids[i]);
+      g_autofree char **style_ids = gtk_source_language_get_style_ids (language);
+
+      /* Steal the strings, only the array itself is freed */
+      for (guint j = 0; style_ids != NULL && style_ids[j] != NULL; j++)
+        g_ptr_array_add (ar, style_ids[j]);
+    }
+
+  g_ptr_array_add (ar, NULL);
+
+  return (char **)g_ptr_array_free (ar, FALSE);
+}
+
+static int
+schemes_cli_generate (int    argc,
+                      char **argv)
+{
+  g_autoptr(SchemesGenerator) generator = NULL;
+  g_autoptr(GOptionContext) context = NULL;
+  g_autoptr(GError) error = NULL;
+  g_autofree char *output = NULL;
+  g_autofree char *contents = NULL;
+  int seed = 0;
+  int n_colors = 32;
+  int n_styles = 0;
+  int n_swatches = 0;
+  double use_style = .1;
+  double literal = .1;
+  gsize len;
+  const GOptionEntry entries[] = {
+    { "seed", 's', 0, G_OPTION_ARG_INT, &seed, N_("Seed for the random number generator"), N_("SEED") },
+    { "colors", 'c', 0, G_OPTION_ARG_INT, &n_colors, N_("Number of named colors"), N_("N") },
+    { "styles", 0, 0, G_OPTION_ARG_INT, &n_styles, N_("Number of synthetic styles instead of every language style"), N_("N") },
+    { "use-style", 0, 0, G_OPTION_ARG_DOUBLE, &use_style, N_("Fraction of styles using use-style"), N_("RATIO") },
+    { "literal", 0, 0, G_OPTION_ARG_DOUBLE, &literal, N_("Fraction of colors not using a named color"), N_("RATIO") },
+    { "palette", 'p', 0, G_OPTION_ARG_INT, &n_swatches, N_("Generate a GIMP palette with N swatches"), N_("N") },
+    { "output", 'o', 0, G_OPTION_ARG_FILENAME, &output, N_("Write to FILE instead of stdout"), N_("FILE") },
+    { NULL }
+  };
+
+  context = g_option_context_new (NULL);
+  g_option_context_set_summary (context, _("Generate reproducible style-schemes and palettes"));
+  g_option_context_add_main_entries (context, entries, GETTEXT_PACKAGE);
+
+  if (!g_option_context_parse (context, &argc, &argv, &error))
+    {
+      g_printerr ("%s\n", error->message);
+      return EXIT_FAILURE;
+    }
+
+  generator = schemes_generator_new (seed);
+
+  if (n_swatches > 0)
+    {
+      contents = schemes_generator_create_palette (generator, n_swatches, &len);
+    }
+  else
+    {
+      g_autoptr(SchemesScheme) scheme = NULL;
+
+      schemes_generator_set_n_colors (generator, MAX (0, n_colors));
+      schemes_generator_set_use_style (generator, use_style);
+      schemes_generator_set_literal (generator, literal);
+
+      if (n_styles > 0)
+        {
+          schemes_generator_set_n_styles (generator, n_styles);
+        }
+      else
+        {
+          g_auto(GStrv) style_ids = get_all_style_ids ();
+          schemes_generator_set_style_ids (generator, (const char * const *)style_ids);
+        }
+
+      load_language_names ();
+
+      scheme = schemes_generator_create_scheme (generator);
+      contents = schemes_scheme_to_string (scheme);
+      len = strlen (contents);
+    }
+
+  if (output == NULL)
+    {
+      fwrite (contents, 1, len, stdout);
+    }
+  else if (!g_file_set_contents (output, contents, len, &error))
+    {
+      g_printerr ("%s\n", error->message);
+      return EXIT_FAILURE;
+    }
+
+  g_clear_pointer (&language_names, g_hash_table_unref);
+
+  return EXIT_SUCCESS;
+}
+
+static int
+schemes_cli_batch (const char  *command,
+                   int          argc,
+                   char       **argv)
+{
+  g_autoptr(GOptionContext) context = NULL;
+  g_autoptr(GError) error = NULL;
+  g_autofree char *output_dir = NULL;
+  g_auto(GStrv) files = NULL;
+  g_autoptr(GPtrArray) jobs_ar = NULL;
+  g_autoptr(GHashTable) outputs = NULL;
+  SchemesCli cli = {0};
+  GThreadPool *pool;
+  int jobs = g_get_num_processors ();
+  gboolean quiet = FALSE;
+  gsize total_read = 0;
+  gsize total_written = 0;
+  guint n_failed = 0;
+  guint n_files;
+  gint64 begin;
+  gint64 elapsed;
+  const GOptionEntry entries[] = {
+    { "jobs", 'j', 0, G_OPTION_ARG_INT, &jobs, N_("Number of worker threads"), N_("N") },
+    { "output-dir", 'o', 0, G_OPTION_ARG_FILENAME, &output_dir, N_("Write results to DIR"), N_("DIR") },
+    { "quiet", 'q', 0, G_OPTION_ARG_NONE, &quiet, N_("Only report errors and the summary"), NULL },
+    { G_OPTION_REMAINING, 0, 0, G_OPTION_ARG_FILENAME_ARRAY, &files, NULL, N_("FILE…") },
+    { NULL }
+  };
+
+  cli.mode = g_strcmp0 (command, "convert") == 0 ? SCHEMES_CLI_CONVERT : SCHEMES_CLI_NORMALIZE;
+
+  context = g_option_context_new (NULL);
+  g_option_context_set_summary (context,
+                                cli.mode == SCHEMES_CLI_CONVERT
+                                ? _("Convert style-schemes and GIMP palettes into normalized style-schemes")
+                                : _("Rewrite style-schemes in normalized form"));
+  g_option_context_add_main_entries (context, entries, GETTEXT_PACKAGE);
+
+  if (!g_option_context_parse (context, &argc, &argv, &error))
+    {
+      g_printerr ("%s\n", error->message);
+      return EXIT_FAILURE;
+    }
+
+  if (files == NULL || files[0] == NULL)
+    {
+      g_printerr ("%s\n", _("No files were provided"));
+      return EXIT_FAILURE;
+    }
+
+  if (cli.mode == SCHEMES_CLI_CONVERT && output_dir == NULL)
+    {
+      g_printerr ("%s\n", _("convert requires --output-dir"));
+      return EXIT_FAILURE;
+    }
+
+  if (output_dir != NULL)
+    {
+      cli.output_dir = g_file_new_for_commandline_arg (output_dir);
+
+      if (!g_file_make_directory_with_parents (cli.output_dir, NULL, &error) &&
+          !g_error_matches (error, G_IO_ERROR, G_IO_ERROR_EXISTS))
+        {
+          g_printerr ("%s\n", error->message);
+          g_clear_object (&cli.output_dir);
+          return EXIT_FAILURE;
+        }
+
+      g_clear_error (&error);
+    }
+
+  n_files = g_strv_length (files);
+  jobs_ar = g_ptr_array_new_full (n_files, (GDestroyNotify)schemes_cli_job_free);
+  outputs = g_hash_table_new (g_file_hash, (GEqualFunc)g_file_equal);
+
+  /* Workers would race on a shared output and the last one would win */
+  for (guint i = 0; i < n_files; i++)
+    {
+      SchemesCliJob *job = g_new0 (SchemesCliJob, 1);
+      SchemesCliJob *other;
+
+      job->file = g_file_new_for_commandline_arg (files[i]);
+      job->output = get_output_file (&cli, job->file);
+      g_ptr_array_add (jobs_ar, job);
+
+      if ((other = g_hash_table_lookup (outputs, job->output)))
+        {
+          g_autofree char *path = g_file_get_parse_name (job->file);
+          g_autofree char *other_path = g_file_get_parse_name (other->file);
+          g_autofree char *output_path = g_file_get_parse_name (job->output);
+
+          g_printerr (_("%s and %s would both be written to %s\n"), other_path, path, output_path);
+          g_clear_object (&cli.output_dir);
+          return EXIT_FAILURE;
+        }
+
+      g_hash_table_insert (outputs, job->output, job);
+    }
+
+  g_clear_pointer (&outputs, g_hash_table_unref);
+
+  load_language_names ();
+
+  cli.results = g_async_queue_new ();
+  begin = g_get_monotonic_time ();
+
+  pool = g_thread_pool_new (schemes_cli_worker, &cli, MAX (1, jobs), TRUE, NULL);
+
+  /* Each job is freed once its result has been reported */
+  g_ptr_array_set_free_func (jobs_ar, NULL);
+  for (guint i = 0; i < n_files; i++)
+    g_thread_pool_push (pool, g_ptr_array_index (jobs_ar, i), NULL);
+
+  for (guint i = 0; i < n_files; i++)
+    {
+      g_autoptr(SchemesCliJob) job = g_async_queue_pop (cli.results);
+      g_autofree char *path = g_file_get_parse_name (job->file);
+
+      if (job->error != NULL)
+        {
+          g_printerr ("%s: %s\n", path, job->error->message);
+          n_failed++;
+          continue;
+        }
+
+      total_read += job->n_read;
+      total_written += job->n_written;
+
+      if (!quiet)
+        g_print ("%s: %"G_GSIZE_FORMAT" bytes in %.3lf ms (%.2lf MiB/s)\n",
+                 path,
+                 job->n_read,
+                 job->elapsed / 1000.0,
+                 mib_per_second (job->n_read, job->elapsed));
+    }
+
+  g_thread_pool_free (pool, FALSE, TRUE);
+
+  elapsed = g_get_monotonic_time () - begin;
+
+  g_print ("%u files, %u failed, %"G_GSIZE_FORMAT" bytes read, %"G_GSIZE_FORMAT" bytes written "
+           "in %.3lf ms with %d workers (%.2lf MiB/s)\n",
+           n_files, n_failed, total_read, total_written,
+           elapsed / 1000.0,
+           MAX (1, jobs),
+           mib_per_second (total_read, elapsed));
+
+  g_clear_pointer (&cli.results, g_async_queue_unref);
+  g_clear_object (&cli.output_dir);
+  g_clear_pointer (&language_names, g_hash_table_unref);
+
+  return n_failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+int
+schemes_cli_run (int    argc,
+                 char **argv)
+{
+  g_autofree char *command = NULL;
+
+  g_assert (schemes_cli_handles (argc, argv));
+
+  /* Skip the sub-command but keep it around for the batch mode */
+  command = g_strdup (argv[1]);
+  argv[1] = argv[0];
+  argc--, argv++;
+
+  if (g_strcmp0 (command, "generate") == 0)
+    return schemes_cli_generate (argc, argv);
+
+  return schemes_cli_batch (command, argc, argv);
+}
@@ -26,7 +26,7 @@ struct _SchemesColor
 {
   GObject parent_instance;
   char *name;
-  GdkRGBA color;
+  SchemesRGBA color;
   guint color_set : 1;
 };
 
@@ -48,8 +48,8 @@ static GParamSpec *properties [N_PROPS];
 static guint signals [N_SIGNALS];
 
 SchemesColor *
-schemes_color_new (const char    *name,
-                   const GdkRGBA *color)
+schemes_color_new (const char        *name,
+                   const SchemesRGBA *color)
 {
   g_return_val_if_fail (name != NULL, NULL);
   g_return_val_if_fail (color != NULL, NULL);
@@ -61,15 +61,15 @@ schemes_color_new (const char    *name,
 }
 
 static void
-schemes_color_set_color (SchemesColor  *self,
-                         const GdkRGBA *color)
+schemes_color_set_color (SchemesColor      *self,
+                         const SchemesRGBA *color)
 {
-  static const GdkRGBA transparent;
-  GdkRGBA previous;
+  static const SchemesRGBA transparent;
+  SchemesRGBA previous;
 
   g_assert (SCHEMES_IS_COLOR (self));
 
-  if (color && self->color_set && gdk_rgba_equal (color, &self->color))
+  if (color && self->color_set && schemes_rgba_equal (color, &self->color))
     return;
 
   previous = self->color;
@@ -156,8 +156,8 @@ schemes_color_class_init (SchemesColorClass *klass)
   properties [PROP_COLOR] =
     g_param_spec_boxed ("color",
                         "Color",
-                        "The RGBA color as a GdkRGBA",
-                        GDK_TYPE_RGBA,
+                        "The RGBA color as a SchemesRGBA",
+                        SCHEMES_TYPE_RGBA,
                         (G_PARAM_READWRITE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS));
 
   g_object_class_install_properties (object_class, N_PROPS, properties);
@@ -169,7 +169,7 @@ schemes_color_class_init (SchemesColorClass *klass)
                   0,
                   NULL, NULL,
                   NULL,
-                  G_TYPE_NONE, 1, GDK_TYPE_RGBA | G_SIGNAL_TYPE_STATIC_SCOPE);
+                  G_TYPE_NONE, 1, SCHEMES_TYPE_RGBA | G_SIGNAL_TYPE_STATIC_SCOPE);
 }
 
 static void
@@ -185,7 +185,7 @@ schemes_color_get_name (SchemesColor *self)
   return self->name;
 }
 
-const GdkRGBA *
+const SchemesRGBA *
 schemes_color_get_color (SchemesColor *self)
 {
   g_return_val_if_fail (SCHEMES_IS_COLOR (self), NULL);
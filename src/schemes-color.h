@@ -20,7 +20,7 @@
 
 #pragma once
 
-#include <gdk/gdk.h>
+#include "schemes-rgba.h"
 
 G_BEGIN_DECLS
 
@@ -28,9 +28,9 @@ G_BEGIN_DECLS
 
 G_DECLARE_FINAL_TYPE (SchemesColor, schemes_color, SCHEMES, COLOR, GObject)
 
-SchemesColor  *schemes_color_new       (const char    *name,
-                                        const GdkRGBA *color);
-const char    *schemes_color_get_name  (SchemesColor  *self);
-const GdkRGBA *schemes_color_get_color (SchemesColor  *self);
+SchemesColor      *schemes_color_new       (const char        *name,
+                                            const SchemesRGBA *color);
+const char        *schemes_color_get_name  (SchemesColor      *self);
+const SchemesRGBA *schemes_color_get_color (SchemesColor      *self);
 
 G_END_DECLS
@@ -0,0 +1,300 @@
+/* schemes-generator.c
+ *
+ * Copyright 2022 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+
+#include "config.h"
+
+#include "schemes-generator.h"
+
+/* Produces reproducible schemes for benchmarks and stress testing. The
+ * same seed and settings always result in the same colors and styles.
+ * Style ids may be provided by the caller (such as from every installed
+ * GtkSourceView language) or are synthesized as "langN:styleN".
+ */
+
+#define STYLES_PER_LANGUAGE 32
+
+struct _SchemesGenerator
+{
+  guint32  seed;
+  guint    n_colors;
+  guint    n_styles;
+  char   **style_ids;
+  double   use_style;
+  double   literal;
+};
+
+SchemesGenerator *
+schemes_generator_new (guint32 seed)
+{
+  SchemesGenerator *self;
+
+  self = g_new0 (SchemesGenerator, 1);
+  self->seed = seed;
+  self->n_colors = 32;
+  self->n_styles = 256;
+  self->use_style = .1;
+  self->literal = .1;
+
+  return self;
+}
+
+void
+schemes_generator_free (SchemesGenerator *self)
+{
+  if (self == NULL)
+    return;
+
+  g_clear_pointer (&self->style_ids, g_strfreev);
+  g_free (self);
+}
+
+void
+schemes_generator_set_n_colors (SchemesGenerator *self,
+                                guint             n_colors)
+{
+  g_return_if_fail (self != NULL);
+
+  self->n_colors = n_colors;
+}
+
+void
+schemes_generator_set_n_styles (SchemesGenerator *self,
+                                guint             n_styles)
+{
+  g_return_if_fail (self != NULL);
+
+  self->n_styles = n_styles;
+}
+
+/* Overrides n-styles with a style for each of @style_ids */
+void
+schemes_generator_set_style_ids (SchemesGenerator   *self,
+                                 const char * const *style_ids)
+{
+  g_return_if_fail (self != NULL);
+
+  g_clear_pointer (&self->style_ids, g_strfreev);
+  self->style_ids = g_strdupv ((char **)style_ids);
+}
+
+/* Fraction of styles that refer to an earlier style with use-style */
+void
+schemes_generator_set_use_style (SchemesGenerator *self,
+                                 double            ratio)
+{
+  g_return_if_fail (self != NULL);
+
+  self->use_style = CLAMP (ratio, 0, 1);
+}
+
+/* Fraction of colored attributes that do not match a named color */
+void
+schemes_generator_set_literal (SchemesGenerator *self,
+                               double            ratio)
+{
+  g_return_if_fail (self != NULL);
+
+  self->literal = CLAMP (ratio, 0, 1);
+}
+
+static void
+random_rgba (GRand       *rand,
+             SchemesRGBA *rgba)
+{
+  rgba->red = g_rand_int_range (rand, 0, 256) / 255.0;
+  rgba->green = g_rand_int_range (rand, 0, 256) / 255.0;
+  rgba->blue = g_rand_int_range (rand, 0, 256) / 255.0;
+  rgba->alpha = g_rand_int_range (rand, 0, 8) == 0 ? g_rand_int_range (rand, 0, 256) / 255.0 : 1.0;
+}
+
+/* Named colors are followed by reference, as when loaded from a file */
+static void
+pick_rgba (SchemesGenerator  *self,
+           GRand             *rand,
+           SchemesScheme     *scheme,
+           SchemesStyleValue *value)
+{
+  GListModel *colors = schemes_scheme_get_colors (scheme);
+  guint n_items = g_list_model_get_n_items (colors);
+
+  if (n_items == 0 || g_rand_double (rand) < self->literal)
+    {
+      random_rgba (rand, &value->v.rgba);
+    }
+  else
+    {
+      g_autoptr(SchemesColor) color = NULL;
+
+      color = g_list_model_get_item (colors, g_rand_int_range (rand, 0, n_items));
+      value->v.rgba = *schemes_color_get_color (color);
+
+      /* Borrowed, self->colors of @scheme keeps it alive */
+      value->color = color;
+    }
+}
+
+static void
+generate_style (SchemesGenerator *self,
+                GRand            *rand,
+                SchemesScheme    *scheme,
+                GPtrArray        *names,
+                guint             position)
+{
+  const char *name = g_ptr_array_index (names, position);
+  g_autoptr(SchemesStyle) style = schemes_scheme_dup_style (scheme, name);
+  SchemesStyleAttributes attributes = {0};
+
+  /* use-style may not be combined with other attributes, so chain to
+   * a previous style which itself may chain to another.
+   */
+  if (position > 0 && g_rand_double (rand) < self->use_style)
+    {
+      guint target = g_rand_int_range (rand, 0, position);
+
+      schemes_style_set_use_style (style, g_ptr_array_index (names, target));
+      return;
+    }
+
+  pick_rgba (self, rand, scheme, schemes_style_attributes_add (&attributes, SCHEMES_STYLE_ATTRIBUTE_FOREGROUND));
+
+  if (g_rand_int_range (rand, 0, 4) == 0)
+    pick_rgba (self, rand, scheme, schemes_style_attributes_add (&attributes, SCHEMES_STYLE_ATTRIBUTE_BACKGROUND));
+
+  if (g_rand_int_range (rand, 0, 16) == 0)
+    pick_rgba (self, rand, scheme, schemes_style_attributes_add (&attributes, SCHEMES_STYLE_ATTRIBUTE_LINE_BACKGROUND));
+
+  if (g_rand_int_range (rand, 0, 3) == 0)
+    schemes_style_attributes_add (&attributes, SCHEMES_STYLE_ATTRIBUTE_BOLD)->v.boolean = g_rand_boolean (rand);
+
+  if (g_rand_int_range (rand, 0, 4) == 0)
+    schemes_style_attributes_add (&attributes, SCHEMES_STYLE_ATTRIBUTE_ITALIC)->v.boolean = g_rand_boolean (rand);
+
+  if (g_rand_int_range (rand, 0, 16) == 0)
+    schemes_style_attributes_add (&attributes, SCHEMES_STYLE_ATTRIBUTE_STRIKETHROUGH)->v.boolean = TRUE;
+
+  if (g_rand_int_range (rand, 0, 8) == 0)
+    {
+      schemes_style_attributes_add (&attributes, SCHEMES_STYLE_ATTRIBUTE_UNDERLINE)->v.underline = PANGO_UNDERLINE_ERROR;
+      pick_rgba (self, rand, scheme, schemes_style_attributes_add (&attributes, SCHEMES_STYLE_ATTRIBUTE_UNDERLINE_COLOR));
+    }
+
+  if (g_rand_int_range (rand, 0, 16) == 0)
+    schemes_style_attributes_add (&attributes, SCHEMES_STYLE_ATTRIBUTE_SCALE)->v.scale = g_rand_double_range (rand, .5, 2.);
+
+  if (g_rand_int_range (rand, 0, 16) == 0)
+    schemes_style_attributes_add (&attributes, SCHEMES_STYLE_ATTRIBUTE_WEIGHT)->v.weight = PANGO_WEIGHT_SEMIBOLD;
+
+  schemes_style_apply (style, &attributes);
+}
+
+SchemesScheme *
+schemes_generator_create_scheme (SchemesGenerator *self)
+{
+  g_autoptr(GPtrArray) names = NULL;
+  g_autofree char *id = NULL;
+  SchemesScheme *scheme;
+  GRand *rand;
+
+  g_return_val_if_fail (self != NULL, NULL);
+
+  rand = g_rand_new_with_seed (self->seed);
+
+  id = g_strdup_printf ("generated-%u", self->seed);
+
+  scheme = schemes_scheme_new ();
+  schemes_scheme_begin_update (scheme);
+  schemes_scheme_set_id (scheme, id);
+  schemes_scheme_set_name (scheme, id);
+  schemes_scheme_set_author (scheme, "Schemes");
+  schemes_scheme_set_description (scheme, "Generated style-scheme");
+
+  for (guint i = 0; i < self->n_colors; i++)
+    {
+      g_autoptr(SchemesColor) color = NULL;
+      g_autofree char *name = g_strdup_printf ("color%u", i);
+      SchemesRGBA rgba;
+
+      random_rgba (rand, &rgba);
+      color = schemes_color_new (name, &rgba);
+      schemes_scheme_add_color (scheme, color);
+    }
+
+  /* Styles pick from the colors, which must be in the list model */
+  schemes_scheme_end_update (scheme);
+  schemes_scheme_begin_update (scheme);
+
+  names = g_ptr_array_new_with_free_func (g_free);
+
+  if (self->style_ids != NULL)
+    {
+      for (guint i = 0; self->style_ids[i]; i++)
+        g_ptr_array_add (names, g_strdup (self->style_ids[i]));
+    }
+  else
+    {
+      for (guint i = 0; i < self->n_styles; i++)
+        g_ptr_array_add (names,
+                         g_strdup_printf ("lang%u:style%u",
+                                          i / STYLES_PER_LANGUAGE,
+                                          i % STYLES_PER_LANGUAGE));
+    }
+
+  for (guint i = 0; i < names->len; i++)
+    generate_style (self, rand, scheme, names, i);
+
+  schemes_scheme_end_update (scheme);
+
+  /* Like a loaded scheme, a generated one has nothing to undo */
+  schemes_scheme_clear_history (scheme);
+
+  g_rand_free (rand);
+
+  return scheme;
+}
+
+char *
+schemes_generator_create_palette (SchemesGenerator *self,
+                                  guint             n_swatches,
+                                  gsize            *len)
+{
+  GString *str;
+  GRand *rand;
+
+  g_return_val_if_fail (self != NULL, NULL);
+
+  rand = g_rand_new_with_seed (self->seed);
+  str = g_string_new (NULL);
+  g_string_append_printf (str, "GIMP Palette\nName: generated-%u\nColumns: 16\n#\n", self->seed);
+
+  for (guint i = 0; i < n_swatches; i++)
+    g_string_append_printf (str, "%3d %3d %3d\tswatch%u\n",
+                            g_rand_int_range (rand, 0, 256),
+                            g_rand_int_range (rand, 0, 256),
+                            g_rand_int_range (rand, 0, 256),
+                            i);
+
+  if (len != NULL)
+    *len = str->len;
+
+  g_rand_free (rand);
+
+  return g_string_free (str, FALSE);
+}
@@ -0,0 +1,49 @@
+/* schemes-generator.h
+ *
+ * Copyright 2022 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+
+#pragma once
+
+#include "schemes-scheme.h"
+
+G_BEGIN_DECLS
+
+typedef struct _SchemesGenerator SchemesGenerator;
+
+SchemesGenerator *schemes_generator_new             (guint32              seed);
+void              schemes_generator_free            (SchemesGenerator    *self);
+void              schemes_generator_set_n_colors    (SchemesGenerator    *self,
+                                                     guint                n_colors);
+void              schemes_generator_set_n_styles    (SchemesGenerator    *self,
+                                                     guint                n_styles);
+void              schemes_generator_set_style_ids   (SchemesGenerator    *self,
+                                                     const char * const  *style_ids);
+void              schemes_generator_set_use_style   (SchemesGenerator    *self,
+                                                     double               ratio);
+void              schemes_generator_set_literal     (SchemesGenerator    *self,
+                                                     double               ratio);
+SchemesScheme    *schemes_generator_create_scheme   (SchemesGenerator    *self);
+char             *schemes_generator_create_palette  (SchemesGenerator    *self,
+                                                     guint                n_swatches,
+                                                     gsize               *len);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (SchemesGenerator, schemes_generator_free)
+
+G_END_DECLS
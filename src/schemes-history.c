@@ -0,0 +1,485 @@
+/* schemes-history.c
+ *
+ * Copyright 2022 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+
+#include "config.h"
+
+#include <string.h>
+
+#include "schemes-history.h"
+
+/* Edits of the same thing closer together than this, such as dragging
+ * a color around in the chooser, are undone as a single step.
+ */
+#define MERGE_USEC         (G_USEC_PER_SEC)
+#define DEFAULT_MAX_SIZE   (4 * 1024 * 1024)
+
+/* Deltas of all the groups are stored contiguously, with the index of
+ * the first delta of each group in @groups.
+ */
+typedef struct
+{
+  GArray *deltas;
+  GArray *groups;
+} Stack;
+
+struct _SchemesHistory
+{
+  Stack undo;
+  Stack redo;
+
+  /* Where deltas are recorded, which is the redo stack while undoing */
+  Stack *target;
+
+  SchemesHistoryFunc changed_func;
+  gpointer changed_data;
+
+  gsize size;
+  gsize max_size;
+
+  /* When the last delta was recorded, to merge with the next one */
+  gint64 last_time;
+
+  guint depth;
+  guint blocked;
+
+  /* If the outermost group has deltas in target yet */
+  guint group_open : 1;
+  guint replaying : 1;
+};
+
+void
+schemes_delta_clear (SchemesDelta *delta)
+{
+  switch (delta->kind)
+    {
+    case SCHEMES_DELTA_STYLE:
+      g_clear_object (&delta->u.style.value.color);
+      break;
+
+    case SCHEMES_DELTA_COLOR:
+    case SCHEMES_DELTA_ADD_COLOR:
+    case SCHEMES_DELTA_REMOVE_COLOR:
+      g_clear_object (&delta->u.color.color);
+      break;
+
+    case SCHEMES_DELTA_METADATA:
+      g_clear_pointer (&delta->u.metadata.string, g_free);
+      break;
+
+    default:
+      g_assert_not_reached ();
+    }
+}
+
+static inline gsize
+delta_get_size (const SchemesDelta *delta)
+{
+  gsize size = sizeof *delta;
+
+  if (delta->kind == SCHEMES_DELTA_METADATA && delta->u.metadata.string != NULL)
+    size += strlen (delta->u.metadata.string) + 1;
+
+  return size;
+}
+
+/* Whether @a and @b revert the same thing, in which case only the
+ * first one of a group is needed.
+ */
+static inline gboolean
+delta_same_target (const SchemesDelta *a,
+                   const SchemesDelta *b)
+{
+  if (a->kind != b->kind || a->id != b->id)
+    return FALSE;
+
+  switch (a->kind)
+    {
+    case SCHEMES_DELTA_STYLE:
+      return a->u.style.name == b->u.style.name;
+
+    case SCHEMES_DELTA_COLOR:
+      return a->u.color.color == b->u.color.color;
+
+    case SCHEMES_DELTA_METADATA:
+      return TRUE;
+
+    case SCHEMES_DELTA_ADD_COLOR:
+    case SCHEMES_DELTA_REMOVE_COLOR:
+    default:
+      return FALSE;
+    }
+}
+
+static void
+stack_init (Stack *stack)
+{
+  stack->deltas = g_array_new (FALSE, FALSE, sizeof (SchemesDelta));
+  stack->groups = g_array_new (FALSE, FALSE, sizeof (guint));
+}
+
+static void
+stack_truncate (SchemesHistory *self,
+                Stack          *stack,
+                guint           n_groups)
+{
+  guint first;
+
+  if (n_groups >= stack->groups->len)
+    return;
+
+  first = g_array_index (stack->groups, guint, n_groups);
+
+  for (guint i = first; i < stack->deltas->len; i++)
+    {
+      SchemesDelta *delta = &g_array_index (stack->deltas, SchemesDelta, i);
+
+      self->size -= delta_get_size (delta);
+      schemes_delta_clear (delta);
+    }
+
+  g_array_set_size (stack->deltas, first);
+  g_array_set_size (stack->groups, n_groups);
+}
+
+static void
+stack_destroy (SchemesHistory *self,
+               Stack          *stack)
+{
+  stack_truncate (self, stack, 0);
+  g_clear_pointer (&stack->deltas, g_array_unref);
+  g_clear_pointer (&stack->groups, g_array_unref);
+}
+
+/* Drops the oldest undo steps until we are within max_size, always
+ * keeping the latest one.
+ */
+static void
+schemes_history_trim (SchemesHistory *self)
+{
+  Stack *stack = &self->undo;
+  guint n_groups = 0;
+  guint n_deltas;
+
+  while (self->size > self->max_size && n_groups + 1 < stack->groups->len)
+    {
+      guint end = g_array_index (stack->groups, guint, ++n_groups);
+
+      for (guint i = g_array_index (stack->groups, guint, n_groups - 1); i < end; i++)
+        {
+          SchemesDelta *delta = &g_array_index (stack->deltas, SchemesDelta, i);
+
+          self->size -= delta_get_size (delta);
+          schemes_delta_clear (delta);
+        }
+    }
+
+  if (n_groups == 0)
+    return;
+
+  n_deltas = g_array_index (stack->groups, guint, n_groups);
+  g_array_remove_range (stack->deltas, 0, n_deltas);
+  g_array_remove_range (stack->groups, 0, n_groups);
+  for (guint i = 0; i < stack->groups->len; i++)
+    g_array_index (stack->groups, guint, i) -= n_deltas;
+}
+
+static void
+schemes_history_changed (SchemesHistory *self)
+{
+  if (self->changed_func != NULL)
+    self->changed_func (self, self->changed_data);
+}
+
+SchemesHistory *
+schemes_history_new (void)
+{
+  SchemesHistory *self;
+
+  self = g_new0 (SchemesHistory, 1);
+  self->max_size = DEFAULT_MAX_SIZE;
+  self->target = &self->undo;
+  stack_init (&self->undo);
+  stack_init (&self->redo);
+
+  return self;
+}
+
+void
+schemes_history_free (SchemesHistory *self)
+{
+  if (self == NULL)
+    return;
+
+  stack_destroy (self, &self->undo);
+  stack_destroy (self, &self->redo);
+  g_free (self);
+}
+
+void
+schemes_history_set_changed_func (SchemesHistory     *self,
+                                  SchemesHistoryFunc  func,
+                                  gpointer            user_data)
+{
+  g_return_if_fail (self != NULL);
+
+  self->changed_func = func;
+  self->changed_data = user_data;
+}
+
+/* Approximate number of bytes used by both stacks */
+gsize
+schemes_history_get_size (SchemesHistory *self)
+{
+  g_return_val_if_fail (self != NULL, 0);
+
+  return self->size;
+}
+
+gsize
+schemes_history_get_max_size (SchemesHistory *self)
+{
+  g_return_val_if_fail (self != NULL, 0);
+
+  return self->max_size;
+}
+
+void
+schemes_history_set_max_size (SchemesHistory *self,
+                              gsize           max_size)
+{
+  g_return_if_fail (self != NULL);
+
+  self->max_size = max_size;
+
+  if (self->depth == 0)
+    {
+      schemes_history_trim (self);
+      schemes_history_changed (self);
+    }
+}
+
+gboolean
+schemes_history_can_undo (SchemesHistory *self)
+{
+  g_return_val_if_fail (self != NULL, FALSE);
+
+  return self->undo.groups->len > 0;
+}
+
+gboolean
+schemes_history_can_redo (SchemesHistory *self)
+{
+  g_return_val_if_fail (self != NULL, FALSE);
+
+  return self->redo.groups->len > 0;
+}
+
+void
+schemes_history_clear (SchemesHistory *self)
+{
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (!self->replaying);
+
+  stack_truncate (self, &self->undo, 0);
+  stack_truncate (self, &self->redo, 0);
+  self->group_open = FALSE;
+  self->last_time = 0;
+
+  schemes_history_changed (self);
+}
+
+/* Deltas recorded while blocked are dropped, such as when loading or
+ * for changes derived from others which are reverted along with them.
+ */
+void
+schemes_history_block (SchemesHistory *self)
+{
+  g_return_if_fail (self != NULL);
+
+  self->blocked++;
+}
+
+void
+schemes_history_unblock (SchemesHistory *self)
+{
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (self->blocked > 0);
+
+  self->blocked--;
+}
+
+/* Deltas recorded until the outermost schemes_history_end_group() are
+ * undone together. Deltas recorded outside of a group are a step of
+ * their own.
+ */
+void
+schemes_history_begin_group (SchemesHistory *self)
+{
+  g_return_if_fail (self != NULL);
+
+  self->depth++;
+}
+
+void
+schemes_history_end_group (SchemesHistory *self)
+{
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (self->depth > 0);
+
+  if (--self->depth > 0 || !self->group_open)
+    return;
+
+  self->group_open = FALSE;
+
+  if (!self->replaying)
+    schemes_history_trim (self);
+
+  schemes_history_changed (self);
+}
+
+/* Takes ownership of the contents of @delta */
+void
+schemes_history_record (SchemesHistory *self,
+                        SchemesDelta   *delta)
+{
+  Stack *stack;
+  guint first;
+
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (delta != NULL);
+
+  if (self->blocked > 0)
+    {
+      schemes_delta_clear (delta);
+      return;
+    }
+
+  stack = self->target;
+
+  if (!self->group_open)
+    {
+      gint64 now = g_get_monotonic_time ();
+      gboolean merge = FALSE;
+
+      if (!self->replaying && stack->groups->len > 0 && now - self->last_time < MERGE_USEC)
+        {
+          first = g_array_index (stack->groups, guint, stack->groups->len - 1);
+          merge = delta_same_target (&g_array_index (stack->deltas, SchemesDelta, first), delta);
+        }
+
+      if (!merge)
+        {
+          first = stack->deltas->len;
+          g_array_append_val (stack->groups, first);
+        }
+
+      /* A new change makes what was undone unreachable */
+      if (!self->replaying)
+        {
+          stack_truncate (self, &self->redo, 0);
+          self->last_time = now;
+        }
+
+      self->group_open = TRUE;
+    }
+
+  first = g_array_index (stack->groups, guint, stack->groups->len - 1);
+
+  /* Reverting the earliest delta of a target is enough, so repeated
+   * changes within a step cost nothing.
+   */
+  for (guint i = first; i < stack->deltas->len; i++)
+    {
+      if (delta_same_target (&g_array_index (stack->deltas, SchemesDelta, i), delta))
+        {
+          schemes_delta_clear (delta);
+          goto finish;
+        }
+    }
+
+  self->size += delta_get_size (delta);
+  g_array_append_vals (stack->deltas, delta, 1);
+
+finish:
+  if (self->depth == 0)
+    {
+      self->depth++;
+      schemes_history_end_group (self);
+    }
+}
+
+/* Removes the latest step from the undo stack, or the redo stack if
+ * @redo is set, and returns its deltas in the order they were recorded.
+ * They should be reverted in the opposite order, followed by a call to
+ * schemes_history_end_replay(). Returns %NULL if there is nothing to
+ * replay.
+ */
+GArray *
+schemes_history_begin_replay (SchemesHistory *self,
+                              gboolean        redo)
+{
+  Stack *stack;
+  GArray *deltas;
+  guint first;
+
+  g_return_val_if_fail (self != NULL, NULL);
+  g_return_val_if_fail (!self->replaying, NULL);
+  g_return_val_if_fail (self->depth == 0, NULL);
+
+  stack = redo ? &self->redo : &self->undo;
+
+  if (stack->groups->len == 0)
+    return NULL;
+
+  first = g_array_index (stack->groups, guint, stack->groups->len - 1);
+  deltas = g_array_sized_new (FALSE, FALSE, sizeof (SchemesDelta), stack->deltas->len - first);
+  g_array_set_clear_func (deltas, (GDestroyNotify)schemes_delta_clear);
+  g_array_append_vals (deltas,
+                       &g_array_index (stack->deltas, SchemesDelta, first),
+                       stack->deltas->len - first);
+
+  for (guint i = 0; i < deltas->len; i++)
+    self->size -= delta_get_size (&g_array_index (deltas, SchemesDelta, i));
+
+  g_array_set_size (stack->deltas, first);
+  g_array_set_size (stack->groups, stack->groups->len - 1);
+
+  self->replaying = TRUE;
+  self->target = redo ? &self->undo : &self->redo;
+  self->last_time = 0;
+  self->depth++;
+
+  return deltas;
+}
+
+void
+schemes_history_end_replay (SchemesHistory *self)
+{
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (self->replaying);
+
+  self->replaying = FALSE;
+  schemes_history_end_group (self);
+  self->target = &self->undo;
+
+  schemes_history_trim (self);
+  schemes_history_changed (self);
+}
@@ -0,0 +1,93 @@
+/* schemes-history.h
+ *
+ * Copyright 2022 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+
+#pragma once
+
+#include "schemes-style-table.h"
+
+G_BEGIN_DECLS
+
+typedef struct _SchemesHistory SchemesHistory;
+
+typedef enum _SchemesDeltaKind
+{
+  SCHEMES_DELTA_STYLE,
+  SCHEMES_DELTA_COLOR,
+  SCHEMES_DELTA_ADD_COLOR,
+  SCHEMES_DELTA_REMOVE_COLOR,
+  SCHEMES_DELTA_METADATA,
+} SchemesDeltaKind;
+
+/* A single change, holding only what is needed to revert it. Reverting
+ * a delta records the change that made, so undoing fills the redo
+ * stack and redoing fills the undo stack.
+ */
+typedef struct _SchemesDelta
+{
+  SchemesDeltaKind kind;
+
+  /* SchemesStyleAttribute for styles, the property id for metadata */
+  guint id;
+
+  union {
+    struct {
+      const char        *name;
+      SchemesStyleValue  value;
+    } style;
+    struct {
+      SchemesColor *color;
+      SchemesRGBA   rgba;
+      guint         position;
+    } color;
+    struct {
+      char     *string;
+      gboolean  boolean;
+    } metadata;
+  } u;
+} SchemesDelta;
+
+typedef void (*SchemesHistoryFunc) (SchemesHistory *history,
+                                    gpointer        user_data);
+
+SchemesHistory *schemes_history_new              (void);
+void            schemes_history_free             (SchemesHistory     *self);
+void            schemes_history_set_changed_func (SchemesHistory     *self,
+                                                  SchemesHistoryFunc  func,
+                                                  gpointer            user_data);
+gsize           schemes_history_get_size         (SchemesHistory     *self);
+gsize           schemes_history_get_max_size     (SchemesHistory     *self);
+void            schemes_history_set_max_size     (SchemesHistory     *self,
+                                                  gsize               max_size);
+gboolean        schemes_history_can_undo         (SchemesHistory     *self);
+gboolean        schemes_history_can_redo         (SchemesHistory     *self);
+void            schemes_history_clear            (SchemesHistory     *self);
+void            schemes_history_block            (SchemesHistory     *self);
+void            schemes_history_unblock          (SchemesHistory     *self);
+void            schemes_history_begin_group      (SchemesHistory     *self);
+void            schemes_history_end_group        (SchemesHistory     *self);
+void            schemes_history_record           (SchemesHistory     *self,
+                                                  SchemesDelta       *delta);
+GArray         *schemes_history_begin_replay     (SchemesHistory     *self,
+                                                  gboolean            redo);
+void            schemes_history_end_replay       (SchemesHistory     *self);
+void            schemes_delta_clear              (SchemesDelta       *delta);
+
+G_END_DECLS
@@ -0,0 +1,868 @@
+/* schemes-preview.c
+ *
+ * Copyright 2022 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+
+#include "config.h"
+
+#include <errno.h>
+#include <glib/gstdio.h>
+#include <math.h>
+
+#include "schemes-preview.h"
+#include "schemes-xml.h"
+
+/* Previews are loaded through a single GtkSourceStyleSchemeManager whose
+ * search path only contains a private directory. The directory lives in
+ * the user runtime directory (tmpfs on most systems) and holds nothing
+ * but preview.xml, so a rescan only ever parses the scheme being edited.
+ * The file is rewritten only when the serialized scheme changed.
+ *
+ * When attached to a buffer, edits to a single style can also be applied
+ * directly to the GtkTextTags that GtkSourceView created for it. Those
+ * tags are anonymous, so they are discovered once by applying a "probe"
+ * scheme which gives every style id a unique foreground color.
+ *
+ * Full previews may be serialized and written on a worker thread from a
+ * snapshot of the scheme, GtkSourceView then parses the file on the main
+ * thread. Every request bumps a generation counter so that builds which
+ * were superseded by a newer edit are dropped instead of being applied.
+ * The file and cached contents are guarded by a mutex since they are
+ * shared by the workers and the main thread.
+ */
+
+#define MAX_STYLE_DEPTH 16
+#define PROBE_SCHEME_ID "schemes-probe"
+
+struct _SchemesPreview
+{
+  GObject                      parent_instance;
+  GtkSourceStyleSchemeManager *manager;
+  GtkSourceStyleScheme        *style_scheme;
+  GtkSourceBuffer             *buffer;
+  char                        *directory;
+  char                        *path;
+  char                        *contents;
+  GMutex                       mutex;
+
+  /* Bumped for every full preview request */
+  guint                        generation;
+  guint                        n_active;
+
+  /* Style id to GtkTextTag, discovered with the probe scheme */
+  GtkSourceStyleScheme        *probe;
+  GPtrArray                   *probe_ids;
+  GHashTable                  *tags;
+
+  /* Tags were modified since the last full rebuild */
+  guint                        stale : 1;
+  guint                        probing : 1;
+};
+
+G_DEFINE_FINAL_TYPE (SchemesPreview, schemes_preview, G_TYPE_OBJECT)
+
+enum {
+  PROP_0,
+  PROP_STYLE_SCHEME,
+  N_PROPS
+};
+
+enum {
+  NEEDS_REBUILD,
+  N_SIGNALS
+};
+
+typedef struct
+{
+  SchemesSchemeSnapshot *snapshot;
+  char                  *contents;
+  guint                  generation;
+  guint                  force : 1;
+} Update;
+
+static GParamSpec *properties [N_PROPS];
+static guint signals [N_SIGNALS];
+
+static void
+update_free (Update *update)
+{
+  g_clear_pointer (&update->snapshot, schemes_scheme_snapshot_unref);
+  g_clear_pointer (&update->contents, g_free);
+  g_free (update);
+}
+
+SchemesPreview *
+schemes_preview_new (void)
+{
+  return g_object_new (SCHEMES_TYPE_PREVIEW, NULL);
+}
+
+static gboolean
+schemes_preview_ensure_directory (SchemesPreview *self)
+{
+  g_autofree char *template = NULL;
+  const char *search_path[] = { NULL, NULL };
+
+  g_assert (SCHEMES_IS_PREVIEW (self));
+
+  if (self->directory != NULL)
+    return TRUE;
+
+  template = g_build_filename (g_get_user_runtime_dir (), "schemes-XXXXXX", NULL);
+
+  if (g_mkdtemp (template) == NULL)
+    {
+      g_warning ("Failed to create preview directory: %s", g_strerror (errno));
+      return FALSE;
+    }
+
+  self->directory = g_steal_pointer (&template);
+  self->path = g_build_filename (self->directory, "preview.xml", NULL);
+
+  search_path[0] = self->directory;
+  gtk_source_style_scheme_manager_set_search_path (self->manager, search_path);
+
+  return TRUE;
+}
+
+/* Called with the mutex held, possibly from a worker thread. The
+ * directory must have been created on the main thread already.
+ */
+static gboolean
+schemes_preview_write (SchemesPreview *self,
+                       const char     *contents)
+{
+  g_autoptr(GError) error = NULL;
+
+  g_assert (SCHEMES_IS_PREVIEW (self));
+  g_assert (self->path != NULL);
+  g_assert (contents != NULL);
+
+  if (!g_file_set_contents (self->path, contents, -1, &error))
+    {
+      g_warning ("Failed to write preview: %s", error->message);
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+/* Returns a new reference to the scheme parsed from the last contents
+ * written. GtkSourceView is not thread-safe, so this must only be
+ * called from the main thread.
+ */
+static GtkSourceStyleScheme *
+schemes_preview_load (SchemesPreview *self)
+{
+  GtkSourceStyleScheme *style_scheme;
+  const char * const *ids;
+
+  g_assert (SCHEMES_IS_PREVIEW (self));
+
+  gtk_source_style_scheme_manager_force_rescan (self->manager);
+
+  if (!(ids = gtk_source_style_scheme_manager_get_scheme_ids (self->manager)) ||
+      ids[0] == NULL ||
+      !(style_scheme = gtk_source_style_scheme_manager_get_scheme (self->manager, ids[0])))
+    {
+      g_warning ("Failed to load preview.xml");
+      return NULL;
+    }
+
+  return g_object_ref (style_scheme);
+}
+
+static void
+add_style_id (GPtrArray  *ar,
+              GHashTable *seen,
+              const char *style_id)
+{
+  if (g_hash_table_contains (seen, style_id))
+    return;
+
+  g_ptr_array_add (ar, g_strdup (style_id));
+  g_hash_table_add (seen, g_ptr_array_index (ar, ar->len - 1));
+}
+
+static void
+collect_style_ids (GPtrArray *ar)
+{
+  GtkSourceLanguageManager *manager = gtk_source_language_manager_get_default ();
+  const char * const *ids = gtk_source_language_manager_get_language_ids (manager);
+  g_autoptr(GHashTable) seen = g_hash_table_new (g_str_hash, g_str_equal);
+
+#define SCHEMES_STYLE(group_name, name, title, subtitle, flags) \
+  add_style_id (ar, seen, name)
+# include "schemes-styles.defs"
+#undef SCHEMES_STYLE
+
+  for (guint i = 0; ids != NULL && ids[i] != NULL; i++)
+    {
+      GtkSourceLanguage *language = gtk_source_language_manager_get_language (manager, ids[i]);
+      g_auto(GStrv) style_ids = gtk_source_language_get_style_ids (language);
+
+      for (guint j = 0; style_ids != NULL && style_ids[j] != NULL; j++)
+        add_style_id (ar, seen, style_ids[j]);
+    }
+}
+
+static gboolean
+schemes_preview_ensure_probe (SchemesPreview *self)
+{
+  g_autoptr(GOutputStream) stream = NULL;
+  g_autofree char *contents = NULL;
+  SchemesXmlWriter writer;
+
+  g_assert (SCHEMES_IS_PREVIEW (self));
+
+  if (self->probe != NULL)
+    return TRUE;
+
+  /* A pending preview would be loaded from the probe contents */
+  if (self->n_active > 0)
+    return FALSE;
+
+  self->probe_ids = g_ptr_array_new_with_free_func (g_free);
+  collect_style_ids (self->probe_ids);
+
+  stream = g_memory_output_stream_new_resizable ();
+  schemes_xml_writer_init (&writer, stream, NULL);
+  schemes_xml_writer_write (&writer, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
+  schemes_xml_writer_write (&writer, "<style-scheme id=\"" PROBE_SCHEME_ID "\" name=\"Probe\" version=\"1.0\">\n");
+
+  /* The color of each style is its position + 1 in probe_ids */
+  for (guint i = 0; i < self->probe_ids->len; i++)
+    {
+      char color[8];
+
+      g_snprintf (color, sizeof color, "#%06X", i + 1);
+
+      schemes_xml_writer_write (&writer, "  ");
+      schemes_xml_writer_begin_open_element (&writer, "style");
+      schemes_xml_writer_add_attribute (&writer, "name", g_ptr_array_index (self->probe_ids, i));
+      schemes_xml_writer_add_attribute (&writer, "foreground", color);
+      schemes_xml_writer_end_open_element (&writer, FALSE);
+      schemes_xml_writer_write_c (&writer, '\n');
+    }
+
+  schemes_xml_writer_close_element (&writer, "style-scheme");
+  schemes_xml_writer_write_c (&writer, 0);
+
+  /* Writing to memory does not fail */
+  schemes_xml_writer_finish (&writer, NULL);
+  g_output_stream_close (stream, NULL, NULL);
+  contents = g_memory_output_stream_steal_data (G_MEMORY_OUTPUT_STREAM (stream));
+
+  g_mutex_lock (&self->mutex);
+  if (schemes_preview_ensure_directory (self) &&
+      schemes_preview_write (self, contents))
+    self->probe = schemes_preview_load (self);
+  g_mutex_unlock (&self->mutex);
+
+  return self->probe != NULL;
+}
+
+static void
+collect_tag_cb (GtkTextTag *tag,
+                gpointer    data)
+{
+  SchemesPreview *self = data;
+  g_autoptr(GdkRGBA) rgba = NULL;
+  g_autofree char *name = NULL;
+  gboolean foreground_set = FALSE;
+  guint position;
+
+  g_object_get (tag,
+                "name", &name,
+                "foreground-set", &foreground_set,
+                "foreground-rgba", &rgba,
+                NULL);
+
+  if (name != NULL || !foreground_set || rgba == NULL)
+    return;
+
+  position = ((guint)lroundf (rgba->red * 255.f) << 16) |
+             ((guint)lroundf (rgba->green * 255.f) << 8) |
+             (guint)lroundf (rgba->blue * 255.f);
+
+  if (position == 0 || position > self->probe_ids->len)
+    return;
+
+  g_hash_table_insert (self->tags, g_ptr_array_index (self->probe_ids, position - 1), tag);
+}
+
+static gboolean
+schemes_preview_ensure_tags (SchemesPreview *self)
+{
+  GtkTextTagTable *table;
+
+  g_assert (SCHEMES_IS_PREVIEW (self));
+
+  if (self->tags != NULL)
+    return TRUE;
+
+  /* Re-applying the last full preview would drop our tag edits */
+  if (self->buffer == NULL || self->style_scheme == NULL || self->stale)
+    return FALSE;
+
+  if (!schemes_preview_ensure_probe (self))
+    return FALSE;
+
+  table = gtk_text_buffer_get_tag_table (GTK_TEXT_BUFFER (self->buffer));
+
+  self->probing = TRUE;
+  self->tags = g_hash_table_new (g_str_hash, g_str_equal);
+  gtk_source_buffer_set_style_scheme (self->buffer, self->probe);
+  gtk_text_tag_table_foreach (table, collect_tag_cb, self);
+  gtk_source_buffer_set_style_scheme (self->buffer, self->style_scheme);
+  self->probing = FALSE;
+
+  return TRUE;
+}
+
+static void
+on_tag_table_changed_cb (SchemesPreview  *self,
+                         GtkTextTag      *tag,
+                         GtkTextTagTable *table)
+{
+  g_assert (SCHEMES_IS_PREVIEW (self));
+
+  if (self->probing)
+    return;
+
+  g_clear_pointer (&self->tags, g_hash_table_unref);
+
+  /* New tags were styled from the last full preview, which is older
+   * than the edits we have applied to the other tags.
+   */
+  if (self->stale)
+    g_signal_emit (self, signals [NEEDS_REBUILD], 0);
+}
+
+static void
+schemes_preview_finalize (GObject *object)
+{
+  SchemesPreview *self = (SchemesPreview *)object;
+
+  if (self->path != NULL)
+    g_unlink (self->path);
+
+  if (self->directory != NULL)
+    g_rmdir (self->directory);
+
+  g_clear_object (&self->style_scheme);
+  g_clear_object (&self->probe);
+  g_clear_object (&self->buffer);
+  g_clear_object (&self->manager);
+  g_clear_pointer (&self->tags, g_hash_table_unref);
+  g_clear_pointer (&self->probe_ids, g_ptr_array_unref);
+  g_clear_pointer (&self->directory, g_free);
+  g_clear_pointer (&self->path, g_free);
+  g_clear_pointer (&self->contents, g_free);
+
+  g_mutex_clear (&self->mutex);
+
+  G_OBJECT_CLASS (schemes_preview_parent_class)->finalize (object);
+}
+
+static void
+schemes_preview_get_property (GObject    *object,
+                              guint       prop_id,
+                              GValue     *value,
+                              GParamSpec *pspec)
+{
+  SchemesPreview *self = SCHEMES_PREVIEW (object);
+
+  switch (prop_id)
+    {
+    case PROP_STYLE_SCHEME:
+      g_value_set_object (value, self->style_scheme);
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    }
+}
+
+static void
+schemes_preview_class_init (SchemesPreviewClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->finalize = schemes_preview_finalize;
+  object_class->get_property = schemes_preview_get_property;
+
+  properties [PROP_STYLE_SCHEME] =
+    g_param_spec_object ("style-scheme", NULL, NULL,
+                         GTK_SOURCE_TYPE_STYLE_SCHEME,
+                         (G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_properties (object_class, N_PROPS, properties);
+
+  signals [NEEDS_REBUILD] =
+    g_signal_new ("needs-rebuild",
+                  G_TYPE_FROM_CLASS (klass),
+                  G_SIGNAL_RUN_LAST,
+                  0,
+                  NULL, NULL,
+                  NULL,
+                  G_TYPE_NONE, 0);
+}
+
+static void
+schemes_preview_init (SchemesPreview *self)
+{
+  g_mutex_init (&self->mutex);
+  self->manager = gtk_source_style_scheme_manager_new ();
+}
+
+GtkSourceStyleScheme *
+schemes_preview_get_style_scheme (SchemesPreview *self)
+{
+  g_return_val_if_fail (SCHEMES_IS_PREVIEW (self), NULL);
+
+  return self->style_scheme;
+}
+
+/* The style scheme of @buffer is kept in sync with the preview */
+void
+schemes_preview_set_buffer (SchemesPreview  *self,
+                            GtkSourceBuffer *buffer)
+{
+  GtkTextTagTable *table;
+
+  g_return_if_fail (SCHEMES_IS_PREVIEW (self));
+  g_return_if_fail (GTK_SOURCE_IS_BUFFER (buffer));
+  g_return_if_fail (self->buffer == NULL);
+
+  self->buffer = g_object_ref (buffer);
+
+  table = gtk_text_buffer_get_tag_table (GTK_TEXT_BUFFER (buffer));
+  g_signal_connect_object (table,
+                           "tag-added",
+                           G_CALLBACK (on_tag_table_changed_cb),
+                           self,
+                           G_CONNECT_SWAPPED);
+  g_signal_connect_object (table,
+                           "tag-removed",
+                           G_CALLBACK (on_tag_table_changed_cb),
+                           self,
+                           G_CONNECT_SWAPPED);
+
+  gtk_source_buffer_set_style_scheme (buffer, self->style_scheme);
+}
+
+static void
+schemes_preview_apply (SchemesPreview       *self,
+                       GtkSourceStyleScheme *style_scheme,
+                       char                 *contents)
+{
+  g_assert (SCHEMES_IS_PREVIEW (self));
+  g_assert (!style_scheme || GTK_SOURCE_IS_STYLE_SCHEME (style_scheme));
+
+  g_mutex_lock (&self->mutex);
+  g_free (self->contents);
+  self->contents = contents;
+  g_mutex_unlock (&self->mutex);
+
+  self->stale = FALSE;
+
+  if (g_set_object (&self->style_scheme, style_scheme))
+    g_object_notify_by_pspec (G_OBJECT (self), properties [PROP_STYLE_SCHEME]);
+
+  if (self->buffer != NULL)
+    gtk_source_buffer_set_style_scheme (self->buffer, self->style_scheme);
+}
+
+/* Returns the style scheme for @scheme, owned by @self */
+GtkSourceStyleScheme *
+schemes_preview_update (SchemesPreview *self,
+                        SchemesScheme  *scheme)
+{
+  g_autoptr(GtkSourceStyleScheme) style_scheme = NULL;
+  g_autofree char *contents = NULL;
+
+  g_return_val_if_fail (SCHEMES_IS_PREVIEW (self), NULL);
+  g_return_val_if_fail (SCHEMES_IS_SCHEME (scheme), NULL);
+
+  /* Anything still in flight is older than this */
+  g_atomic_int_inc (&self->generation);
+
+  if (!(contents = schemes_scheme_to_string (scheme)))
+    return self->style_scheme;
+
+  g_mutex_lock (&self->mutex);
+
+  if (self->style_scheme != NULL &&
+      !self->stale &&
+      g_strcmp0 (contents, self->contents) == 0)
+    {
+      g_mutex_unlock (&self->mutex);
+      return self->style_scheme;
+    }
+
+  if (schemes_preview_ensure_directory (self) &&
+      schemes_preview_write (self, contents))
+    style_scheme = schemes_preview_load (self);
+
+  g_mutex_unlock (&self->mutex);
+
+  schemes_preview_apply (self, style_scheme, g_steal_pointer (&contents));
+
+  return self->style_scheme;
+}
+
+static gboolean
+update_is_current (SchemesPreview *self,
+                   Update         *update)
+{
+  return update->generation == (guint)g_atomic_int_get (&self->generation);
+}
+
+static void
+schemes_preview_update_worker (GTask        *task,
+                               gpointer      source_object,
+                               gpointer      task_data,
+                               GCancellable *cancellable)
+{
+  SchemesPreview *self = source_object;
+  Update *update = task_data;
+  g_autofree char *contents = NULL;
+
+  g_assert (G_IS_TASK (task));
+  g_assert (SCHEMES_IS_PREVIEW (self));
+  g_assert (update != NULL);
+
+  if (!update_is_current (self, update))
+    goto superseded;
+
+  contents = schemes_scheme_snapshot_to_string (update->snapshot);
+
+  g_mutex_lock (&self->mutex);
+
+  /* A newer request may have arrived while waiting for the lock */
+  if (!update_is_current (self, update))
+    {
+      g_mutex_unlock (&self->mutex);
+      goto superseded;
+    }
+
+  if (!update->force && g_strcmp0 (contents, self->contents) == 0)
+    {
+      g_mutex_unlock (&self->mutex);
+      g_task_return_boolean (task, FALSE);
+      return;
+    }
+
+  if (!schemes_preview_write (self, contents))
+    {
+      g_mutex_unlock (&self->mutex);
+      g_task_return_new_error (task,
+                               G_IO_ERROR,
+                               G_IO_ERROR_FAILED,
+                               "Failed to write preview");
+      return;
+    }
+
+  g_mutex_unlock (&self->mutex);
+
+  /* The contents are only committed once applied on the main thread */
+  update->contents = g_steal_pointer (&contents);
+  g_task_return_boolean (task, TRUE);
+  return;
+
+superseded:
+  g_task_return_new_error (task,
+                           G_IO_ERROR,
+                           G_IO_ERROR_CANCELLED,
+                           "Preview was superseded by a newer one");
+}
+
+/* Serializes @scheme on a worker thread, the result is parsed when
+ * finishing. Only the newest request is applied, older ones complete
+ * with G_IO_ERROR_CANCELLED.
+ */
+void
+schemes_preview_update_async (SchemesPreview      *self,
+                              SchemesScheme       *scheme,
+                              GCancellable        *cancellable,
+                              GAsyncReadyCallback  callback,
+                              gpointer             user_data)
+{
+  g_autoptr(GTask) task = NULL;
+  Update *update;
+
+  g_return_if_fail (SCHEMES_IS_PREVIEW (self));
+  g_return_if_fail (SCHEMES_IS_SCHEME (scheme));
+  g_return_if_fail (!cancellable || G_IS_CANCELLABLE (cancellable));
+
+  update = g_new0 (Update, 1);
+  update->snapshot = schemes_scheme_snapshot (scheme);
+  update->generation = g_atomic_int_add (&self->generation, 1) + 1;
+  update->force = self->style_scheme == NULL || self->stale;
+
+  self->n_active++;
+
+  task = g_task_new (self, cancellable, callback, user_data);
+  g_task_set_source_tag (task, schemes_preview_update_async);
+  g_task_set_task_data (task, update, (GDestroyNotify)update_free);
+
+  /* This also sets the search path, which workers must not touch */
+  if (!schemes_preview_ensure_directory (self))
+    {
+      g_task_return_new_error (task,
+                               G_IO_ERROR,
+                               G_IO_ERROR_FAILED,
+                               "Failed to create preview directory");
+      return;
+    }
+
+  g_task_run_in_thread (task, schemes_preview_update_worker);
+}
+
+/* Applies the result to the buffer, so must always be called. Returns
+ * the style scheme owned by @self.
+ */
+GtkSourceStyleScheme *
+schemes_preview_update_finish (SchemesPreview  *self,
+                               GAsyncResult    *result,
+                               GError         **error)
+{
+  g_autoptr(GtkSourceStyleScheme) style_scheme = NULL;
+  g_autoptr(GError) local_error = NULL;
+  Update *update;
+  gboolean written;
+
+  g_return_val_if_fail (SCHEMES_IS_PREVIEW (self), NULL);
+  g_return_val_if_fail (g_task_is_valid (result, self), NULL);
+
+  update = g_task_get_task_data (G_TASK (result));
+
+  g_assert (self->n_active > 0);
+  self->n_active--;
+
+  written = g_task_propagate_boolean (G_TASK (result), &local_error);
+
+  if (local_error != NULL)
+    {
+      g_propagate_error (error, g_steal_pointer (&local_error));
+      return NULL;
+    }
+
+  /* Unchanged from what is already applied */
+  if (!written)
+    return self->style_scheme;
+
+  /* A newer request may have replaced the file already */
+  if (!update_is_current (self, update))
+    {
+      g_set_error_literal (error,
+                           G_IO_ERROR,
+                           G_IO_ERROR_CANCELLED,
+                           "Preview was superseded by a newer one");
+      return NULL;
+    }
+
+  g_mutex_lock (&self->mutex);
+  style_scheme = schemes_preview_load (self);
+  g_mutex_unlock (&self->mutex);
+
+  if (style_scheme == NULL)
+    {
+      g_set_error_literal (error,
+                           G_IO_ERROR,
+                           G_IO_ERROR_INVALID_DATA,
+                           "Failed to load preview");
+      return NULL;
+    }
+
+  schemes_preview_apply (self, style_scheme, g_steal_pointer (&update->contents));
+
+  return self->style_scheme;
+}
+
+/* Mirrors gtk_source_style_scheme_get_style(), which follows use-style
+ * references and ignores styles that would not be serialized.
+ */
+static gboolean
+get_scheme_style (SchemesScheme    *scheme,
+                  const char       *style_id,
+                  const char       *changed,
+                  gboolean         *touched,
+                  SchemesStyleData *data)
+{
+  for (guint depth = 0; style_id != NULL && depth < MAX_STYLE_DEPTH; depth++)
+    {
+      if (g_strcmp0 (style_id, changed) == 0)
+        *touched = TRUE;
+
+      if (!schemes_scheme_get_style_data (scheme, style_id, data))
+        return FALSE;
+
+      if (!data->use_style_set)
+        return TRUE;
+
+      style_id = data->use_style;
+    }
+
+  return FALSE;
+}
+
+/* Mirrors how GtkSourceContextEngine picks the style for a tag, falling
+ * back through the language "map-to" styles when it is missing.
+ */
+static gboolean
+resolve_style (SchemesScheme     *scheme,
+               GtkSourceLanguage *language,
+               const char        *style_id,
+               const char        *changed,
+               gboolean          *touched,
+               SchemesStyleData  *data)
+{
+  gboolean found = get_scheme_style (scheme, style_id, changed, touched, data);
+
+  for (guint depth = 0; !found && language != NULL && depth < MAX_STYLE_DEPTH; depth++)
+    {
+      if (!(style_id = gtk_source_language_get_style_fallback (language, style_id)))
+        break;
+
+      found = get_scheme_style (scheme, style_id, changed, touched, data);
+    }
+
+  return found;
+}
+
+static void
+apply_color (GtkTextTag        *tag,
+             const char        *property,
+             const char        *property_set,
+             const SchemesRGBA *rgba)
+{
+  if (rgba != NULL)
+    {
+      GdkRGBA gdk_rgba = { rgba->red, rgba->green, rgba->blue, rgba->alpha };
+      g_object_set (tag, property, &gdk_rgba, NULL);
+    }
+  else
+    {
+      g_object_set (tag, property_set, FALSE, NULL);
+    }
+}
+
+/* Same attributes that gtk_source_style_apply() sets on a tag. @data
+ * may be %NULL to unset all of them.
+ */
+static void
+apply_style (const SchemesStyleData *data,
+             GtkTextTag             *tag)
+{
+  static const SchemesStyleData empty = { .weight = PANGO_WEIGHT_NORMAL, .scale = 1.0 };
+
+  if (data == NULL)
+    data = &empty;
+
+  g_object_freeze_notify (G_OBJECT (tag));
+
+  apply_color (tag, "foreground-rgba", "foreground-set",
+               data->foreground_set ? &data->foreground : NULL);
+  apply_color (tag, "background-rgba", "background-set",
+               data->background_set ? &data->background : NULL);
+  apply_color (tag, "paragraph-background-rgba", "paragraph-background-set",
+               data->line_background_set ? &data->line_background : NULL);
+  apply_color (tag, "underline-rgba", "underline-rgba-set",
+               data->underline_color_set ? &data->underline_color : NULL);
+
+  if (data->weight_set)
+    g_object_set (tag, "weight", data->weight, NULL);
+  else if (data->bold_set)
+    g_object_set (tag, "weight", data->bold ? PANGO_WEIGHT_BOLD : PANGO_WEIGHT_NORMAL, NULL);
+  else
+    g_object_set (tag, "weight-set", FALSE, NULL);
+
+  if (data->italic_set)
+    g_object_set (tag, "style", data->italic ? PANGO_STYLE_ITALIC : PANGO_STYLE_NORMAL, NULL);
+  else
+    g_object_set (tag, "style-set", FALSE, NULL);
+
+  if (data->underline_set)
+    g_object_set (tag, "underline", data->underline, NULL);
+  else
+    g_object_set (tag, "underline-set", FALSE, NULL);
+
+  if (data->strikethrough_set)
+    g_object_set (tag, "strikethrough", (gboolean)data->strikethrough, NULL);
+  else
+    g_object_set (tag, "strikethrough-set", FALSE, NULL);
+
+  if (data->scale_set)
+    g_object_set (tag, "scale", data->scale, NULL);
+  else
+    g_object_set (tag, "scale-set", FALSE, NULL);
+
+  g_object_thaw_notify (G_OBJECT (tag));
+}
+
+/* Applies @style directly to the tags of the buffer that depend on it.
+ * Returns FALSE if that is not possible and a full update is required.
+ */
+gboolean
+schemes_preview_update_style (SchemesPreview *self,
+                              SchemesScheme  *scheme,
+                              SchemesStyle   *style)
+{
+  GtkSourceLanguage *language;
+  GHashTableIter iter;
+  const char *style_id;
+  const char *changed;
+  GtkTextTag *tag;
+  gboolean handled = FALSE;
+
+  g_return_val_if_fail (SCHEMES_IS_PREVIEW (self), FALSE);
+  g_return_val_if_fail (SCHEMES_IS_SCHEME (scheme), FALSE);
+  g_return_val_if_fail (SCHEMES_IS_STYLE (style), FALSE);
+
+  /* An older full preview could still replace the edited tags */
+  if (self->n_active > 0)
+    return FALSE;
+
+  if (!schemes_preview_ensure_tags (self))
+    return FALSE;
+
+  language = gtk_source_buffer_get_language (self->buffer);
+  changed = schemes_style_get_name (style);
+
+  g_hash_table_iter_init (&iter, self->tags);
+  while (g_hash_table_iter_next (&iter, (gpointer *)&style_id, (gpointer *)&tag))
+    {
+      SchemesStyleData data;
+      gboolean touched = FALSE;
+      gboolean found = resolve_style (scheme, language, style_id, changed, &touched, &data);
+
+      if (touched)
+        {
+          apply_style (found ? &data : NULL, tag);
+          handled = TRUE;
+        }
+    }
+
+  if (handled)
+    self->stale = TRUE;
+
+  return handled;
+}
@@ -0,0 +1,52 @@
+/* schemes-preview.h
+ *
+ * Copyright 2022 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+
+#pragma once
+
+#include <gtksourceview/gtksource.h>
+
+#include "schemes-scheme.h"
+
+G_BEGIN_DECLS
+
+#define SCHEMES_TYPE_PREVIEW (schemes_preview_get_type())
+
+G_DECLARE_FINAL_TYPE (SchemesPreview, schemes_preview, SCHEMES, PREVIEW, GObject)
+
+SchemesPreview       *schemes_preview_new              (void);
+void                  schemes_preview_set_buffer       (SchemesPreview  *self,
+                                                        GtkSourceBuffer *buffer);
+GtkSourceStyleScheme *schemes_preview_get_style_scheme (SchemesPreview  *self);
+GtkSourceStyleScheme *schemes_preview_update           (SchemesPreview  *self,
+                                                        SchemesScheme   *scheme);
+void                  schemes_preview_update_async     (SchemesPreview      *self,
+                                                        SchemesScheme       *scheme,
+                                                        GCancellable        *cancellable,
+                                                        GAsyncReadyCallback  callback,
+                                                        gpointer             user_data);
+GtkSourceStyleScheme *schemes_preview_update_finish    (SchemesPreview  *self,
+                                                        GAsyncResult    *result,
+                                                        GError         **error);
+gboolean              schemes_preview_update_style     (SchemesPreview  *self,
+                                                        SchemesScheme   *scheme,
+                                                        SchemesStyle    *style);
+
+G_END_DECLS
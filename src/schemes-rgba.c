@@ -0,0 +1,238 @@
+/* schemes-rgba.c
+ *
+ * Copyright 2022 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <math.h>
+#include <string.h>
+
+#include <pango/pango.h>
+
+#include "schemes-rgba.h"
+
+G_DEFINE_BOXED_TYPE (SchemesRGBA, schemes_rgba, schemes_rgba_copy, schemes_rgba_free)
+
+SchemesRGBA *
+schemes_rgba_copy (const SchemesRGBA *rgba)
+{
+  SchemesRGBA *copy;
+
+  g_return_val_if_fail (rgba != NULL, NULL);
+
+  copy = g_new (SchemesRGBA, 1);
+  *copy = *rgba;
+
+  return copy;
+}
+
+void
+schemes_rgba_free (SchemesRGBA *rgba)
+{
+  g_free (rgba);
+}
+
+static inline const char *
+skip_whitespace (const char *str)
+{
+  while (g_ascii_isspace (*str))
+    str++;
+  return str;
+}
+
+static gboolean
+parse_rgb_value (const char  *str,
+                 const char **endp,
+                 double      *number)
+{
+  char *end;
+
+  errno = 0;
+  *number = g_ascii_strtod (str, &end);
+  if (errno == ERANGE || end == str || isinf (*number) || isnan (*number))
+    return FALSE;
+
+  str = skip_whitespace (end);
+
+  if (*str == '%')
+    {
+      *endp = str + 1;
+      *number = CLAMP (*number / 100.0, 0.0, 1.0);
+    }
+  else
+    {
+      *endp = str;
+      *number = CLAMP (*number / 255.0, 0.0, 1.0);
+    }
+
+  return TRUE;
+}
+
+/* Follows gdk_rgba_parse() for everything that may appear in a
+ * style-scheme: color names, hex notation, rgb() and rgba().
+ */
+gboolean
+schemes_rgba_parse (SchemesRGBA *rgba,
+                    const char  *spec)
+{
+  gboolean has_alpha;
+  double r, g, b, a = 1.0;
+  const char *str = spec;
+
+  g_return_val_if_fail (spec != NULL, FALSE);
+
+  if (strncmp (str, "rgba", 4) == 0)
+    {
+      has_alpha = TRUE;
+      str += 4;
+    }
+  else if (strncmp (str, "rgb", 3) == 0)
+    {
+      has_alpha = FALSE;
+      str += 3;
+    }
+  else
+    {
+      PangoColor pango_color;
+      guint16 alpha;
+
+      if (!pango_color_parse_with_alpha (&pango_color, &alpha, str))
+        return FALSE;
+
+      if (rgba != NULL)
+        {
+          rgba->red = pango_color.red / 65535.0;
+          rgba->green = pango_color.green / 65535.0;
+          rgba->blue = pango_color.blue / 65535.0;
+          rgba->alpha = alpha / 65535.0;
+        }
+
+      return TRUE;
+    }
+
+  str = skip_whitespace (str);
+  if (*str != '(')
+    return FALSE;
+
+  str = skip_whitespace (str + 1);
+  if (!parse_rgb_value (str, &str, &r))
+    return FALSE;
+
+  str = skip_whitespace (str);
+  if (*str != ',')
+    return FALSE;
+
+  str = skip_whitespace (str + 1);
+  if (!parse_rgb_value (str, &str, &g))
+    return FALSE;
+
+  str = skip_whitespace (str);
+  if (*str != ',')
+    return FALSE;
+
+  str = skip_whitespace (str + 1);
+  if (!parse_rgb_value (str, &str, &b))
+    return FALSE;
+
+  str = skip_whitespace (str);
+
+  if (has_alpha)
+    {
+      char *end;
+
+      if (*str != ',')
+        return FALSE;
+
+      str = skip_whitespace (str + 1);
+
+      errno = 0;
+      a = g_ascii_strtod (str, &end);
+      if (errno == ERANGE || end == str || isinf (a) || isnan (a))
+        return FALSE;
+
+      str = skip_whitespace (end);
+    }
+
+  if (*str != ')')
+    return FALSE;
+
+  str = skip_whitespace (str + 1);
+  if (*str != 0)
+    return FALSE;
+
+  if (rgba != NULL)
+    {
+      rgba->red = r;
+      rgba->green = g;
+      rgba->blue = b;
+      rgba->alpha = CLAMP (a, 0.0, 1.0);
+    }
+
+  return TRUE;
+}
+
+/* Same output as gdk_rgba_to_string() so saved files do not change */
+char *
+schemes_rgba_to_string (const SchemesRGBA *rgba)
+{
+  g_return_val_if_fail (rgba != NULL, NULL);
+
+  if (rgba->alpha > 0.999)
+    return g_strdup_printf ("rgb(%d,%d,%d)",
+                            (int)(0.5 + CLAMP (rgba->red, 0., 1.) * 255.),
+                            (int)(0.5 + CLAMP (rgba->green, 0., 1.) * 255.),
+                            (int)(0.5 + CLAMP (rgba->blue, 0., 1.) * 255.));
+  else
+    {
+      char alpha[G_ASCII_DTOSTR_BUF_SIZE];
+
+      g_ascii_formatd (alpha, sizeof alpha, "%g", CLAMP (rgba->alpha, 0, 1));
+
+      return g_strdup_printf ("rgba(%d,%d,%d,%s)",
+                              (int)(0.5 + CLAMP (rgba->red, 0., 1.) * 255.),
+                              (int)(0.5 + CLAMP (rgba->green, 0., 1.) * 255.),
+                              (int)(0.5 + CLAMP (rgba->blue, 0., 1.) * 255.),
+                              alpha);
+    }
+}
+
+gboolean
+schemes_rgba_equal (const SchemesRGBA *a,
+                    const SchemesRGBA *b)
+{
+  g_return_val_if_fail (a != NULL, FALSE);
+  g_return_val_if_fail (b != NULL, FALSE);
+
+  return a->red == b->red &&
+         a->green == b->green &&
+         a->blue == b->blue &&
+         a->alpha == b->alpha;
+}
+
+guint
+schemes_rgba_hash (gconstpointer data)
+{
+  const SchemesRGBA *rgba = data;
+
+  return ((guint)(rgba->red * 255.f) << 24) ^
+         ((guint)(rgba->green * 255.f) << 16) ^
+         ((guint)(rgba->blue * 255.f) << 8) ^
+         (guint)(rgba->alpha * 255.f);
+}
@@ -0,0 +1,52 @@
+/* schemes-rgba.h
+ *
+ * Copyright 2022 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+#define SCHEMES_TYPE_RGBA (schemes_rgba_get_type())
+
+/* Same layout as GdkRGBA so that the UI can convert between the two
+ * without touching the model, which must not depend on GTK.
+ */
+typedef struct _SchemesRGBA
+{
+  float red;
+  float green;
+  float blue;
+  float alpha;
+} SchemesRGBA;
+
+GType        schemes_rgba_get_type  (void) G_GNUC_CONST;
+SchemesRGBA *schemes_rgba_copy      (const SchemesRGBA *rgba);
+void         schemes_rgba_free      (SchemesRGBA       *rgba);
+gboolean     schemes_rgba_parse     (SchemesRGBA       *rgba,
+                                     const char        *spec);
+char        *schemes_rgba_to_string (const SchemesRGBA *rgba);
+gboolean     schemes_rgba_equal     (const SchemesRGBA *a,
+                                     const SchemesRGBA *b);
+guint        schemes_rgba_hash      (gconstpointer      data);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (SchemesRGBA, schemes_rgba_free)
+
+G_END_DECLS
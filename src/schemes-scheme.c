@@ -20,19 +20,58 @@
 
 #include "config.h"
 
-#include <glib/gstdio.h>
 #include <math.h>
 #include <stdlib.h>
 
+#include "schemes-history.h"
 #include "schemes-scheme.h"
 #include "schemes-xml.h"
 
+/* A color or style as captured by snapshots. Entries do not change
+ * once created, except for @fragment which any thread may fill in, so
+ * they are shared between the scheme and its snapshots.
+ */
+typedef struct
+{
+  gconstpointer  key;
+  const char    *name;
+  const char    *language_name;
+  GBytes        *fragment;
+  guint          hash;
+  union {
+    SchemesRGBA      rgba;
+    SchemesStyleData style;
+  } u;
+} SnapshotEntry;
+
+/* Entries in the order they are written, with the keys changed since
+ * they were last updated. @hash is the sum of the entry hashes so it
+ * can be kept up to date without going over all of them.
+ */
+typedef struct
+{
+  GPtrArray    *entries;
+  GHashTable   *by_key;
+  GHashTable   *dirty;
+  GCompareFunc  compare;
+  guint         hash;
+} SnapshotEntries;
+
 struct _SchemesScheme
 {
   GObject parent_instance;
   GFile *file;
   GListStore *colors;
-  GHashTable *styles;
+  GHashTable *colors_by_name;
+  SchemesStyleTable *styles;
+
+  /* SchemesColor to a set of style rows, with the mask of attributes
+   * following that color. style_colors has what each row was indexed
+   * with, so it can be removed once the row changes. Rows are stored
+   * as row + 1.
+   */
+  GHashTable *styles_by_color;
+  GHashTable *style_colors;
   char *version;
   char *alternate;
   char *id;
@@ -40,6 +79,43 @@ struct _SchemesScheme
   char *author;
   char *description;
 
+  /* Cached until the next change */
+  SchemesSchemeSnapshot *snapshot;
+
+  /* What snapshots capture, keyed by SchemesColor and by interned
+   * style name. Changes are applied when the next snapshot is taken.
+   * Names are counted by length to know the longest without measuring
+   * all of them.
+   */
+  SnapshotEntries color_entries;
+  SnapshotEntries style_entries;
+  GArray *name_lengths;
+  guint longest_name;
+  GHashTable *language_names;
+
+  /* Within begin_update()/end_update(), "changed" is deferred and
+   * colors are added to the store in one splice when it ends.
+   */
+  guint update_depth;
+  SchemesSchemeChanges pending_changes;
+  GPtrArray *pending_colors;
+
+  /* Undo and redo, with whether they were possible when last notified */
+  SchemesHistory *history;
+
+  /* What is known to be on disk for saved_file, so that saving an
+   * unchanged scheme does not write anything.
+   */
+  GFile *saved_file;
+  char *saved_digest;
+  char *saved_etag;
+
+  /* Saves are written in the order they were requested, older ones
+   * being skipped once a newer one is pending.
+   */
+  GMutex save_mutex;
+  guint save_generation;
+
   /* Parsing related data */
   const char *element_name;
   const char *property_name;
@@ -49,11 +125,168 @@ struct _SchemesScheme
     guint failed : 1;
   } parse_failure;
 
+  /* Where the element being parsed starts, either as a line and
+   * character or as a pointer into the document for the fast path.
+   */
+  struct {
+    const char *pos;
+    int line_pos;
+    int char_pos;
+  } parse_position;
+
+  /* References to named colors which were not known yet when parsing
+   * a style, resolved once the whole document has been parsed.
+   */
+  GArray *color_fixups;
+
   guint dark : 1;
+  guint can_undo : 1;
+  guint can_redo : 1;
 };
 
+typedef struct
+{
+  const char        *style;
+  char              *color;
+  const char        *pos;
+  int                line_pos;
+  int                char_pos;
+  SchemesStyleColor  which;
+} ColorFixup;
+
+static void
+color_fixup_clear (ColorFixup *fixup)
+{
+  g_clear_pointer (&fixup->color, g_free);
+}
+
+static void
+snapshot_entry_finalize (gpointer data)
+{
+  SnapshotEntry *entry = data;
+
+  g_clear_pointer (&entry->fragment, g_bytes_unref);
+}
+
+static SnapshotEntry *
+snapshot_entry_ref (SnapshotEntry *entry)
+{
+  return g_atomic_rc_box_acquire (entry);
+}
+
+static void
+snapshot_entry_unref (SnapshotEntry *entry)
+{
+  g_atomic_rc_box_release_full (entry, snapshot_entry_finalize);
+}
+
+static inline guint
+style_language_class (const char *language)
+{
+  if (language == NULL)
+    return 0;
+  else if (strcmp (language, "def") == 0)
+    return 1;
+  else
+    return 2;
+}
+
+/* Compares the text before ':', styles without one have no language */
+static gboolean
+same_language_prefix (const char *a,
+                      const char *b)
+{
+  const char *colon_a = strchr (a, ':');
+  const char *colon_b = strchr (b, ':');
+
+  if (colon_a == NULL || colon_b == NULL)
+    return colon_a == colon_b;
+
+  return colon_a - a == colon_b - b && strncmp (a, b, colon_a - a) == 0;
+}
+
+/* A style using another one of the same language sorts right after
+ * it. Following a style of another language would split the styles of
+ * this one, repeating the language header when serialized.
+ */
+static inline const char *
+style_sort_name (const SchemesStyleData *data)
+{
+  if (data->use_style_set &&
+      data->use_style != NULL &&
+      data->name != NULL &&
+      same_language_prefix (data->use_style, data->name) &&
+      g_strcmp0 (data->use_style, data->name) > 0)
+    return data->use_style;
+
+  return data->name;
+}
+
+static int
+compare_style_entries (gconstpointer a,
+                       gconstpointer b)
+{
+  const SchemesStyleData *style_a = &((const SnapshotEntry *)a)->u.style;
+  const SchemesStyleData *style_b = &((const SnapshotEntry *)b)->u.style;
+  gboolean uses_a = style_a->use_style_set && style_a->use_style != NULL;
+  gboolean uses_b = style_b->use_style_set && style_b->use_style != NULL;
+  int ret;
+
+  /* Styles without a language first, then def: and everything else */
+  if ((ret = (int)style_language_class (style_a->language) - (int)style_language_class (style_b->language)) ||
+      (ret = g_strcmp0 (style_sort_name (style_a), style_sort_name (style_b))) ||
+      (ret = uses_a - uses_b))
+    return ret;
+
+  return g_strcmp0 (style_a->name, style_b->name);
+}
+
+static int
+compare_color_entries (gconstpointer a,
+                       gconstpointer b)
+{
+  const SnapshotEntry *entry_a = a;
+  const SnapshotEntry *entry_b = b;
+  const float *rgba_a = &entry_a->u.rgba.red;
+  const float *rgba_b = &entry_b->u.rgba.red;
+  int ret;
+
+  if ((ret = g_strcmp0 (entry_a->name, entry_b->name)))
+    return ret;
+
+  /* Colors sharing a name still need a stable order */
+  for (guint i = 0; i < 4; i++)
+    {
+      if (rgba_a[i] != rgba_b[i])
+        return rgba_a[i] < rgba_b[i] ? -1 : 1;
+    }
+
+  return 0;
+}
+
+static void
+snapshot_entries_init (SnapshotEntries *entries,
+                       GCompareFunc     compare)
+{
+  entries->entries = g_ptr_array_new_with_free_func ((GDestroyNotify)snapshot_entry_unref);
+  entries->by_key = g_hash_table_new (NULL, NULL);
+  entries->dirty = g_hash_table_new (NULL, NULL);
+  entries->compare = compare;
+  entries->hash = 0;
+}
+
+static void
+snapshot_entries_clear (SnapshotEntries *entries)
+{
+  g_clear_pointer (&entries->entries, g_ptr_array_unref);
+  g_clear_pointer (&entries->by_key, g_hash_table_unref);
+  g_clear_pointer (&entries->dirty, g_hash_table_unref);
+}
+
 G_DEFINE_TYPE (SchemesScheme, schemes_scheme, G_TYPE_OBJECT)
 
+static SchemesLanguageNameFunc language_name_func;
+
 enum {
   PROP_0,
   PROP_AUTHOR,
@@ -64,14 +297,21 @@ enum {
   PROP_NAME,
   PROP_DARK,
   PROP_ALTERNATE,
+  PROP_CAN_UNDO,
+  PROP_CAN_REDO,
   N_PROPS
 };
 
 enum {
   CHANGED,
+  STYLE_CHANGED,
   N_SIGNALS
 };
 
+/* How much is loaded between checking for cancellation */
+#define LOAD_SLICE_SIZE   (64 * 1024)
+#define LOAD_SLICE_TOKENS 4096
+
 #define XML_PARSER_ERROR() \
   G_STMT_START { \
     int line_pos, char_pos; \
@@ -94,6 +334,14 @@ static void root_start_element (GMarkupParseContext  *context,
                                 const char          **attribute_values,
                                 gpointer              user_data,
                                 GError              **error);
+typedef struct _LoadProgress LoadProgress;
+static gboolean schemes_scheme_load_tokens (SchemesScheme *self,
+                                            const char    *contents,
+                                            gsize          len,
+                                            LoadProgress  *progress,
+                                            GCancellable  *cancellable);
+static void     resolve_color_fixups       (SchemesScheme *self,
+                                            const char    *contents);
 
 static GParamSpec *properties [N_PROPS];
 static guint signals [N_SIGNALS];
@@ -104,12 +352,49 @@ str_empty0 (const char *str)
   return str == NULL || str[0] == 0;
 }
 
+/* Trims whitespace from @text in place of copying it, as most text
+ * nodes are only the whitespace between elements.
+ */
+static const char *
+strip_text (const char *text,
+            gsize      *len)
+{
+  const char *end = text + *len;
+
+  while (text < end && g_ascii_isspace (*text))
+    text++;
+
+  while (end > text && g_ascii_isspace (end[-1]))
+    end--;
+
+  *len = end - text;
+
+  return text;
+}
+
+static void
+schemes_scheme_invalidate (SchemesScheme *self)
+{
+  g_assert (SCHEMES_IS_SCHEME (self));
+
+  g_clear_pointer (&self->snapshot, schemes_scheme_snapshot_unref);
+}
+
 static void
-schemes_scheme_emit_changed (SchemesScheme *self)
+schemes_scheme_emit_changed (SchemesScheme        *self,
+                             SchemesSchemeChanges  changes)
 {
   g_assert (SCHEMES_IS_SCHEME (self));
 
-  g_signal_emit (self, signals [CHANGED], 0);
+  schemes_scheme_invalidate (self);
+
+  if (self->update_depth > 0)
+    {
+      self->pending_changes |= changes;
+      return;
+    }
+
+  g_signal_emit (self, signals [CHANGED], 0, changes);
 }
 
 static void
@@ -117,7 +402,16 @@ do_notify (SchemesScheme *self,
            guint          prop_id)
 {
   g_object_notify_by_pspec (G_OBJECT (self), properties [prop_id]);
-  schemes_scheme_emit_changed (self);
+  schemes_scheme_emit_changed (self, SCHEMES_SCHEME_CHANGES_METADATA);
+}
+
+/* The model does not know about GtkSourceView, so the application
+ * provides the human readable language names used in comments.
+ */
+void
+schemes_scheme_set_language_name_func (SchemesLanguageNameFunc func)
+{
+  language_name_func = func;
 }
 
 SchemesScheme *
@@ -126,6 +420,54 @@ schemes_scheme_new (void)
   return g_object_new (SCHEMES_TYPE_SCHEME, NULL);
 }
 
+/* Groups changes so that property notifications are frozen and a
+ * single "changed" is emitted with all of them once the outermost
+ * schemes_scheme_end_update() is called. Colors added meanwhile only
+ * appear in schemes_scheme_get_colors() then.
+ */
+void
+schemes_scheme_begin_update (SchemesScheme *self)
+{
+  g_return_if_fail (SCHEMES_IS_SCHEME (self));
+
+  if (self->update_depth++ == 0)
+    g_object_freeze_notify (G_OBJECT (self));
+
+  schemes_history_begin_group (self->history);
+}
+
+void
+schemes_scheme_end_update (SchemesScheme *self)
+{
+  SchemesSchemeChanges changes;
+
+  g_return_if_fail (SCHEMES_IS_SCHEME (self));
+  g_return_if_fail (self->update_depth > 0);
+
+  schemes_history_end_group (self->history);
+
+  if (--self->update_depth > 0)
+    return;
+
+  if (self->pending_colors->len > 0)
+    {
+      g_list_store_splice (self->colors,
+                           g_list_model_get_n_items (G_LIST_MODEL (self->colors)),
+                           0,
+                           self->pending_colors->pdata,
+                           self->pending_colors->len);
+      g_ptr_array_set_size (self->pending_colors, 0);
+    }
+
+  changes = self->pending_changes;
+  self->pending_changes = SCHEMES_SCHEME_CHANGES_NONE;
+
+  g_object_thaw_notify (G_OBJECT (self));
+
+  if (changes != SCHEMES_SCHEME_CHANGES_NONE)
+    g_signal_emit (self, signals [CHANGED], 0, changes);
+}
+
 static void
 schemes_scheme_finalize (GObject *object)
 {
@@ -137,8 +479,26 @@ schemes_scheme_finalize (GObject *object)
   g_clear_pointer (&self->name, g_free);
   g_clear_pointer (&self->description, g_free);
   g_clear_pointer (&self->alternate, g_free);
-  g_clear_pointer (&self->styles, g_hash_table_unref);
+  /* Views handed out may outlive us and keep the table alive */
+  schemes_style_table_set_changed_func (self->styles, NULL, NULL);
+  g_clear_pointer (&self->history, schemes_history_free);
+  g_clear_object (&self->file);
+  g_clear_object (&self->saved_file);
+  g_clear_pointer (&self->saved_digest, g_free);
+  g_clear_pointer (&self->saved_etag, g_free);
+  g_mutex_clear (&self->save_mutex);
+  g_clear_pointer (&self->styles, schemes_style_table_unref);
+  g_clear_pointer (&self->colors_by_name, g_hash_table_unref);
+  g_clear_pointer (&self->styles_by_color, g_hash_table_unref);
+  g_clear_pointer (&self->style_colors, g_hash_table_unref);
   g_clear_object (&self->colors);
+  g_clear_pointer (&self->pending_colors, g_ptr_array_unref);
+  g_clear_pointer (&self->color_fixups, g_array_unref);
+  g_clear_pointer (&self->snapshot, schemes_scheme_snapshot_unref);
+  snapshot_entries_clear (&self->color_entries);
+  snapshot_entries_clear (&self->style_entries);
+  g_clear_pointer (&self->name_lengths, g_array_unref);
+  g_clear_pointer (&self->language_names, g_hash_table_unref);
 
   G_OBJECT_CLASS (schemes_scheme_parent_class)->finalize (object);
 }
@@ -185,6 +545,14 @@ schemes_scheme_get_property (GObject    *object,
       g_value_set_string (value, schemes_scheme_get_description (self));
       break;
 
+    case PROP_CAN_UNDO:
+      g_value_set_boolean (value, schemes_scheme_can_undo (self));
+      break;
+
+    case PROP_CAN_REDO:
+      g_value_set_boolean (value, schemes_scheme_can_redo (self));
+      break;
+
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
     }
@@ -282,8 +650,19 @@ schemes_scheme_class_init (SchemesSchemeClass *klass)
                          "",
                          (G_PARAM_READWRITE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS));
 
+  properties [PROP_CAN_UNDO] =
+    g_param_spec_boolean ("can-undo", NULL, NULL,
+                          FALSE,
+                          (G_PARAM_READABLE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS));
+
+  properties [PROP_CAN_REDO] =
+    g_param_spec_boolean ("can-redo", NULL, NULL,
+                          FALSE,
+                          (G_PARAM_READABLE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS));
+
   g_object_class_install_properties (object_class, N_PROPS, properties);
 
+  /* The argument is the SchemesSchemeChanges that happened */
   signals [CHANGED] =
     g_signal_new ("changed",
                   G_TYPE_FROM_CLASS (klass),
@@ -291,7 +670,237 @@ schemes_scheme_class_init (SchemesSchemeClass *klass)
                   0,
                   NULL, NULL,
                   NULL,
-                  G_TYPE_NONE, 0);
+                  G_TYPE_NONE, 1, G_TYPE_UINT);
+
+  /* Emitted before "changed" when only the attributes of a single
+   * style were modified, so that views may update just that style.
+   * Not emitted within schemes_scheme_begin_update().
+   */
+  signals [STYLE_CHANGED] =
+    g_signal_new ("style-changed",
+                  G_TYPE_FROM_CLASS (klass),
+                  G_SIGNAL_RUN_LAST,
+                  0,
+                  NULL, NULL,
+                  NULL,
+                  G_TYPE_NONE, 1, SCHEMES_TYPE_STYLE);
+}
+
+typedef struct
+{
+  SchemesColor *colors[SCHEMES_STYLE_N_COLORS];
+  guint         mask;
+} StyleColors;
+
+typedef struct
+{
+  guint row;
+  guint mask;
+} StyleUse;
+
+static void
+schemes_scheme_unindex_style (SchemesScheme *self,
+                              guint          row)
+{
+  gpointer key = GUINT_TO_POINTER (row + 1);
+  StyleColors *indexed;
+
+  if (!(indexed = g_hash_table_lookup (self->style_colors, key)))
+    return;
+
+  for (guint i = 0; i < SCHEMES_STYLE_N_COLORS; i++)
+    {
+      GHashTable *users;
+      guint mask;
+
+      if (!(indexed->mask & (1 << i)) ||
+          !(users = g_hash_table_lookup (self->styles_by_color, indexed->colors[i])))
+        continue;
+
+      mask = GPOINTER_TO_UINT (g_hash_table_lookup (users, key)) & ~(1 << i);
+
+      if (mask != 0)
+        g_hash_table_insert (users, key, GUINT_TO_POINTER (mask));
+      else if (g_hash_table_remove (users, key) && g_hash_table_size (users) == 0)
+        g_hash_table_remove (self->styles_by_color, indexed->colors[i]);
+    }
+
+  g_hash_table_remove (self->style_colors, key);
+}
+
+static void
+schemes_scheme_index_style (SchemesScheme *self,
+                            guint          row)
+{
+  gpointer key = GUINT_TO_POINTER (row + 1);
+  StyleColors *indexed;
+
+  schemes_scheme_unindex_style (self, row);
+
+  indexed = g_new0 (StyleColors, 1);
+
+  for (guint i = 0; i < SCHEMES_STYLE_N_COLORS; i++)
+    {
+      SchemesColor *color;
+      GHashTable *users;
+      guint mask;
+
+      if (schemes_style_table_get_color (self->styles, row, i) == NULL ||
+          !(color = schemes_style_table_get_color_ref (self->styles, row, i)))
+        continue;
+
+      if (!(users = g_hash_table_lookup (self->styles_by_color, color)))
+        {
+          users = g_hash_table_new (NULL, NULL);
+          g_hash_table_insert (self->styles_by_color, color, users);
+        }
+
+      mask = GPOINTER_TO_UINT (g_hash_table_lookup (users, key)) | (1 << i);
+      g_hash_table_insert (users, key, GUINT_TO_POINTER (mask));
+
+      indexed->colors[i] = color;
+      indexed->mask |= 1 << i;
+    }
+
+  if (indexed->mask != 0)
+    g_hash_table_insert (self->style_colors, key, indexed);
+  else
+    g_free (indexed);
+}
+
+/* Updating the styles re-indexes them, so callers work from a copy */
+static GArray *
+get_color_users (SchemesScheme *self,
+                 SchemesColor  *color)
+{
+  GHashTable *users;
+  GHashTableIter iter;
+  gpointer k, v;
+  GArray *ar;
+
+  ar = g_array_new (FALSE, FALSE, sizeof (StyleUse));
+
+  if (!(users = g_hash_table_lookup (self->styles_by_color, color)))
+    return ar;
+
+  g_hash_table_iter_init (&iter, users);
+  while (g_hash_table_iter_next (&iter, &k, &v))
+    {
+      StyleUse use = { GPOINTER_TO_UINT (k) - 1, GPOINTER_TO_UINT (v) };
+      g_array_append_val (ar, use);
+    }
+
+  return ar;
+}
+
+/* Makes the styles following @color take @color again, or become
+ * literals when @color is %NULL.
+ */
+static void
+schemes_scheme_update_color_users (SchemesScheme *self,
+                                   SchemesColor  *color,
+                                   gboolean       unlink)
+{
+  g_autoptr(GArray) users = get_color_users (self, color);
+
+  for (guint i = 0; i < users->len; i++)
+    {
+      const StyleUse *use = &g_array_index (users, StyleUse, i);
+
+      for (guint j = 0; j < SCHEMES_STYLE_N_COLORS; j++)
+        {
+          if (use->mask & (1 << j))
+            schemes_style_table_set_color_ref (self->styles, use->row, j, unlink ? NULL : color);
+        }
+    }
+}
+
+static void
+on_style_changed_cb (SchemesStyleTable       *styles,
+                     guint                    row,
+                     SchemesStyleAttribute    attribute,
+                     gboolean                 set_changed,
+                     const SchemesStyleValue *previous,
+                     gpointer                 user_data)
+{
+  SchemesScheme *self = user_data;
+  SchemesDelta delta = { SCHEMES_DELTA_STYLE, attribute };
+  SchemesStyle *style;
+
+  g_assert (SCHEMES_IS_SCHEME (self));
+
+  delta.u.style.name = schemes_style_table_get_name (styles, row);
+  delta.u.style.value = *previous;
+  g_hash_table_add (self->style_entries.dirty, (gpointer)delta.u.style.name);
+  if (previous->color != NULL)
+    g_object_ref (previous->color);
+
+  /* Linking to a named color while indexing is part of the same step */
+  schemes_history_begin_group (self->history);
+  schemes_history_record (self->history, &delta);
+  schemes_scheme_index_style (self, row);
+  schemes_history_end_group (self->history);
+
+  /* Only views that were requested have anyone to tell */
+  if (self->update_depth == 0 &&
+      (style = (SchemesStyle *)schemes_style_table_get_view (styles, schemes_style_table_get_name (styles, row))))
+    g_signal_emit (self, signals [STYLE_CHANGED], 0, style);
+
+  schemes_scheme_emit_changed (self, SCHEMES_SCHEME_CHANGES_STYLES);
+}
+
+static void
+on_history_changed_cb (SchemesHistory *history,
+                       gpointer        user_data)
+{
+  SchemesScheme *self = user_data;
+  gboolean can_undo = schemes_history_can_undo (history);
+  gboolean can_redo = schemes_history_can_redo (history);
+
+  g_assert (SCHEMES_IS_SCHEME (self));
+
+  if (can_undo != self->can_undo)
+    {
+      self->can_undo = can_undo;
+      g_object_notify_by_pspec (G_OBJECT (self), properties [PROP_CAN_UNDO]);
+    }
+
+  if (can_redo != self->can_redo)
+    {
+      self->can_redo = can_redo;
+      g_object_notify_by_pspec (G_OBJECT (self), properties [PROP_CAN_REDO]);
+    }
+}
+
+static void
+schemes_scheme_record_metadata (SchemesScheme *self,
+                                guint          prop_id,
+                                const char    *string,
+                                gboolean       boolean)
+{
+  SchemesDelta delta = { SCHEMES_DELTA_METADATA, prop_id };
+
+  delta.u.metadata.string = g_strdup (string);
+  delta.u.metadata.boolean = boolean;
+
+  schemes_history_record (self->history, &delta);
+}
+
+static void
+schemes_scheme_record_color (SchemesScheme     *self,
+                             SchemesDeltaKind   kind,
+                             SchemesColor      *color,
+                             const SchemesRGBA *rgba,
+                             guint              position)
+{
+  SchemesDelta delta = { kind };
+
+  delta.u.color.color = g_object_ref (color);
+  if (rgba != NULL)
+    delta.u.color.rgba = *rgba;
+  delta.u.color.position = position;
+
+  schemes_history_record (self->history, &delta);
 }
 
 static void
@@ -301,6 +910,22 @@ schemes_scheme_init (SchemesScheme *self)
   self->name = g_strdup ("");
   self->description = g_strdup ("");
   self->colors = g_list_store_new (SCHEMES_TYPE_COLOR);
+  self->pending_colors = g_ptr_array_new_with_free_func (g_object_unref);
+  self->color_fixups = g_array_new (FALSE, FALSE, sizeof (ColorFixup));
+  g_array_set_clear_func (self->color_fixups, (GDestroyNotify)color_fixup_clear);
+  self->colors_by_name = g_hash_table_new (g_str_hash, g_str_equal);
+  self->styles_by_color = g_hash_table_new_full (NULL, NULL, NULL,
+                                                 (GDestroyNotify)g_hash_table_unref);
+  self->style_colors = g_hash_table_new_full (NULL, NULL, NULL, g_free);
+  snapshot_entries_init (&self->color_entries, compare_color_entries);
+  snapshot_entries_init (&self->style_entries, compare_style_entries);
+  self->name_lengths = g_array_new (FALSE, TRUE, sizeof (guint));
+  self->language_names = g_hash_table_new (NULL, NULL);
+  self->styles = schemes_style_table_new ();
+  schemes_style_table_set_changed_func (self->styles, on_style_changed_cb, self);
+  self->history = schemes_history_new ();
+  g_mutex_init (&self->save_mutex);
+  schemes_history_set_changed_func (self->history, on_history_changed_cb, self);
   self->author = g_strdup (g_get_real_name ());
 }
 
@@ -320,6 +945,7 @@ schemes_scheme_set_id (SchemesScheme *self,
 
   if (g_strcmp0 (self->id, id) != 0)
     {
+      schemes_scheme_record_metadata (self, PROP_ID, self->id, FALSE);
       g_free (self->id);
       self->id = g_strdup (id);
       do_notify (self, PROP_ID);
@@ -361,6 +987,7 @@ schemes_scheme_set_name (SchemesScheme *self,
 
   if (g_strcmp0 (self->name, name) != 0)
     {
+      schemes_scheme_record_metadata (self, PROP_NAME, self->name, FALSE);
       g_free (self->name);
       self->name = g_strdup (name);
       do_notify (self, PROP_NAME);
@@ -383,6 +1010,7 @@ schemes_scheme_set_description (SchemesScheme *self,
 
   if (g_strcmp0 (self->description, description) != 0)
     {
+      schemes_scheme_record_metadata (self, PROP_DESCRIPTION, self->description, FALSE);
       g_free (self->description);
       self->description = g_strdup (description);
       do_notify (self, PROP_DESCRIPTION);
@@ -397,52 +1025,129 @@ schemes_scheme_get_colors (SchemesScheme *self)
   return G_LIST_MODEL (self->colors);
 }
 
+/* Names are construct-only, so the index borrows them from the colors
+ * which are kept alive by self->colors. When names collide the first
+ * color wins, as it did with a linear scan.
+ */
 static void
-on_color_changed_cb (SchemesScheme *self,
-                     const GdkRGBA *previous_color,
-                     SchemesColor  *color)
+schemes_scheme_index_color (SchemesScheme *self,
+                            SchemesColor  *color)
 {
-  const GdkRGBA *new_color;
-  SchemesStyle *style;
-  const char *key;
-  GHashTableIter iter;
+  const char *name = schemes_color_get_name (color);
 
-  g_assert (SCHEMES_IS_SCHEME (self));
-  g_assert (SCHEMES_IS_COLOR (color));
+  if (name != NULL && !g_hash_table_contains (self->colors_by_name, name))
+    g_hash_table_insert (self->colors_by_name, (char *)name, color);
+}
+
+static void
+schemes_scheme_unindex_color (SchemesScheme *self,
+                              SchemesColor  *color)
+{
+  const char *name = schemes_color_get_name (color);
+  guint n_items;
+
+  if (name == NULL || g_hash_table_lookup (self->colors_by_name, name) != color)
+    return;
 
-  new_color = schemes_color_get_color (color);
+  g_hash_table_remove (self->colors_by_name, name);
 
-  g_hash_table_iter_init (&iter, self->styles);
-  while (g_hash_table_iter_next (&iter, (gpointer *)&key, (gpointer *)&style))
+  /* Fallback to another color with the same name, if any */
+  n_items = g_list_model_get_n_items (G_LIST_MODEL (self->colors));
+  for (guint i = 0; i < n_items; i++)
     {
-      g_assert (key != NULL);
-      g_assert (style != NULL);
+      g_autoptr(SchemesColor) item = g_list_model_get_item (G_LIST_MODEL (self->colors), i);
 
-      schemes_style_replace_color (style, previous_color, new_color);
+      if (item != color && g_strcmp0 (name, schemes_color_get_name (item)) == 0)
+        {
+          schemes_scheme_index_color (self, item);
+          break;
+        }
     }
 }
 
-void
-schemes_scheme_add_color (SchemesScheme *self,
-                          SchemesColor  *color)
+static void
+on_color_changed_cb (SchemesScheme     *self,
+                     const SchemesRGBA *previous_color,
+                     SchemesColor      *color)
 {
-  g_return_if_fail (SCHEMES_IS_SCHEME (self));
-  g_return_if_fail (SCHEMES_IS_COLOR (color));
+  g_assert (SCHEMES_IS_SCHEME (self));
+  g_assert (SCHEMES_IS_COLOR (color));
+
+  /* Named colors are serialized even when no style uses them */
+  g_hash_table_insert (self->color_entries.dirty, color, GUINT_TO_POINTER (TRUE));
+  schemes_scheme_invalidate (self);
+
+  schemes_scheme_record_color (self, SCHEMES_DELTA_COLOR, color, previous_color, 0);
+
+  /* Reverting the color updates the styles following it again */
+  schemes_history_block (self->history);
+  schemes_scheme_update_color_users (self, color, FALSE);
+  schemes_history_unblock (self->history);
+}
+
+/* Positions past the end append, which within an update is deferred
+ * like any other color added.
+ */
+static void
+schemes_scheme_insert_color (SchemesScheme *self,
+                             SchemesColor  *color,
+                             guint          position)
+{
+  guint n_items;
+
+  g_assert (SCHEMES_IS_SCHEME (self));
+  g_assert (SCHEMES_IS_COLOR (color));
 
   g_signal_connect_object (color,
                            "color-changed",
                            G_CALLBACK (on_color_changed_cb),
                            self,
                            G_CONNECT_SWAPPED);
+  g_hash_table_insert (self->color_entries.dirty, color, GUINT_TO_POINTER (TRUE));
+
+  n_items = g_list_model_get_n_items (G_LIST_MODEL (self->colors));
+
+  if (position < n_items)
+    {
+      g_list_store_insert (self->colors, position, color);
+    }
+  else if (self->update_depth > 0)
+    {
+      position = n_items + self->pending_colors->len;
+      g_ptr_array_add (self->pending_colors, g_object_ref (color));
+    }
+  else
+    {
+      position = n_items;
+      g_list_store_append (self->colors, color);
+    }
+
+  schemes_scheme_index_color (self, color);
+  schemes_scheme_record_color (self, SCHEMES_DELTA_ADD_COLOR, color, NULL, position);
+}
+
+static void
+schemes_scheme_append_color (SchemesScheme *self,
+                             SchemesColor  *color)
+{
+  schemes_scheme_insert_color (self, color, G_MAXUINT);
+}
+
+void
+schemes_scheme_add_color (SchemesScheme *self,
+                          SchemesColor  *color)
+{
+  g_return_if_fail (SCHEMES_IS_SCHEME (self));
+  g_return_if_fail (SCHEMES_IS_COLOR (color));
 
-  g_list_store_append (self->colors, color);
-  schemes_scheme_emit_changed (self);
+  schemes_scheme_append_color (self, color);
+  schemes_scheme_emit_changed (self, SCHEMES_SCHEME_CHANGES_COLORS);
 }
 
 static void
-schemes_scheme_add_color_simple (SchemesScheme *self,
-                                 const char    *name,
-                                 const GdkRGBA *rgba)
+schemes_scheme_add_color_simple (SchemesScheme     *self,
+                                 const char        *name,
+                                 const SchemesRGBA *rgba)
 {
   g_autoptr(SchemesColor) color = NULL;
 
@@ -452,15 +1157,50 @@ schemes_scheme_add_color_simple (SchemesScheme *self,
   schemes_scheme_add_color (self, color);
 }
 
+/* @position is where @color was, to put it back there when undone */
+static void
+schemes_scheme_forget_color (SchemesScheme *self,
+                             SchemesColor  *color,
+                             guint          position)
+{
+  g_assert (SCHEMES_IS_SCHEME (self));
+  g_assert (SCHEMES_IS_COLOR (color));
+
+  g_signal_handlers_disconnect_by_func (color,
+                                        G_CALLBACK (on_color_changed_cb),
+                                        self);
+  g_hash_table_insert (self->color_entries.dirty, color, GUINT_TO_POINTER (FALSE));
+  schemes_scheme_unindex_color (self, color);
+
+  /* Styles keep the value but no longer follow the color. The removal
+   * is recorded last so undoing adds the color back first.
+   */
+  schemes_history_begin_group (self->history);
+  schemes_scheme_update_color_users (self, color, TRUE);
+  schemes_scheme_record_color (self, SCHEMES_DELTA_REMOVE_COLOR, color, NULL, position);
+  schemes_history_end_group (self->history);
+
+  schemes_scheme_emit_changed (self, SCHEMES_SCHEME_CHANGES_COLORS);
+}
+
 void
 schemes_scheme_remove_color (SchemesScheme *self,
                              SchemesColor  *color)
 {
   guint n_items;
+  guint pos;
 
   g_return_if_fail (SCHEMES_IS_SCHEME (self));
   g_return_if_fail (SCHEMES_IS_COLOR (color));
 
+  if (g_ptr_array_find (self->pending_colors, color, &pos))
+    {
+      g_autoptr(SchemesColor) item = g_ptr_array_steal_index (self->pending_colors, pos);
+      n_items = g_list_model_get_n_items (G_LIST_MODEL (self->colors));
+      schemes_scheme_forget_color (self, item, n_items + pos);
+      return;
+    }
+
   n_items = g_list_model_get_n_items (G_LIST_MODEL (self->colors));
 
   for (guint i = 0; i < n_items; i++)
@@ -469,11 +1209,8 @@ schemes_scheme_remove_color (SchemesScheme *self,
 
       if (item == color)
         {
-          g_signal_handlers_disconnect_by_func (color,
-                                                G_CALLBACK (on_color_changed_cb),
-                                                self);
           g_list_store_remove (self->colors, i);
-          schemes_scheme_emit_changed (self);
+          schemes_scheme_forget_color (self, item, i);
           break;
         }
     }
@@ -535,10 +1272,12 @@ Columns: 3
   if (pos < 0)
     goto failure;
 
+  schemes_scheme_begin_update (self);
+
   for (guint i = pos; i < n_lines; i++)
     {
       g_autoptr(SchemesColor) color = NULL;
-      GdkRGBA rgba;
+      SchemesRGBA rgba;
       int r, g, b;
       char name[128];
 
@@ -546,7 +1285,10 @@ Columns: 3
         continue;
 
       if (sscanf (lines[i], "%d %d %d %128[^\n]", &r, &g, &b, name) != 4)
-        goto failure;
+        {
+          schemes_scheme_end_update (self);
+          goto failure;
+        }
 
       name[sizeof name - 1] = 0;
 
@@ -556,10 +1298,11 @@ Columns: 3
       rgba.alpha = 1;
 
       color = schemes_color_new (name, &rgba);
-      g_list_store_append (self->colors, color);
+      schemes_scheme_append_color (self, color);
+      schemes_scheme_emit_changed (self, SCHEMES_SCHEME_CHANGES_COLORS);
     }
 
-  g_signal_emit (self, signals [CHANGED], 0);
+  schemes_scheme_end_update (self);
 
   return TRUE;
 
@@ -591,6 +1334,7 @@ schemes_scheme_set_alternate (SchemesScheme *self,
 
   if (g_strcmp0 (self->alternate, alternate) != 0)
     {
+      schemes_scheme_record_metadata (self, PROP_ALTERNATE, self->alternate, FALSE);
       g_free (self->alternate);
       self->alternate = g_strdup (alternate);
       do_notify (self, PROP_ALTERNATE);
@@ -613,6 +1357,7 @@ schemes_scheme_set_author (SchemesScheme *self,
 
   if (g_strcmp0 (self->author, author) != 0)
     {
+      schemes_scheme_record_metadata (self, PROP_AUTHOR, self->author, FALSE);
       g_free (self->author);
       self->author = g_strdup (author);
       do_notify (self, PROP_AUTHOR);
@@ -637,464 +1382,1349 @@ schemes_scheme_set_dark (SchemesScheme *self,
 
   if (dark != self->dark)
     {
+      schemes_scheme_record_metadata (self, PROP_DARK, NULL, self->dark);
       self->dark = dark;
+      schemes_scheme_invalidate (self);
       g_object_notify_by_pspec (G_OBJECT (self), properties [PROP_DARK]);
+
+      /* Only tracked within updates, as the UI listens to notify::dark */
+      if (self->update_depth > 0)
+        self->pending_changes |= SCHEMES_SCHEME_CHANGES_METADATA;
     }
 }
 
-static int
-sort_color_func (gconstpointer a,
-                 gconstpointer b)
+static void
+schemes_scheme_revert_delta (SchemesScheme      *self,
+                             const SchemesDelta *delta)
 {
-  SchemesColor *acolor = *(SchemesColor * const *)a;
-  SchemesColor *bcolor = *(SchemesColor * const *)b;
+  guint row;
 
-  return g_strcmp0 (schemes_color_get_name (acolor),
-                    schemes_color_get_name (bcolor));
-}
+  switch (delta->kind)
+    {
+    case SCHEMES_DELTA_STYLE:
+      if (delta->u.style.value.is_set)
+        row = schemes_style_table_ensure (self->styles, delta->u.style.name);
+      else
+        row = schemes_style_table_lookup (self->styles, delta->u.style.name);
 
-static GPtrArray *
-get_colors_sorted (GListStore *store)
-{
-  GPtrArray *ret;
-  guint n_items;
+      if (row != SCHEMES_STYLE_TABLE_INVALID_ROW)
+        schemes_style_table_set_value (self->styles, row, delta->id, &delta->u.style.value);
+      break;
 
-  g_assert (G_IS_LIST_STORE (store));
+    case SCHEMES_DELTA_COLOR:
+      g_object_set (delta->u.color.color, "color", &delta->u.color.rgba, NULL);
+      break;
 
-  ret = g_ptr_array_new_with_free_func (g_object_unref);
-  n_items = g_list_model_get_n_items (G_LIST_MODEL (store));
-  for (guint i = 0; i < n_items; i++)
-    g_ptr_array_add (ret, g_list_model_get_item (G_LIST_MODEL (store), i));
-  g_ptr_array_sort (ret, sort_color_func);
+    case SCHEMES_DELTA_ADD_COLOR:
+      schemes_scheme_remove_color (self, delta->u.color.color);
+      break;
 
-  return ret;
-}
+    case SCHEMES_DELTA_REMOVE_COLOR:
+      schemes_scheme_insert_color (self, delta->u.color.color, delta->u.color.position);
+      schemes_scheme_emit_changed (self, SCHEMES_SCHEME_CHANGES_COLORS);
+      break;
 
-static int
-sort_styles (gconstpointer a,
-             gconstpointer b)
-{
-  SchemesStyle *stylea = *(SchemesStyle **)a;
-  SchemesStyle *styleb = *(SchemesStyle **)b;
-  const char *langa = schemes_style_get_language (stylea);
-  const char *langb = schemes_style_get_language (styleb);
-  const char *name_a = schemes_style_get_name (stylea);
-  const char *name_b = schemes_style_get_name (styleb);
-  const char *use_style_a = schemes_style_get_use_style (stylea);
-  const char *use_style_b = schemes_style_get_use_style (styleb);
-
-  /* If this style references another style, it needs to be sorted
-   * after that style. This only works when the language for the
-   * two are similar.
-   */
-  if (use_style_a && g_strcmp0 (use_style_a, name_a) > 0)
-    name_a = use_style_a;
-  if (use_style_b && g_strcmp0 (use_style_b, name_b) > 0)
-    name_a = use_style_a;
+    case SCHEMES_DELTA_METADATA:
+      if (delta->id == PROP_DARK)
+        schemes_scheme_set_dark (self, delta->u.metadata.boolean);
+      else
+        g_object_set (self,
+                      g_param_spec_get_name (properties [delta->id]), delta->u.metadata.string,
+                      NULL);
+      break;
 
-  if ((langa == NULL && langb == NULL) ||
-      (g_strcmp0 (langa, "def") == 0 && g_strcmp0 (langb, "def") == 0))
-    {
-      int ret = g_strcmp0 (name_a, name_b);
+    default:
+      g_assert_not_reached ();
+    }
+}
 
-      if (ret == 0)
-        {
-          if (use_style_a)
-            ret = 1;
-          else if (use_style_b)
-            ret = -1;
-        }
+static gboolean
+schemes_scheme_replay (SchemesScheme *self,
+                       gboolean       redo)
+{
+  g_autoptr(GArray) deltas = NULL;
 
-      return ret;
-    }
+  g_assert (SCHEMES_IS_SCHEME (self));
 
-  if (g_strcmp0 (langa, NULL) == 0)
-    return -1;
-  else if (g_strcmp0 (langb, NULL) == 0)
-    return 1;
+  if (self->update_depth > 0 ||
+      !(deltas = schemes_history_begin_replay (self->history, redo)))
+    return FALSE;
 
-  if (g_strcmp0 (langa, "def") == 0)
-    return -1;
-  else if (g_strcmp0 (langb, "def") == 0)
-    return 1;
+  schemes_scheme_begin_update (self);
+  for (guint i = deltas->len; i > 0; i--)
+    schemes_scheme_revert_delta (self, &g_array_index (deltas, SchemesDelta, i - 1));
+  schemes_scheme_end_update (self);
 
-  return g_strcmp0 (name_a, name_b);
+  schemes_history_end_replay (self->history);
+
+  return TRUE;
 }
 
-static GPtrArray *
-group_styles (GHashTable *hashtable)
+/* Reverts the last step, which is every change made within the
+ * outermost begin_update()/end_update() or a single change otherwise.
+ * Returns %FALSE if there was nothing to undo.
+ */
+gboolean
+schemes_scheme_undo (SchemesScheme *self)
 {
-  GHashTableIter iter;
-  SchemesStyle *style;
-  GPtrArray *ar;
+  g_return_val_if_fail (SCHEMES_IS_SCHEME (self), FALSE);
 
-  ar = g_ptr_array_new ();
-  g_hash_table_iter_init (&iter, hashtable);
-  while (g_hash_table_iter_next (&iter, NULL, (gpointer *)&style))
-    g_ptr_array_add (ar, style);
-  g_ptr_array_sort (ar, sort_styles);
+  return schemes_scheme_replay (self, FALSE);
+}
 
-  return ar;
+gboolean
+schemes_scheme_redo (SchemesScheme *self)
+{
+  g_return_val_if_fail (SCHEMES_IS_SCHEME (self), FALSE);
+
+  return schemes_scheme_replay (self, TRUE);
 }
 
-static char *
-as_hex (const GdkRGBA *rgba)
+gboolean
+schemes_scheme_can_undo (SchemesScheme *self)
 {
-  char str[8];
+  g_return_val_if_fail (SCHEMES_IS_SCHEME (self), FALSE);
+
+  return schemes_history_can_undo (self->history);
+}
 
-  g_snprintf (str, sizeof str, "#%02X%02X%02X",
-              (guint)roundf (rgba->red * 255.0),
-              (guint)roundf (rgba->green * 255.0),
-              (guint)roundf (rgba->blue * 255.0));
+gboolean
+schemes_scheme_can_redo (SchemesScheme *self)
+{
+  g_return_val_if_fail (SCHEMES_IS_SCHEME (self), FALSE);
 
-  return g_strdup (str);
+  return schemes_history_can_redo (self->history);
 }
 
-char *
-schemes_scheme_to_string (SchemesScheme  *self)
+void
+schemes_scheme_clear_history (SchemesScheme *self)
 {
-  g_autoptr(GPtrArray) colors = NULL;
-  g_autoptr(GHashTable) colors_hash = NULL;
-  g_autoptr(GPtrArray) groups = NULL;
-  g_autoptr(GDateTime) now = NULL;
-  const char *last_lang = NULL;
-  GString *string;
-  GHashTableIter iter;
-  gpointer v;
-  gsize max_name = 0;
-  int year;
+  g_return_if_fail (SCHEMES_IS_SCHEME (self));
 
-  g_return_val_if_fail (SCHEMES_IS_SCHEME (self), NULL);
+  schemes_history_clear (self->history);
+}
 
-  colors = get_colors_sorted (self->colors);
-  colors_hash = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+/* Undo steps are only changed values, the oldest being dropped once
+ * they take more than @max_size bytes.
+ */
+void
+schemes_scheme_set_max_history (SchemesScheme *self,
+                                gsize          max_size)
+{
+  g_return_if_fail (SCHEMES_IS_SCHEME (self));
 
-  now = g_date_time_new_now_local ();
-  year = g_date_time_get_year (now);
+  schemes_history_set_max_size (self->history, max_size);
+}
 
-  string = g_string_new ("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
+struct _SchemesSchemeSnapshot
+{
+  char       *id;
+  char       *name;
+  char       *author;
+  char       *description;
+  char       *alternate;
+  /* SnapshotEntry, shared with the scheme and other snapshots */
+  GPtrArray  *colors;
+  GPtrArray  *styles;
+  guint       longest_name;
+  guint       hash;
+  guint       dark : 1;
+};
 
-  /* TODO: Someday allow people to save with another license. But to
-   * encourange everyone to create them as LGPL-2.1+ so we can use them
-   * with GtkSourceView, just add that here.
-   *
-   * This is mostly problematic when saving an opened file, since the
-   * copyright will be lost based on our current design. We can make that
-   * work eventually, but it's more effort than I have time for right now.
-   */
-  g_string_append_printf (string, "\
-<!--\n\
-\n\
-  Copyright %d %s\n\
-\n\
-  GtkSourceView is free software; you can redistribute it and/or\n\
-  modify it under the terms of the GNU Lesser General Public\n\
-  License as published by the Free Software Foundation; either\n\
-  version 2.1 of the License, or (at your option) any later version.\n\
-\n\
-  GtkSourceView is distributed in the hope that it will be useful,\n\
-  but WITHOUT ANY WARRANTY; without even the implied warranty of\n\
-  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU\n\
-  Lesser General Public License for more details.\n\
-\n\
-  You should have received a copy of the GNU Lesser General Public License\n\
-  along with this library; if not, see <http://www.gnu.org/licenses/>.\n\
-\n\
--->\n", year, self->author);
+G_DEFINE_BOXED_TYPE (SchemesSchemeSnapshot,
+                     schemes_scheme_snapshot,
+                     schemes_scheme_snapshot_ref,
+                     schemes_scheme_snapshot_unref)
 
-  /* <style-scheme/> */
-  schemes_xml_writer_begin_open_element (string, "style-scheme");
-  schemes_xml_writer_add_attribute (string, "id", self->id[0] ? self->id : "unknown");
-  schemes_xml_writer_add_attribute (string, "_name", self->name[0] ? self->name : "unknown");
-  schemes_xml_writer_add_attribute (string, "version", "1.0");
-  schemes_xml_writer_end_open_element (string, TRUE);
-  g_string_append_c (string, '\n');
+static inline guint
+str_hash0 (const char *str)
+{
+  return str ? g_str_hash (str) : 0;
+}
 
-  /* <author/> */
-  g_string_append (string, "  ");
-  schemes_xml_writer_open_element (string, "author");
-  g_string_append (string, self->author);
-  schemes_xml_writer_close_element (string, "author");
-  g_string_append_c (string, '\n');
+static void
+schemes_scheme_count_name (SchemesScheme *self,
+                           const char    *name,
+                           gboolean       added)
+{
+  guint len = name ? strlen (name) : 0;
 
-  /* <description/> */
-  g_string_append (string, "  ");
-  schemes_xml_writer_open_element (string, "_description");
-  g_string_append (string, self->description);
-  schemes_xml_writer_close_element (string, "_description");
-  g_string_append_c (string, '\n');
+  if (len >= self->name_lengths->len)
+    g_array_set_size (self->name_lengths, len + 1);
 
-  /* <metadata/> */
-  g_string_append_c (string, '\n');
-  g_string_append (string, "  <metadata>\n");
-  g_string_append_printf (string, "    <property name=\"variant\">%s</property>\n", self->dark ? "dark" : "light");
-  if (self->alternate)
+  if (added)
     {
-      g_string_append_printf (string, "    <property name=\"%s-variant\">",
-                              self->dark ? "light" : "dark");
-      schemes_xml_writer_write_escaped (string, self->alternate);
-      g_string_append (string, "</property>\n");
+      g_array_index (self->name_lengths, guint, len)++;
+      self->longest_name = MAX (self->longest_name, len);
+      return;
     }
-  g_string_append (string, "  </metadata>\n");
-  g_string_append_c (string, '\n');
 
-  /* Find longest color/style name to align attributes */
-  for (guint i = 0; i < colors->len; i++)
+  g_array_index (self->name_lengths, guint, len)--;
+
+  while (self->longest_name > 0 &&
+         g_array_index (self->name_lengths, guint, self->longest_name) == 0)
+    self->longest_name--;
+}
+
+static const char *
+schemes_scheme_get_language_name (SchemesScheme *self,
+                                  const char    *language)
+{
+  gpointer name;
+
+  if (language == NULL)
+    return NULL;
+
+  /* The resolver may not be safe to call from another thread */
+  if (!g_hash_table_lookup_extended (self->language_names, language, NULL, &name))
     {
-      SchemesColor *color = g_ptr_array_index (colors, i);
-      const char *name = schemes_color_get_name (color);
-      gsize len = name ? strlen (name) : 0;
-      max_name = MAX (len, max_name);
+      name = (gpointer)g_intern_string (language_name_func ? language_name_func (language) : language);
+      g_hash_table_insert (self->language_names, (gpointer)language, name);
     }
-  g_hash_table_iter_init (&iter, self->styles);
-  while (g_hash_table_iter_next (&iter, NULL, &v))
-    {
-      SchemesStyle *style = v;
-      const char *name = schemes_style_get_name (style);
 
-      if (!schemes_style_is_empty (style))
-        max_name = MAX (name ? strlen (name) : 0, max_name);
-    }
+  return name;
+}
 
-  /* Now add all of the colors */
-  g_string_append (string, "  <!-- Named Colors -->\n");
-  for (guint i = 0; i < colors->len; i++)
-    {
-      SchemesColor *color = g_ptr_array_index (colors, i);
-      const char *name = schemes_color_get_name (color);
-      const GdkRGBA *rgba = schemes_color_get_color (color);
-      g_autofree char *value = gdk_rgba_to_string (rgba);
-      g_autofree char *value_hex = as_hex (rgba);
-      gsize padding = 0;
-
-      if (name && strlen (name) < max_name)
-        padding = max_name - strlen (name);
-
-      g_string_append (string, "  ");
-      schemes_xml_writer_begin_open_element (string, "color");
-      schemes_xml_writer_add_attribute (string, "name", name);
-      /* Add spacing to align values */
-      for (guint z = 0; z < padding; z++)
-        g_string_append_c (string, ' ');
-      schemes_xml_writer_add_attribute (string, "value", value_hex);
-      schemes_xml_writer_end_open_element (string, FALSE);
-      g_string_append_c (string, '\n');
-
-      g_hash_table_insert (colors_hash,
-                           g_steal_pointer (&value),
-                           g_strdup (name));
-    }
-
-  g_string_append (string, "\n  <!-- Global Styles -->\n");
-  groups = group_styles (self->styles);
-  for (guint i = 0; i < groups->len; i++)
-    {
-      SchemesStyle *style = g_ptr_array_index (groups, i);
-      const char *language = schemes_style_get_language (style);
-
-      if (schemes_style_is_empty (style))
-        continue;
+static SnapshotEntry *
+snapshot_entry_new_for_color (SchemesColor *color)
+{
+  SnapshotEntry *entry = g_atomic_rc_box_new0 (SnapshotEntry);
+  guint hash;
 
-      if (g_strcmp0 (last_lang, language) != 0)
-        {
-          GtkSourceLanguageManager *lm = gtk_source_language_manager_get_default ();
-          GtkSourceLanguage *l = gtk_source_language_manager_get_language (lm, language);
+  entry->key = color;
+  entry->name = g_intern_string (schemes_color_get_name (color));
+  entry->u.rgba = *schemes_color_get_color (color);
 
-          if (l != NULL)
-            g_string_append_printf (string,
-                                    "\n  <!-- %s -->\n",
-                                    gtk_source_language_get_name (l));
+  hash = str_hash0 (entry->name);
+  hash = (hash << 5) - hash + (guint)(entry->u.rgba.red * 255.f);
+  hash = (hash << 5) - hash + (guint)(entry->u.rgba.green * 255.f);
+  hash = (hash << 5) - hash + (guint)(entry->u.rgba.blue * 255.f);
+  hash = (hash << 5) - hash + (guint)(entry->u.rgba.alpha * 255.f);
+  entry->hash = hash;
 
-          last_lang = schemes_style_get_language (style);
-        }
+  return entry;
+}
 
-      g_string_append (string, "  ");
-      schemes_style_serialize (style, string, colors_hash, max_name);
-      g_string_append_c (string, '\n');
-    }
+static SnapshotEntry *
+snapshot_entry_new_for_style (SchemesScheme *self,
+                              const char    *name)
+{
+  SnapshotEntry *entry;
+  guint row;
 
-  g_string_append_c (string, '\n');
-  schemes_xml_writer_close_element (string, "style-scheme");
+  row = schemes_style_table_lookup (self->styles, name);
 
-  return g_string_free (string, FALSE);
+  if (row == SCHEMES_STYLE_TABLE_INVALID_ROW ||
+      schemes_style_table_is_empty (self->styles, row))
+    return NULL;
+
+  entry = g_atomic_rc_box_new0 (SnapshotEntry);
+  schemes_style_table_peek_data (self->styles, row, &entry->u.style);
+  entry->key = entry->u.style.name;
+  entry->name = entry->u.style.name;
+  entry->language_name = schemes_scheme_get_language_name (self, entry->u.style.language);
+  entry->hash = schemes_style_data_hash (&entry->u.style);
+
+  return entry;
 }
 
-SchemesStyle *
-schemes_scheme_get_style (SchemesScheme *self,
-                          const char    *name)
+static gpointer
+copy_entry (gconstpointer src,
+            gpointer      user_data)
 {
-  SchemesStyle *style;
+  return snapshot_entry_ref ((SnapshotEntry *)src);
+}
 
-  g_return_val_if_fail (SCHEMES_IS_SCHEME (self), NULL);
+static int
+compare_entry_pointers (gconstpointer a,
+                        gconstpointer b,
+                        gpointer      user_data)
+{
+  const SnapshotEntries *entries = user_data;
+
+  return entries->compare (*(SnapshotEntry * const *)a, *(SnapshotEntry * const *)b);
+}
 
-  if (self->styles == NULL)
-    self->styles = g_hash_table_new_full (g_str_hash,
-                                          g_str_equal,
-                                          g_free,
-                                          g_object_unref);
+/* Returns the position after the entries sorting before or with @entry */
+static guint
+snapshot_entries_bisect (const SnapshotEntries *entries,
+                         GPtrArray             *ar,
+                         const SnapshotEntry   *entry)
+{
+  guint lo = 0;
+  guint hi = ar->len;
 
-  if (!(style = g_hash_table_lookup (self->styles, name)))
+  while (lo < hi)
     {
-      style = schemes_style_new (name);
-      g_signal_connect_object (style,
-                               "notify",
-                               G_CALLBACK (schemes_scheme_emit_changed),
-                               self,
-                               G_CONNECT_SWAPPED);
-      g_hash_table_insert (self->styles, g_strdup (name), style);
+      guint mid = lo + (hi - lo) / 2;
+
+      if (entries->compare (g_ptr_array_index (ar, mid), entry) <= 0)
+        lo = mid + 1;
+      else
+        hi = mid;
     }
 
-  return style;
+  return lo;
 }
 
-GtkSourceStyleScheme *
-schemes_scheme_preview (SchemesScheme *self)
+/* Applies the changes to entries which were marked dirty. The previous
+ * array may be in use by snapshots on other threads, so a new one is
+ * created. When few entries changed they are moved into place rather
+ * than sorting everything again.
+ */
+static void
+schemes_scheme_sync_entries (SchemesScheme   *self,
+                             SnapshotEntries *entries)
 {
-  g_autoptr(GtkSourceStyleSchemeManager) manager = NULL;
-  const char * search_path[] = { NULL, NULL };
-  g_autofree char *str = NULL;
-  g_autofree char *tmpdir = NULL;
-  g_autofree char *path = NULL;
-  GtkSourceStyleScheme *ret = NULL;
-  const char * const *ids;
-  g_autoptr(GError) error = NULL;
+  g_autoptr(GPtrArray) removed = NULL;
+  g_autoptr(GPtrArray) added = NULL;
+  GHashTableIter iter;
+  GPtrArray *ar;
+  gpointer key;
+  gpointer value;
 
-  g_return_val_if_fail (SCHEMES_IS_SCHEME (self), NULL);
+  if (g_hash_table_size (entries->dirty) == 0)
+    return;
 
-  if (!(str = schemes_scheme_to_string (self)))
-    goto failure;
+  removed = g_ptr_array_new ();
+  added = g_ptr_array_new ();
 
-  if (!(tmpdir = g_dir_make_tmp (".schemes-XXXXXX", &error)))
+  g_hash_table_iter_init (&iter, entries->dirty);
+  while (g_hash_table_iter_next (&iter, &key, &value))
     {
-      g_warning ("Fail to create tmpdir: %s", error->message);
-      goto failure;
+      SnapshotEntry *entry;
+
+      /* Removed colors may be gone already, so only compare the key */
+      if ((entry = g_hash_table_lookup (entries->by_key, key)))
+        {
+          g_hash_table_remove (entries->by_key, key);
+          schemes_scheme_count_name (self, entry->name, FALSE);
+          entries->hash -= entry->hash;
+          g_ptr_array_add (removed, entry);
+        }
+
+      if (entries == &self->style_entries)
+        entry = snapshot_entry_new_for_style (self, key);
+      else if (GPOINTER_TO_UINT (value))
+        entry = snapshot_entry_new_for_color (key);
+      else
+        entry = NULL;
+
+      if (entry != NULL)
+        {
+          g_hash_table_insert (entries->by_key, key, entry);
+          schemes_scheme_count_name (self, entry->name, TRUE);
+          entries->hash += entry->hash;
+          g_ptr_array_add (added, entry);
+        }
     }
 
-  path = g_build_filename (tmpdir, "preview.xml", NULL);
-  if (!g_file_set_contents (path, str, -1, NULL))
+  g_hash_table_remove_all (entries->dirty);
+
+  if (removed->len == 0 && added->len == 0)
+    return;
+
+  if ((removed->len + added->len) * 16 > entries->entries->len)
     {
-      g_warning ("Fail to set contents: %s", error->message);
-      goto failure;
-    }
+      ar = g_ptr_array_new_full (entries->entries->len - removed->len + added->len,
+                                 (GDestroyNotify)snapshot_entry_unref);
+
+      for (guint i = 0; i < entries->entries->len; i++)
+        {
+          SnapshotEntry *entry = g_ptr_array_index (entries->entries, i);
+
+          if (g_hash_table_lookup (entries->by_key, entry->key) == entry)
+            g_ptr_array_add (ar, snapshot_entry_ref (entry));
+        }
 
-  manager = gtk_source_style_scheme_manager_new ();
-  search_path[0] = tmpdir;
-  gtk_source_style_scheme_manager_set_search_path (manager, (const char * const *)search_path);
-  gtk_source_style_scheme_manager_force_rescan (manager);
+      for (guint i = 0; i < added->len; i++)
+        g_ptr_array_add (ar, g_ptr_array_index (added, i));
 
-  if (!(ids = gtk_source_style_scheme_manager_get_scheme_ids (manager)) ||
-      ids[0] == NULL ||
-      !(ret = gtk_source_style_scheme_manager_get_scheme (manager, ids[0])))
+      g_ptr_array_sort_with_data (ar, compare_entry_pointers, entries);
+    }
+  else
     {
-      g_warning ("Failed to load preview.xml");
-      goto failure;
+      ar = g_ptr_array_copy (entries->entries, copy_entry, NULL);
+
+      for (guint i = 0; i < removed->len; i++)
+        {
+          SnapshotEntry *entry = g_ptr_array_index (removed, i);
+          guint pos = snapshot_entries_bisect (entries, ar, entry);
+
+          /* Entries comparing equal are next to each other */
+          while (g_ptr_array_index (ar, pos - 1) != entry)
+            pos--;
+
+          g_ptr_array_remove_index (ar, pos - 1);
+        }
+
+      for (guint i = 0; i < added->len; i++)
+        {
+          SnapshotEntry *entry = g_ptr_array_index (added, i);
+
+          g_ptr_array_insert (ar, snapshot_entries_bisect (entries, ar, entry), entry);
+        }
     }
 
-  g_object_ref (ret);
+  g_ptr_array_unref (entries->entries);
+  entries->entries = ar;
+}
 
-failure:
-  if (path)
-    g_unlink (path);
+static guint
+snapshot_hash (SchemesSchemeSnapshot *snapshot,
+               guint                  colors_hash,
+               guint                  styles_hash)
+{
+  guint hash = str_hash0 (snapshot->id);
 
-  if (tmpdir)
-    g_unlink (tmpdir);
+  hash = (hash << 5) - hash + str_hash0 (snapshot->name);
+  hash = (hash << 5) - hash + str_hash0 (snapshot->author);
+  hash = (hash << 5) - hash + str_hash0 (snapshot->description);
+  hash = (hash << 5) - hash + str_hash0 (snapshot->alternate);
+  hash = (hash << 5) - hash + snapshot->dark;
+  hash = (hash << 5) - hash + colors_hash;
+  hash = (hash << 5) - hash + styles_hash;
 
-  return ret;
+  return hash;
 }
 
-static gboolean
-styles_empty (GHashTable *hashtable)
+/* Only changed colors and styles are captured again, the rest of the
+ * entries, and whatever was serialized for them, are shared with the
+ * previous snapshot.
+ */
+static SchemesSchemeSnapshot *
+snapshot_new (SchemesScheme *self)
 {
-  GHashTableIter iter;
-  SchemesStyle *style;
+  SchemesSchemeSnapshot *snapshot;
 
-  g_hash_table_iter_init (&iter, hashtable);
-  while (g_hash_table_iter_next (&iter, NULL, (gpointer *)&style))
-    {
-      if (!schemes_style_is_empty (style))
-        return FALSE;
-    }
+  g_assert (SCHEMES_IS_SCHEME (self));
 
-  return TRUE;
+  schemes_scheme_sync_entries (self, &self->color_entries);
+  schemes_scheme_sync_entries (self, &self->style_entries);
+
+  snapshot = g_atomic_rc_box_new0 (SchemesSchemeSnapshot);
+  snapshot->id = g_strdup (self->id);
+  snapshot->name = g_strdup (self->name);
+  snapshot->author = g_strdup (self->author);
+  snapshot->description = g_strdup (self->description);
+  snapshot->alternate = g_strdup (self->alternate);
+  snapshot->dark = self->dark;
+  snapshot->colors = g_ptr_array_ref (self->color_entries.entries);
+  snapshot->styles = g_ptr_array_ref (self->style_entries.entries);
+  snapshot->longest_name = self->longest_name;
+  snapshot->hash = snapshot_hash (snapshot,
+                                  self->color_entries.hash,
+                                  self->style_entries.hash);
+
+  return snapshot;
 }
 
-gboolean
-schemes_scheme_is_pristine (SchemesScheme *self)
+/* Returns a plain-data capture of @self which may be read from any
+ * thread while the scheme continues to be edited. The snapshot is
+ * cached until the scheme changes, so taking one is cheap.
+ */
+SchemesSchemeSnapshot *
+schemes_scheme_snapshot (SchemesScheme *self)
 {
-  g_return_val_if_fail (SCHEMES_IS_SCHEME (self), FALSE);
+  g_return_val_if_fail (SCHEMES_IS_SCHEME (self), NULL);
 
-  return self->file == NULL &&
-         (self->colors == NULL ||
+  if (self->snapshot == NULL)
+    self->snapshot = snapshot_new (self);
+
+  return schemes_scheme_snapshot_ref (self->snapshot);
+}
+
+SchemesSchemeSnapshot *
+schemes_scheme_snapshot_ref (SchemesSchemeSnapshot *self)
+{
+  g_return_val_if_fail (self != NULL, NULL);
+
+  return g_atomic_rc_box_acquire (self);
+}
+
+static void
+snapshot_finalize (gpointer data)
+{
+  SchemesSchemeSnapshot *self = data;
+
+  g_clear_pointer (&self->id, g_free);
+  g_clear_pointer (&self->name, g_free);
+  g_clear_pointer (&self->author, g_free);
+  g_clear_pointer (&self->description, g_free);
+  g_clear_pointer (&self->alternate, g_free);
+  g_clear_pointer (&self->colors, g_ptr_array_unref);
+  g_clear_pointer (&self->styles, g_ptr_array_unref);
+}
+
+void
+schemes_scheme_snapshot_unref (SchemesSchemeSnapshot *self)
+{
+  g_return_if_fail (self != NULL);
+
+  g_atomic_rc_box_release_full (self, snapshot_finalize);
+}
+
+const char *
+schemes_scheme_snapshot_get_id (SchemesSchemeSnapshot *self)
+{
+  g_return_val_if_fail (self != NULL, NULL);
+
+  return self->id;
+}
+
+const char *
+schemes_scheme_snapshot_get_name (SchemesSchemeSnapshot *self)
+{
+  g_return_val_if_fail (self != NULL, NULL);
+
+  return self->name;
+}
+
+guint
+schemes_scheme_snapshot_hash (gconstpointer data)
+{
+  const SchemesSchemeSnapshot *self = data;
+
+  g_return_val_if_fail (self != NULL, 0);
+
+  return self->hash;
+}
+
+gboolean
+schemes_scheme_snapshot_equal (gconstpointer a,
+                               gconstpointer b)
+{
+  const SchemesSchemeSnapshot *snapshot_a = a;
+  const SchemesSchemeSnapshot *snapshot_b = b;
+
+  g_return_val_if_fail (snapshot_a != NULL, FALSE);
+  g_return_val_if_fail (snapshot_b != NULL, FALSE);
+
+  if (snapshot_a == snapshot_b)
+    return TRUE;
+
+  if (snapshot_a->hash != snapshot_b->hash ||
+      snapshot_a->dark != snapshot_b->dark ||
+      snapshot_a->colors->len != snapshot_b->colors->len ||
+      snapshot_a->styles->len != snapshot_b->styles->len ||
+      g_strcmp0 (snapshot_a->id, snapshot_b->id) != 0 ||
+      g_strcmp0 (snapshot_a->name, snapshot_b->name) != 0 ||
+      g_strcmp0 (snapshot_a->author, snapshot_b->author) != 0 ||
+      g_strcmp0 (snapshot_a->description, snapshot_b->description) != 0 ||
+      g_strcmp0 (snapshot_a->alternate, snapshot_b->alternate) != 0)
+    return FALSE;
+
+  /* Unchanged entries are shared between snapshots */
+  for (guint i = 0; i < snapshot_a->colors->len; i++)
+    {
+      const SnapshotEntry *color_a = g_ptr_array_index (snapshot_a->colors, i);
+      const SnapshotEntry *color_b = g_ptr_array_index (snapshot_b->colors, i);
+
+      if (color_a != color_b &&
+          (g_strcmp0 (color_a->name, color_b->name) != 0 ||
+           !schemes_rgba_equal (&color_a->u.rgba, &color_b->u.rgba)))
+        return FALSE;
+    }
+
+  for (guint i = 0; i < snapshot_a->styles->len; i++)
+    {
+      const SnapshotEntry *style_a = g_ptr_array_index (snapshot_a->styles, i);
+      const SnapshotEntry *style_b = g_ptr_array_index (snapshot_b->styles, i);
+
+      if (style_a != style_b &&
+          !schemes_style_data_equal (&style_a->u.style, &style_b->u.style))
+        return FALSE;
+    }
+
+  return TRUE;
+}
+
+char *
+schemes_scheme_to_string (SchemesScheme *self)
+{
+  g_autoptr(SchemesSchemeSnapshot) snapshot = NULL;
+
+  g_return_val_if_fail (SCHEMES_IS_SCHEME (self), NULL);
+
+  snapshot = schemes_scheme_snapshot (self);
+
+  return schemes_scheme_snapshot_to_string (snapshot);
+}
+
+char *
+schemes_scheme_snapshot_to_string (SchemesSchemeSnapshot *self)
+{
+  g_autoptr(GOutputStream) stream = NULL;
+
+  g_return_val_if_fail (self != NULL, NULL);
+
+  stream = g_memory_output_stream_new_resizable ();
+
+  if (!schemes_scheme_snapshot_write (self, stream, NULL, NULL) ||
+      !g_output_stream_write_all (stream, "", 1, NULL, NULL, NULL) ||
+      !g_output_stream_close (stream, NULL, NULL))
+    return NULL;
+
+  return g_memory_output_stream_steal_data (G_MEMORY_OUTPUT_STREAM (stream));
+}
+
+static const char license_header[] = "\
+\n\
+  GtkSourceView is free software; you can redistribute it and/or\n\
+  modify it under the terms of the GNU Lesser General Public\n\
+  License as published by the Free Software Foundation; either\n\
+  version 2.1 of the License, or (at your option) any later version.\n\
+\n\
+  GtkSourceView is distributed in the hope that it will be useful,\n\
+  but WITHOUT ANY WARRANTY; without even the implied warranty of\n\
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU\n\
+  Lesser General Public License for more details.\n\
+\n\
+  You should have received a copy of the GNU Lesser General Public License\n\
+  along with this library; if not, see <http://www.gnu.org/licenses/>.\n\
+\n\
+-->\n";
+
+#define FRAGMENT_SCRATCH_SIZE (SCHEMES_XML_WRITER_BUFSIZE * 8)
+
+/* Fragments are written to a scratch stream and then copied, so that
+ * each owns its memory and may outlive the others.
+ */
+typedef struct
+{
+  GOutputStream    *stream;
+  SchemesXmlWriter  writer;
+} FragmentScratch;
+
+static inline void
+write_name_padding (SchemesXmlWriter *writer,
+                    const char       *name,
+                    guint             longest_name)
+{
+  gsize len = name ? strlen (name) : 0;
+
+  /* Add spacing to align values */
+  if (len < longest_name)
+    schemes_xml_writer_write_padding (writer, longest_name - len);
+}
+
+/* Returns what follows the name and padding of @entry, serializing it
+ * the first time. Later snapshots share the entry and so the fragment.
+ */
+static GBytes *
+snapshot_entry_get_fragment (SnapshotEntry   *entry,
+                             FragmentScratch *scratch,
+                             gboolean         is_style)
+{
+  GBytes *fragment;
+  const char *data;
+  gsize begin;
+
+  if ((fragment = g_atomic_pointer_get (&entry->fragment)))
+    return fragment;
+
+  if (scratch->stream == NULL || scratch->writer.n_written > FRAGMENT_SCRATCH_SIZE)
+    {
+      g_clear_object (&scratch->stream);
+      scratch->stream = g_memory_output_stream_new_resizable ();
+      schemes_xml_writer_init (&scratch->writer, scratch->stream, NULL);
+    }
+
+  begin = scratch->writer.n_written;
+
+  if (is_style)
+    {
+      schemes_style_data_serialize_attributes (&entry->u.style, &scratch->writer);
+    }
+  else
+    {
+      schemes_xml_writer_add_hex_attribute (&scratch->writer, "value", &entry->u.rgba);
+      schemes_xml_writer_end_open_element (&scratch->writer, FALSE);
+    }
+
+  schemes_xml_writer_flush (&scratch->writer);
+
+  data = g_memory_output_stream_get_data (G_MEMORY_OUTPUT_STREAM (scratch->stream));
+  fragment = g_bytes_new (data + begin, scratch->writer.n_written - begin);
+
+  /* Another thread writing a snapshot with this entry may be first */
+  if (!g_atomic_pointer_compare_and_exchange (&entry->fragment, NULL, fragment))
+    {
+      g_bytes_unref (fragment);
+      fragment = g_atomic_pointer_get (&entry->fragment);
+    }
+
+  return fragment;
+}
+
+static inline void
+write_fragment (SchemesXmlWriter *writer,
+                GBytes           *fragment)
+{
+  gsize len;
+  const char *data = g_bytes_get_data (fragment, &len);
+
+  schemes_xml_writer_write_len (writer, data, len);
+}
+
+/* Writes the scheme as XML to @stream, which is not closed. Colors
+ * and styles serialized by an earlier write are reused.
+ */
+gboolean
+schemes_scheme_snapshot_write (SchemesSchemeSnapshot  *self,
+                               GOutputStream          *stream,
+                               GCancellable           *cancellable,
+                               GError                **error)
+{
+  SchemesXmlWriter writer;
+  FragmentScratch scratch = { NULL };
+  g_autoptr(GDateTime) now = NULL;
+  const char *last_lang = NULL;
+  int year;
+
+  g_return_val_if_fail (self != NULL, FALSE);
+  g_return_val_if_fail (G_IS_OUTPUT_STREAM (stream), FALSE);
+  g_return_val_if_fail (!cancellable || G_IS_CANCELLABLE (cancellable), FALSE);
+
+  now = g_date_time_new_now_local ();
+  year = g_date_time_get_year (now);
+
+  schemes_xml_writer_init (&writer, stream, cancellable);
+  schemes_xml_writer_write (&writer, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
+
+  /* TODO: Someday allow people to save with another license. But to
+   * encourange everyone to create them as LGPL-2.1+ so we can use them
+   * with GtkSourceView, just add that here.
+   *
+   * This is mostly problematic when saving an opened file, since the
+   * copyright will be lost based on our current design. We can make that
+   * work eventually, but it's more effort than I have time for right now.
+   */
+  schemes_xml_writer_write (&writer, "<!--\n\n  Copyright ");
+  schemes_xml_writer_write_uint (&writer, year);
+  schemes_xml_writer_write_c (&writer, ' ');
+  schemes_xml_writer_write (&writer, self->author);
+  schemes_xml_writer_write_c (&writer, '\n');
+  schemes_xml_writer_write_len (&writer, license_header, sizeof license_header - 1);
+
+  /* <style-scheme/> */
+  schemes_xml_writer_begin_open_element (&writer, "style-scheme");
+  schemes_xml_writer_add_attribute (&writer, "id", self->id[0] ? self->id : "unknown");
+  schemes_xml_writer_add_attribute (&writer, "_name", self->name[0] ? self->name : "unknown");
+  schemes_xml_writer_add_attribute (&writer, "version", "1.0");
+  schemes_xml_writer_end_open_element (&writer, TRUE);
+  schemes_xml_writer_write_c (&writer, '\n');
+
+  /* <author/> */
+  schemes_xml_writer_write (&writer, "  ");
+  schemes_xml_writer_open_element (&writer, "author");
+  schemes_xml_writer_write_escaped (&writer, self->author);
+  schemes_xml_writer_close_element (&writer, "author");
+  schemes_xml_writer_write_c (&writer, '\n');
+
+  /* <description/> */
+  schemes_xml_writer_write (&writer, "  ");
+  schemes_xml_writer_open_element (&writer, "_description");
+  schemes_xml_writer_write_escaped (&writer, self->description);
+  schemes_xml_writer_close_element (&writer, "_description");
+  schemes_xml_writer_write_c (&writer, '\n');
+
+  /* <metadata/> */
+  schemes_xml_writer_write (&writer, "\n  <metadata>\n");
+  schemes_xml_writer_write (&writer,
+                            self->dark ? "    <property name=\"variant\">dark</property>\n"
+                                       : "    <property name=\"variant\">light</property>\n");
+  if (self->alternate)
+    {
+      schemes_xml_writer_write (&writer,
+                                self->dark ? "    <property name=\"light-variant\">"
+                                           : "    <property name=\"dark-variant\">");
+      schemes_xml_writer_write_escaped (&writer, self->alternate);
+      schemes_xml_writer_write (&writer, "</property>\n");
+    }
+  schemes_xml_writer_write (&writer, "  </metadata>\n\n");
+
+  /* Now add all of the colors */
+  schemes_xml_writer_write (&writer, "  <!-- Named Colors -->\n");
+  for (guint i = 0; i < self->colors->len; i++)
+    {
+      SnapshotEntry *color = g_ptr_array_index (self->colors, i);
+
+      schemes_xml_writer_write (&writer, "  ");
+      schemes_xml_writer_begin_open_element (&writer, "color");
+      schemes_xml_writer_add_attribute (&writer, "name", color->name);
+      write_name_padding (&writer, color->name, self->longest_name);
+      write_fragment (&writer, snapshot_entry_get_fragment (color, &scratch, FALSE));
+      schemes_xml_writer_write_c (&writer, '\n');
+    }
+
+  schemes_xml_writer_write (&writer, "\n  <!-- Global Styles -->\n");
+  for (guint i = 0; i < self->styles->len; i++)
+    {
+      SnapshotEntry *style = g_ptr_array_index (self->styles, i);
+      const char *language = style->u.style.language;
+
+      if (g_strcmp0 (last_lang, language) != 0)
+        {
+          if (style->language_name != NULL)
+            {
+              schemes_xml_writer_write (&writer, "\n  <!-- ");
+              schemes_xml_writer_write (&writer, style->language_name);
+              schemes_xml_writer_write (&writer, " -->\n");
+            }
+
+          last_lang = language;
+        }
+
+      schemes_xml_writer_write (&writer, "  ");
+      schemes_xml_writer_begin_open_element (&writer, "style");
+      schemes_xml_writer_add_attribute (&writer, "name", style->name);
+      write_name_padding (&writer, style->name, self->longest_name);
+      write_fragment (&writer, snapshot_entry_get_fragment (style, &scratch, TRUE));
+      schemes_xml_writer_write_c (&writer, '\n');
+    }
+
+  g_clear_object (&scratch.stream);
+
+  schemes_xml_writer_write_c (&writer, '\n');
+  schemes_xml_writer_close_element (&writer, "style-scheme");
+
+  return schemes_xml_writer_finish (&writer, error);
+}
+
+/* Fills @data if the style @name has any attribute set, without
+ * creating a SchemesStyle for it.
+ */
+gboolean
+schemes_scheme_get_style_data (SchemesScheme    *self,
+                               const char       *name,
+                               SchemesStyleData *data)
+{
+  guint row;
+
+  g_return_val_if_fail (SCHEMES_IS_SCHEME (self), FALSE);
+  g_return_val_if_fail (name != NULL, FALSE);
+  g_return_val_if_fail (data != NULL, FALSE);
+
+  row = schemes_style_table_lookup (self->styles, name);
+  if (row == SCHEMES_STYLE_TABLE_INVALID_ROW ||
+      schemes_style_table_is_empty (self->styles, row))
+    return FALSE;
+
+  schemes_style_table_peek_data (self->styles, row, data);
+
+  return TRUE;
+}
+
+/* Returns a new reference to the style @name. Styles without any
+ * attribute are not stored, so this does not change the scheme until
+ * an attribute is set, and the style stops being stored once empty.
+ */
+SchemesStyle *
+schemes_scheme_dup_style (SchemesScheme *self,
+                          const char    *name)
+{
+  SchemesStyle *style;
+
+  g_return_val_if_fail (SCHEMES_IS_SCHEME (self), NULL);
+  g_return_val_if_fail (name != NULL, NULL);
+
+  if ((style = (SchemesStyle *)schemes_style_table_get_view (self->styles, name)))
+    return g_object_ref (style);
+
+  return schemes_style_new_for_name (self->styles, name);
+}
+
+static gboolean
+styles_empty (SchemesStyleTable *styles)
+{
+  guint n_rows = schemes_style_table_get_n_rows (styles);
+
+  for (guint row = 0; row < n_rows; row++)
+    {
+      if (!schemes_style_table_is_empty (styles, row))
+        return FALSE;
+    }
+
+  return TRUE;
+}
+
+gboolean
+schemes_scheme_is_pristine (SchemesScheme *self)
+{
+  g_return_val_if_fail (SCHEMES_IS_SCHEME (self), FALSE);
+
+  return self->file == NULL &&
+         (self->colors == NULL ||
           g_list_model_get_n_items (G_LIST_MODEL (self->colors)) == 0) &&
-         (self->styles == NULL || styles_empty (self->styles)) &&
+         styles_empty (self->styles) &&
          str_empty0 (self->alternate) &&
          str_empty0 (self->id) &&
          str_empty0 (self->name) &&
          str_empty0 (self->description);
 }
 
-gboolean
-schemes_scheme_get_named_color (SchemesScheme *self,
-                                const char    *name,
-                                GdkRGBA       *rgba)
+gboolean
+schemes_scheme_get_named_color (SchemesScheme *self,
+                                const char    *name,
+                                SchemesRGBA   *rgba)
+{
+  SchemesColor *color;
+
+  g_return_val_if_fail (SCHEMES_IS_SCHEME (self), FALSE);
+  g_return_val_if_fail (name != NULL, FALSE);
+
+  if (!(color = g_hash_table_lookup (self->colors_by_name, name)))
+    return FALSE;
+
+  *rgba = *schemes_color_get_color (color);
+
+  return TRUE;
+}
+
+static const GMarkupParser root_parser = {
+  root_start_element,
+  root_end_element,
+};
+
+struct _LoadProgress
+{
+  SchemesSchemeProgressFunc  func;
+  gpointer                   data;
+  GMainContext              *context;
+  double                     reported;
+};
+
+typedef struct
+{
+  SchemesSchemeProgressFunc  func;
+  gpointer                   data;
+  double                     fraction;
+} ProgressReport;
+
+static gboolean
+dispatch_progress (gpointer user_data)
+{
+  ProgressReport *report = user_data;
+
+  report->func (report->fraction, report->data);
+
+  return G_SOURCE_REMOVE;
+}
+
+/* Sends @fraction to the main context of the loader */
+static void
+load_progress_report (LoadProgress *progress,
+                      double        fraction)
+{
+  ProgressReport *report;
+
+  if (progress == NULL || progress->func == NULL)
+    return;
+
+  /* Only whole percents are worth a main loop iteration */
+  if (fraction < 1.0 && fraction - progress->reported < .01)
+    return;
+
+  progress->reported = fraction;
+
+  report = g_new (ProgressReport, 1);
+  report->func = progress->func;
+  report->data = progress->data;
+  report->fraction = fraction;
+
+  g_main_context_invoke_full (progress->context,
+                              G_PRIORITY_DEFAULT,
+                              dispatch_progress,
+                              report,
+                              g_free);
+}
+
+/* Takes ownership of @digest and @etag */
+static void
+schemes_scheme_set_saved (SchemesScheme *self,
+                          GFile         *file,
+                          char          *digest,
+                          char          *etag)
+{
+  g_set_object (&self->saved_file, file);
+  g_free (self->saved_digest);
+  self->saved_digest = digest;
+  g_free (self->saved_etag);
+  self->saved_etag = etag;
+}
+
+static gboolean
+schemes_scheme_load (SchemesScheme  *self,
+                     GFile          *file,
+                     LoadProgress   *progress,
+                     GCancellable   *cancellable,
+                     GError        **error)
+{
+  g_autoptr(GMarkupParseContext) context = NULL;
+  g_autoptr(GMappedFile) mapped = NULL;
+  g_autofree char *loaded = NULL;
+  g_autofree char *etag = NULL;
+  g_autofree char *path = NULL;
+  const char *contents;
+  gsize len;
+
+  g_assert (SCHEMES_IS_SCHEME (self));
+  g_assert (G_IS_FILE (file));
+
+  /* Local files are parsed straight from the mapping */
+  if ((path = g_file_get_path (file)))
+    {
+      g_autoptr(GFileInfo) info = NULL;
+
+      if (!(info = g_file_query_info (file,
+                                      G_FILE_ATTRIBUTE_ETAG_VALUE,
+                                      G_FILE_QUERY_INFO_NONE,
+                                      cancellable,
+                                      error)) ||
+          !(mapped = g_mapped_file_new (path, FALSE, error)))
+        return FALSE;
+
+      etag = g_strdup (g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_ETAG_VALUE));
+      contents = g_mapped_file_get_contents (mapped);
+      len = g_mapped_file_get_length (mapped);
+    }
+  else
+    {
+      if (!g_file_load_contents (file, cancellable, &loaded, &len, &etag, error))
+        return FALSE;
+
+      contents = loaded;
+    }
+
+  if (g_cancellable_set_error_if_cancelled (cancellable, error))
+    return FALSE;
+
+  /* A loaded scheme starts without history */
+  schemes_scheme_begin_update (self);
+  schemes_history_block (self->history);
+
+  if (!schemes_scheme_load_tokens (self, contents, len, progress, cancellable))
+    {
+      context = g_markup_parse_context_new (&root_parser, 0, self, NULL);
+
+      /* Fed in slices to check for cancellation and report progress */
+      for (gsize offset = 0; offset < len; offset += LOAD_SLICE_SIZE)
+        {
+          gsize n = MIN (LOAD_SLICE_SIZE, len - offset);
+
+          if (!g_markup_parse_context_parse (context, contents + offset, n, error) ||
+              g_cancellable_set_error_if_cancelled (cancellable, error))
+            goto failure;
+
+          load_progress_report (progress, (double)(offset + n) / len);
+        }
+    }
+
+  if (g_cancellable_set_error_if_cancelled (cancellable, error))
+    goto failure;
+
+  resolve_color_fixups (self, contents);
+
+  /* Styles are ensured before knowing whether anything gets set */
+  schemes_style_table_collect (self->styles);
+
+  if (self->parse_failure.failed)
+    {
+      g_set_error (error,
+                   G_IO_ERROR,
+                   G_IO_ERROR_INVALID_DATA,
+                   "Failed to parse style-scheme at %d:%d",
+                   self->parse_failure.line_pos,
+                   self->parse_failure.char_pos);
+      goto failure;
+    }
+
+  schemes_scheme_invalidate (self);
+
+  if (g_set_object (&self->file, file))
+    g_object_notify_by_pspec (G_OBJECT (self), properties [PROP_FILE]);
+
+  schemes_history_unblock (self->history);
+  schemes_history_clear (self->history);
+  schemes_scheme_end_update (self);
+
+  schemes_scheme_set_saved (self,
+                            file,
+                            g_compute_checksum_for_data (G_CHECKSUM_SHA256, (const guchar *)contents, len),
+                            g_steal_pointer (&etag));
+
+  load_progress_report (progress, 1.0);
+
+  return TRUE;
+
+failure:
+  g_array_set_size (self->color_fixups, 0);
+  schemes_style_table_collect (self->styles);
+  schemes_history_unblock (self->history);
+  schemes_scheme_end_update (self);
+
+  return FALSE;
+}
+
+gboolean
+schemes_scheme_load_from_file (SchemesScheme  *self,
+                               GFile          *file,
+                               GError        **error)
+{
+  g_return_val_if_fail (SCHEMES_IS_SCHEME (self), FALSE);
+  g_return_val_if_fail (G_IS_FILE (file), FALSE);
+
+  return schemes_scheme_load (self, file, NULL, NULL, error);
+}
+
+typedef struct
+{
+  GFile        *file;
+  LoadProgress  progress;
+} Load;
+
+static void
+load_free (Load *load)
+{
+  g_clear_object (&load->file);
+  g_clear_pointer (&load->progress.context, g_main_context_unref);
+  g_free (load);
+}
+
+static void
+schemes_scheme_load_worker (GTask        *task,
+                            gpointer      source_object,
+                            gpointer      task_data,
+                            GCancellable *cancellable)
+{
+  SchemesScheme *self = source_object;
+  Load *load = task_data;
+  g_autoptr(GError) error = NULL;
+
+  g_assert (G_IS_TASK (task));
+  g_assert (SCHEMES_IS_SCHEME (self));
+  g_assert (load != NULL);
+
+  if (!schemes_scheme_load (self, load->file, &load->progress, cancellable, &error))
+    g_task_return_error (task, g_steal_pointer (&error));
+  else
+    g_task_return_boolean (task, TRUE);
+}
+
+/* Reads and parses @file on a worker thread, so that many files may be
+ * loaded at once. @self must be a new scheme which is not used by
+ * anything else until the operation has completed, as it is modified
+ * from the worker thread. Nothing can see the scheme half loaded, such
+ * as with colors still pending or in a snapshot.
+ *
+ * @progress_func, if set, is called with the fraction loaded on the
+ * thread-default main context of the caller, before @callback.
+ */
+void
+schemes_scheme_load_from_file_async (SchemesScheme             *self,
+                                     GFile                     *file,
+                                     SchemesSchemeProgressFunc  progress_func,
+                                     gpointer                   progress_data,
+                                     GCancellable              *cancellable,
+                                     GAsyncReadyCallback        callback,
+                                     gpointer                   user_data)
+{
+  g_autoptr(GTask) task = NULL;
+  Load *load;
+
+  g_return_if_fail (SCHEMES_IS_SCHEME (self));
+  g_return_if_fail (G_IS_FILE (file));
+  g_return_if_fail (!cancellable || G_IS_CANCELLABLE (cancellable));
+
+  load = g_new0 (Load, 1);
+  load->file = g_object_ref (file);
+  load->progress.func = progress_func;
+  load->progress.data = progress_data;
+  load->progress.context = g_main_context_ref_thread_default ();
+
+  task = g_task_new (self, cancellable, callback, user_data);
+  g_task_set_source_tag (task, schemes_scheme_load_from_file_async);
+  g_task_set_task_data (task, load, (GDestroyNotify)load_free);
+  g_task_run_in_thread (task, schemes_scheme_load_worker);
+}
+
+gboolean
+schemes_scheme_load_from_file_finish (SchemesScheme  *self,
+                                      GAsyncResult   *result,
+                                      GError        **error)
+{
+  g_return_val_if_fail (SCHEMES_IS_SCHEME (self), FALSE);
+  g_return_val_if_fail (g_task_is_valid (result, self), FALSE);
+
+  return g_task_propagate_boolean (G_TASK (result), error);
+}
+
+typedef struct
+{
+  SchemesSchemeSnapshot *snapshot;
+  GFile *file;
+  char *digest;
+  char *etag;
+  guint generation;
+  guint make_backup : 1;
+} Save;
+
+static void
+save_free (Save *save)
+{
+  g_clear_pointer (&save->snapshot, schemes_scheme_snapshot_unref);
+  g_clear_object (&save->file);
+  g_clear_pointer (&save->digest, g_free);
+  g_clear_pointer (&save->etag, g_free);
+  g_free (save);
+}
+
+static gboolean
+save_is_current (SchemesScheme *self,
+                 Save          *save)
+{
+  return save->generation == (guint)g_atomic_int_get (&self->save_generation);
+}
+
+static void
+schemes_scheme_save_worker (GTask        *task,
+                            gpointer      source_object,
+                            gpointer      task_data,
+                            GCancellable *cancellable)
+{
+  SchemesScheme *self = source_object;
+  Save *save = task_data;
+  g_autoptr(GOutputStream) stream = NULL;
+  g_autoptr(GError) error = NULL;
+  g_autofree char *digest = NULL;
+  g_autofree char *etag = NULL;
+  const guchar *data;
+  gsize len;
+
+  g_assert (G_IS_TASK (task));
+  g_assert (SCHEMES_IS_SCHEME (self));
+  g_assert (save != NULL);
+
+  stream = g_memory_output_stream_new_resizable ();
+
+  if (!schemes_scheme_snapshot_write (save->snapshot, stream, cancellable, &error) ||
+      !g_output_stream_close (stream, cancellable, &error))
+    {
+      g_task_return_error (task, g_steal_pointer (&error));
+      return;
+    }
+
+  data = g_memory_output_stream_get_data (G_MEMORY_OUTPUT_STREAM (stream));
+  len = g_memory_output_stream_get_data_size (G_MEMORY_OUTPUT_STREAM (stream));
+  digest = g_compute_checksum_for_data (G_CHECKSUM_SHA256, data, len);
+
+  g_mutex_lock (&self->save_mutex);
+
+  /* A newer save will write the file anyway */
+  if (!save_is_current (self, save))
+    goto skip;
+
+  /* Unchanged since it was loaded or saved, unless modified by others */
+  if (save->digest != NULL && save->etag != NULL && strcmp (save->digest, digest) == 0)
+    {
+      g_autoptr(GFileInfo) info = g_file_query_info (save->file,
+                                                     G_FILE_ATTRIBUTE_ETAG_VALUE,
+                                                     G_FILE_QUERY_INFO_NONE,
+                                                     cancellable,
+                                                     NULL);
+
+      if (info != NULL &&
+          g_strcmp0 (save->etag, g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_ETAG_VALUE)) == 0)
+        goto skip;
+    }
+
+  /* Written to a temporary file which then replaces the original */
+  if (!g_file_replace_contents (save->file,
+                                (const char *)data,
+                                len,
+                                NULL,
+                                save->make_backup,
+                                G_FILE_CREATE_NONE,
+                                &etag,
+                                cancellable,
+                                &error))
+    {
+      g_mutex_unlock (&self->save_mutex);
+      g_task_return_error (task, g_steal_pointer (&error));
+      return;
+    }
+
+  g_free (save->etag);
+  save->etag = g_steal_pointer (&etag);
+
+skip:
+  g_mutex_unlock (&self->save_mutex);
+
+  g_free (save->digest);
+  save->digest = g_steal_pointer (&digest);
+
+  g_task_return_boolean (task, TRUE);
+}
+
+/* Serializes a snapshot of @self on a worker thread and atomically
+ * replaces @file with it, keeping the previous contents as a backup
+ * if @make_backup is set. Nothing is written if the file already has
+ * the same contents as when @self last loaded or saved it.
+ */
+void
+schemes_scheme_save_async (SchemesScheme       *self,
+                           GFile               *file,
+                           gboolean             make_backup,
+                           GCancellable        *cancellable,
+                           GAsyncReadyCallback  callback,
+                           gpointer             user_data)
 {
-  guint n_items;
+  g_autoptr(GTask) task = NULL;
+  Save *save;
 
-  g_return_val_if_fail (SCHEMES_IS_SCHEME (self), FALSE);
-  g_return_val_if_fail (name != NULL, FALSE);
+  g_return_if_fail (SCHEMES_IS_SCHEME (self));
+  g_return_if_fail (G_IS_FILE (file));
+  g_return_if_fail (!cancellable || G_IS_CANCELLABLE (cancellable));
 
-  n_items = g_list_model_get_n_items (G_LIST_MODEL (self->colors));
+  save = g_new0 (Save, 1);
+  save->snapshot = schemes_scheme_snapshot (self);
+  save->file = g_object_ref (file);
+  save->make_backup = !!make_backup;
+  save->generation = g_atomic_int_add (&self->save_generation, 1) + 1;
 
-  for (guint i = 0; i < n_items; i++)
+  if (self->saved_file != NULL && g_file_equal (self->saved_file, file))
     {
-      g_autoptr(SchemesColor) color = g_list_model_get_item (G_LIST_MODEL (self->colors), i);
-
-      if (g_strcmp0 (name, schemes_color_get_name (color)) == 0)
-        {
-          *rgba = *schemes_color_get_color (color);
-          return TRUE;
-        }
+      save->digest = g_strdup (self->saved_digest);
+      save->etag = g_strdup (self->saved_etag);
     }
 
-  return FALSE;
+  task = g_task_new (self, cancellable, callback, user_data);
+  g_task_set_source_tag (task, schemes_scheme_save_async);
+  g_task_set_task_data (task, save, (GDestroyNotify)save_free);
+  g_task_run_in_thread (task, schemes_scheme_save_worker);
 }
 
-static const GMarkupParser root_parser = {
-  root_start_element,
-  root_end_element,
-};
-
 gboolean
-schemes_scheme_load_from_file (SchemesScheme  *self,
-                               GFile          *file,
-                               GError        **error)
+schemes_scheme_save_finish (SchemesScheme  *self,
+                            GAsyncResult   *result,
+                            GError        **error)
 {
-  g_autoptr(GMarkupParseContext) context = NULL;
-  g_autofree char *contents = NULL;
-  gsize len;
+  Save *save;
 
   g_return_val_if_fail (SCHEMES_IS_SCHEME (self), FALSE);
-  g_return_val_if_fail (G_IS_FILE (file), FALSE);
+  g_return_val_if_fail (g_task_is_valid (result, self), FALSE);
 
-  context = g_markup_parse_context_new (&root_parser, 0, self, NULL);
-
-  if (!g_file_load_contents (file, NULL, &contents, &len, NULL, error) ||
-      !g_markup_parse_context_parse (context, contents, len, error))
+  if (!g_task_propagate_boolean (G_TASK (result), error))
     return FALSE;
 
-  if (self->parse_failure.failed)
-    {
-      g_set_error (error,
-                   G_IO_ERROR,
-                   G_IO_ERROR_INVALID_DATA,
-                   "Failed to parse style-scheme at %d:%d",
-                   self->parse_failure.line_pos,
-                   self->parse_failure.char_pos);
-      return FALSE;
-    }
+  save = g_task_get_task_data (G_TASK (result));
 
-  if (g_set_object (&self->file, file))
-    g_object_notify_by_pspec (G_OBJECT (self), properties [PROP_FILE]);
+  if (save_is_current (self, save))
+    schemes_scheme_set_saved (self,
+                              save->file,
+                              g_steal_pointer (&save->digest),
+                              g_steal_pointer (&save->etag));
 
   return TRUE;
 }
@@ -1107,11 +2737,15 @@ text_parser_text (GMarkupParseContext  *context,
                   GError              **error)
 {
   SchemesScheme *self = user_data;
-  g_autofree char *trimmed = g_strstrip (g_strdup (text));
+  g_autofree char *trimmed = NULL;
+
+  text = strip_text (text, &text_len);
 
-  if (str_empty0 (trimmed))
+  if (text_len == 0)
     return;
 
+  trimmed = g_strndup (text, text_len);
+
   if (g_strcmp0 (self->element_name, "author") == 0)
     schemes_scheme_set_author (self, trimmed);
   else if (g_strcmp0 (self->element_name, "_description") == 0 ||
@@ -1131,16 +2765,20 @@ metadata_text (GMarkupParseContext  *context,
                GError              **error)
 {
   SchemesScheme *self = user_data;
-  g_autofree char *trimmed = g_strstrip (g_strdup (text));
 
-  if (str_empty0 (trimmed) || self->property_name == NULL)
+  text = strip_text (text, &text_len);
+
+  if (text_len == 0 || self->property_name == NULL)
     return;
 
   if (g_strcmp0 (self->property_name, "variant") == 0)
-    schemes_scheme_set_dark (self, g_strcmp0 (trimmed, "dark") == 0);
+    schemes_scheme_set_dark (self, text_len == 4 && memcmp (text, "dark", 4) == 0);
   else if (g_strcmp0 (self->property_name, "light-variant") == 0 ||
            g_strcmp0 (self->property_name, "dark-variant") == 0)
-    schemes_scheme_set_alternate (self, trimmed);
+    {
+      g_autofree char *trimmed = g_strndup (text, text_len);
+      schemes_scheme_set_alternate (self, trimmed);
+    }
 }
 
 static void
@@ -1199,12 +2837,12 @@ static const GMarkupParser metadata_parser = {
 };
 
 static gboolean
-rgba_parse (GdkRGBA    *rgba,
-            const char *color)
+rgba_parse (SchemesRGBA *rgba,
+            const char  *color)
 {
   if (g_str_has_prefix (color, "#rgb"))
     color++;
-  return gdk_rgba_parse (rgba, color);
+  return schemes_rgba_parse (rgba, color);
 }
 
 static gboolean
@@ -1238,59 +2876,105 @@ parse_boolean_string (gboolean   *b,
 }
 
 static void
-parse_boolean (SchemesScheme *self,
-               SchemesStyle  *style,
-               const char    *property,
-               const char    *value)
+parse_boolean (SchemesScheme         *self,
+               guint                  row,
+               SchemesStyleAttribute  attribute,
+               const char            *value)
 {
   gboolean b;
 
   g_assert (SCHEMES_IS_SCHEME (self));
-  g_assert (SCHEMES_IS_STYLE (style));
-  g_assert (property != NULL);
 
   if (str_empty0 (value))
     return;
 
   if (parse_boolean_string (&b, value))
-    g_object_set (style, property, b, NULL);
+    schemes_style_table_set_boolean (self->styles, row, attribute, b);
   else
     g_warning ("Failed to parse boolean value: %s", value);
 }
 
 static void
-parse_color (SchemesScheme *self,
-             SchemesStyle  *style,
-             const char    *property,
-             const char    *value)
+parse_color (SchemesScheme     *self,
+             guint              row,
+             SchemesStyleColor  which,
+             const char        *value)
 {
-  GdkRGBA rgba;
+  SchemesColor *color;
+  SchemesRGBA rgba;
 
   g_assert (SCHEMES_IS_SCHEME (self));
-  g_assert (SCHEMES_IS_STYLE (style));
-  g_assert (property != NULL);
 
   if (str_empty0 (value))
     return;
 
-  if ((value[0] == '#' && rgba_parse (&rgba, value)) ||
-      schemes_scheme_get_named_color (self, value, &rgba))
-    g_object_set (style, property, &rgba, NULL);
+  if (value[0] == '#' && rgba_parse (&rgba, value))
+    schemes_style_table_set_color (self->styles, row, which, &rgba);
+  else if ((color = g_hash_table_lookup (self->colors_by_name, value)))
+    schemes_style_table_set_color_ref (self->styles, row, which, color);
   else
-    g_warning ("Failed to parse color: %s", value);
+    {
+      /* The color may come later in the document */
+      ColorFixup fixup = {
+        .style = schemes_style_table_get_name (self->styles, row),
+        .color = g_strdup (value),
+        .pos = self->parse_position.pos,
+        .line_pos = self->parse_position.line_pos,
+        .char_pos = self->parse_position.char_pos,
+        .which = which,
+      };
+
+      g_array_append_val (self->color_fixups, fixup);
+    }
+}
+
+/* Resolves the references parse_color() could not in one pass over
+ * the fixups, which are in document order. Positions of the fast path
+ * are only computed for names that remain unknown.
+ */
+static void
+resolve_color_fixups (SchemesScheme *self,
+                      const char    *contents)
+{
+  const char *pos = contents;
+  int line_pos = 1;
+  int char_pos = 1;
+
+  for (guint i = 0; i < self->color_fixups->len; i++)
+    {
+      const ColorFixup *fixup = &g_array_index (self->color_fixups, ColorFixup, i);
+      SchemesColor *color;
+
+      if ((color = g_hash_table_lookup (self->colors_by_name, fixup->color)))
+        {
+          schemes_style_table_set_color_ref (self->styles,
+                                             schemes_style_table_ensure (self->styles, fixup->style),
+                                             fixup->which,
+                                             color);
+          continue;
+        }
+
+      if (fixup->pos != NULL)
+        {
+          schemes_xml_advance_position (pos, fixup->pos, &line_pos, &char_pos);
+          pos = fixup->pos;
+          g_warning ("%d:%d: Failed to parse color: %s", line_pos, char_pos, fixup->color);
+        }
+      else
+        g_warning ("%d:%d: Failed to parse color: %s", fixup->line_pos, fixup->char_pos, fixup->color);
+    }
+
+  g_array_set_size (self->color_fixups, 0);
 }
 
 static void
 parse_scale (SchemesScheme *self,
-             SchemesStyle  *style,
-             const char    *property,
+             guint          row,
              const char    *value)
 {
   double d;
 
   g_assert (SCHEMES_IS_SCHEME (self));
-  g_assert (SCHEMES_IS_STYLE (style));
-  g_assert (property != NULL);
 
   if (str_empty0 (value))
     return;
@@ -1313,24 +2997,35 @@ parse_scale (SchemesScheme *self,
     d = g_ascii_strtod (value, NULL);
 
   if (!isnan (d))
-    g_object_set (style, property, d, NULL);
+    schemes_style_table_set_scale (self->styles, row, d);
   else
     g_warning ("Failed to parse value for scale: %s", value);
 }
 
+static void
+set_enum (SchemesScheme *self,
+          guint          row,
+          GType          type,
+          int            value)
+{
+  if (type == PANGO_TYPE_UNDERLINE)
+    schemes_style_table_set_underline (self->styles, row, value);
+  else if (type == PANGO_TYPE_WEIGHT)
+    schemes_style_table_set_weight (self->styles, row, value);
+  else
+    g_return_if_reached ();
+}
+
 static void
 parse_enum (SchemesScheme *self,
-            SchemesStyle  *style,
+            guint          row,
             GType          type,
-            const char    *property,
             const char    *value)
 {
   g_autoptr(GEnumClass) klass = NULL;
   const GEnumValue *info;
 
   g_assert (SCHEMES_IS_SCHEME (self));
-  g_assert (SCHEMES_IS_STYLE (style));
-  g_assert (property != NULL);
 
   if (str_empty0 (value))
     return;
@@ -1340,7 +3035,7 @@ parse_enum (SchemesScheme *self,
 
   if (info != NULL)
     {
-      g_object_set (style, property, info->value, NULL);
+      set_enum (self, row, type, info->value);
       return;
     }
 
@@ -1350,9 +3045,7 @@ parse_enum (SchemesScheme *self,
 
       if (parse_boolean_string (&b, value))
         {
-          g_object_set (style,
-                        property, b ? PANGO_UNDERLINE_SINGLE : PANGO_UNDERLINE_NONE,
-                        NULL);
+          set_enum (self, row, type, b ? PANGO_UNDERLINE_SINGLE : PANGO_UNDERLINE_NONE);
           return;
         }
 
@@ -1364,7 +3057,7 @@ parse_enum (SchemesScheme *self,
 
       if (ival != 0)
         {
-          g_object_set (style, "weight", ival, NULL);
+          set_enum (self, row, type, ival);
           return;
         }
     }
@@ -1373,6 +3066,28 @@ parse_enum (SchemesScheme *self,
              G_OBJECT_CLASS_NAME (klass), value);
 }
 
+static gboolean
+load_color (SchemesScheme *self,
+            const char    *name,
+            const char    *value)
+{
+  SchemesRGBA rgba;
+
+  /* Skip past # for rgb. GtkSourceView doesn't support this,
+   * but we can trivially in the future and this can help ensure
+   * that we still process things correctly.
+   */
+  if (g_str_has_prefix (value, "#rgb"))
+    value++;
+
+  if (!schemes_rgba_parse (&rgba, value))
+    return FALSE;
+
+  schemes_scheme_add_color_simple (self, name, &rgba);
+
+  return TRUE;
+}
+
 static void
 scheme_start_element (GMarkupParseContext  *context,
                       const char           *element_name,
@@ -1400,7 +3115,6 @@ scheme_start_element (GMarkupParseContext  *context,
     {
       const char *name = NULL;
       const char *value = NULL;
-      GdkRGBA rgba;
 
       if (!g_markup_collect_attributes (element_name, attribute_names, attribute_values, error,
                                         G_MARKUP_COLLECT_STRING, "name", &name,
@@ -1408,16 +3122,7 @@ scheme_start_element (GMarkupParseContext  *context,
                                         G_MARKUP_COLLECT_INVALID))
         return;
 
-      /* Skip past # for rgb. GtkSourceView doesn't support this,
-       * but we can trivially in the future and this can help ensure
-       * that we still process things correctly.
-       */
-      if (g_str_has_prefix (value, "#rgb"))
-        value++;
-
-      if (gdk_rgba_parse (&rgba, value))
-        schemes_scheme_add_color_simple (self, name, &rgba);
-      else
+      if (!load_color (self, name, value))
         XML_PARSER_ERROR ();
     }
   else if (g_strcmp0 (element_name, "style") == 0)
@@ -1434,7 +3139,7 @@ scheme_start_element (GMarkupParseContext  *context,
       const char *use_style = NULL;
       const char *strikethrough = NULL;
       const char *scale = NULL;
-      SchemesStyle *style;
+      guint row;
 
       if (!g_markup_collect_attributes (element_name, attribute_names, attribute_values, error,
                                         G_MARKUP_COLLECT_STRING, "name", &name,
@@ -1452,21 +3157,27 @@ scheme_start_element (GMarkupParseContext  *context,
                                         G_MARKUP_COLLECT_INVALID))
         return;
 
-      style = schemes_scheme_get_style (self, name);
-
-      parse_color (self, style, "foreground", foreground);
-      parse_color (self, style, "background", background);
-      parse_color (self, style, "line-background", line_background);
-      parse_color (self, style, "underline-color", underline_color);
-      parse_boolean (self, style, "bold", bold);
-      parse_boolean (self, style, "italic", italic);
-      parse_boolean (self, style, "strikethrough", strikethrough);
-      parse_enum (self, style, PANGO_TYPE_WEIGHT, "weight", weight);
-      parse_enum (self, style, PANGO_TYPE_UNDERLINE, "underline", underline);
-      parse_scale (self, style, "scale", scale);
+      /* Rows are filled directly, views are only created on request */
+      row = schemes_style_table_ensure (self->styles, name);
+
+      self->parse_position.pos = NULL;
+      g_markup_parse_context_get_position (context,
+                                           &self->parse_position.line_pos,
+                                           &self->parse_position.char_pos);
+
+      parse_color (self, row, SCHEMES_STYLE_COLOR_FOREGROUND, foreground);
+      parse_color (self, row, SCHEMES_STYLE_COLOR_BACKGROUND, background);
+      parse_color (self, row, SCHEMES_STYLE_COLOR_LINE_BACKGROUND, line_background);
+      parse_color (self, row, SCHEMES_STYLE_COLOR_UNDERLINE, underline_color);
+      parse_boolean (self, row, SCHEMES_STYLE_ATTRIBUTE_BOLD, bold);
+      parse_boolean (self, row, SCHEMES_STYLE_ATTRIBUTE_ITALIC, italic);
+      parse_boolean (self, row, SCHEMES_STYLE_ATTRIBUTE_STRIKETHROUGH, strikethrough);
+      parse_enum (self, row, PANGO_TYPE_WEIGHT, weight);
+      parse_enum (self, row, PANGO_TYPE_UNDERLINE, underline);
+      parse_scale (self, row, scale);
 
       if (!str_empty0 (use_style))
-        g_object_set (style, "use-style", use_style, NULL);
+        schemes_style_table_set_use_style (self->styles, row, use_style);
     }
   else
     XML_PARSER_ERROR ();
@@ -1508,6 +3219,30 @@ static const GMarkupParser scheme_parser = {
   scheme_end_element,
 };
 
+static void
+load_scheme_attributes (SchemesScheme *self,
+                        const char    *id,
+                        const char    *_name,
+                        const char    *name,
+                        const char    *version)
+{
+  schemes_scheme_set_id (self, id);
+
+  if (!str_empty0 (_name))
+    schemes_scheme_set_name (self, _name);
+  else if (!str_empty0 (name))
+    schemes_scheme_set_name (self, name);
+
+  if (str_empty0 (version))
+    version = NULL;
+
+  if (g_strcmp0 (version, self->version) != 0)
+    {
+      g_free (self->version);
+      self->version = g_strdup (version);
+    }
+}
+
 static void
 root_start_element (GMarkupParseContext  *context,
                     const char           *element_name,
@@ -1537,22 +3272,7 @@ root_start_element (GMarkupParseContext  *context,
                                         G_MARKUP_COLLECT_INVALID))
         return;
 
-      schemes_scheme_set_id (self, id);
-
-      if (!str_empty0 (_name))
-        schemes_scheme_set_name (self, _name);
-      else if (!str_empty0 (name))
-        schemes_scheme_set_name (self, name);
-
-      if (str_empty0 (version))
-        version = NULL;
-
-      if (g_strcmp0 (version, self->version) != 0)
-        {
-          g_free (self->version);
-          self->version = g_strdup (version);
-        }
-
+      load_scheme_attributes (self, id, _name, name, version);
       g_markup_parse_context_push (context, &scheme_parser, self);
     }
   else
@@ -1576,3 +3296,456 @@ root_end_element (GMarkupParseContext  *context,
   else
     XML_PARSER_ERROR ();
 }
+
+/* The fast path below handles documents using only the style-scheme
+ * vocabulary, dispatching on ids instead of comparing names and
+ * reading values where they are in the document. Anything it does not
+ * understand is left to the GMarkup parser above.
+ */
+enum {
+  XML_NONE,
+  XML_STYLE_SCHEME,
+  XML_AUTHOR,
+  XML__DESCRIPTION,
+  XML_DESCRIPTION,
+  XML_METADATA,
+  XML_PROPERTY,
+  XML_COLOR,
+  XML_STYLE,
+  XML_ID,
+  XML__NAME,
+  XML_NAME,
+  XML_VERSION,
+  XML_VALUE,
+  XML_FOREGROUND,
+  XML_BACKGROUND,
+  XML_LINE_BACKGROUND,
+  XML_BOLD,
+  XML_ITALIC,
+  XML_SCALE,
+  XML_WEIGHT,
+  XML_UNDERLINE,
+  XML_UNDERLINE_COLOR,
+  XML_USE_STYLE,
+  XML_STRIKETHROUGH,
+  XML_N_NAMES
+};
+
+static const char * const xml_vocabulary[] = {
+  "style-scheme",
+  "author",
+  "_description",
+  "description",
+  "metadata",
+  "property",
+  "color",
+  "style",
+  "id",
+  "_name",
+  "name",
+  "version",
+  "value",
+  "foreground",
+  "background",
+  "line-background",
+  "bold",
+  "italic",
+  "scale",
+  "weight",
+  "underline",
+  "underline-color",
+  "use-style",
+  "strikethrough",
+  NULL
+};
+
+#define XML_BIT(id) (1u << (id))
+
+static const struct {
+  guint parent;
+  guint32 allowed;
+  guint32 required;
+} xml_elements[XML_N_NAMES] = {
+  [XML_STYLE_SCHEME] = { XML_NONE,
+                         XML_BIT (XML_ID) | XML_BIT (XML__NAME) | XML_BIT (XML_NAME) | XML_BIT (XML_VERSION),
+                         XML_BIT (XML_ID) },
+  [XML_AUTHOR]       = { XML_STYLE_SCHEME, 0, 0 },
+  [XML__DESCRIPTION] = { XML_STYLE_SCHEME, 0, 0 },
+  [XML_DESCRIPTION]  = { XML_STYLE_SCHEME, 0, 0 },
+  [XML_METADATA]     = { XML_STYLE_SCHEME, 0, 0 },
+  [XML_PROPERTY]     = { XML_METADATA, XML_BIT (XML_NAME), XML_BIT (XML_NAME) },
+  [XML_COLOR]        = { XML_STYLE_SCHEME,
+                         XML_BIT (XML_NAME) | XML_BIT (XML_VALUE),
+                         XML_BIT (XML_NAME) | XML_BIT (XML_VALUE) },
+  [XML_STYLE]        = { XML_STYLE_SCHEME,
+                         XML_BIT (XML_NAME) | XML_BIT (XML_FOREGROUND) | XML_BIT (XML_BACKGROUND) |
+                         XML_BIT (XML_LINE_BACKGROUND) | XML_BIT (XML_BOLD) | XML_BIT (XML_ITALIC) |
+                         XML_BIT (XML_SCALE) | XML_BIT (XML_WEIGHT) | XML_BIT (XML_UNDERLINE) |
+                         XML_BIT (XML_UNDERLINE_COLOR) | XML_BIT (XML_USE_STYLE) | XML_BIT (XML_STRIKETHROUGH),
+                         XML_BIT (XML_NAME) },
+};
+
+static gboolean fast_parser_disabled;
+
+/* Only meant for comparing both parsers */
+void
+schemes_scheme_set_fast_parser_enabled (gboolean enabled)
+{
+  fast_parser_disabled = !enabled;
+}
+
+/* Checks that @tokens are something the GMarkup parser would load
+ * without errors, before anything is applied to the scheme.
+ */
+static gboolean
+validate_tokens (GArray *tokens,
+                 GArray *attributes)
+{
+  guint stack[3];
+  guint depth = 0;
+
+  for (guint i = 0; i < tokens->len; i++)
+    {
+      const SchemesXmlToken *token = &g_array_index (tokens, SchemesXmlToken, i);
+      guint32 seen = 0;
+
+      if (token->kind == SCHEMES_XML_TOKEN_END)
+        depth--;
+
+      if (token->kind != SCHEMES_XML_TOKEN_START)
+        continue;
+
+      /* Attribute names are not elements */
+      if (token->id == XML_NONE ||
+          token->id > XML_STYLE ||
+          depth == G_N_ELEMENTS (stack) ||
+          xml_elements[token->id].parent != (depth ? stack[depth - 1] : XML_NONE))
+        return FALSE;
+
+      for (guint j = 0; j < token->n_attributes; j++)
+        seen |= XML_BIT (g_array_index (attributes, SchemesXmlAttribute, token->first_attribute + j).id);
+
+      if ((seen & ~xml_elements[token->id].allowed) != 0 ||
+          (seen & xml_elements[token->id].required) != xml_elements[token->id].required)
+        return FALSE;
+
+      stack[depth++] = token->id;
+    }
+
+  return TRUE;
+}
+
+/* Returns @attribute as a nul-terminated string in @buf, or in @heap
+ * should it not fit.
+ */
+static const char *
+attribute_to_string (const SchemesXmlAttribute  *attribute,
+                     char                       *buf,
+                     gsize                       buf_len,
+                     char                      **heap)
+{
+  char *dest;
+  gsize len;
+
+  if (attribute == NULL)
+    return NULL;
+
+  if (attribute->len < buf_len)
+    dest = buf;
+  else
+    dest = *heap = g_malloc (attribute->len + 1);
+
+  if (attribute->has_entities)
+    len = schemes_xml_unescape (dest, attribute->value, attribute->len);
+  else
+    memcpy (dest, attribute->value, (len = attribute->len));
+
+  dest[len] = 0;
+
+  return dest;
+}
+
+static inline int
+hex_byte (const char *s)
+{
+  int hi = g_ascii_xdigit_value (s[0]);
+  int lo = g_ascii_xdigit_value (s[1]);
+
+  if (hi < 0 || lo < 0)
+    return -1;
+
+  return (hi << 4) | lo;
+}
+
+/* #rrggbb and #rrggbbaa as written by schemes_xml_writer_write_hex_color(),
+ * converted the same way pango_color_parse_with_alpha() would.
+ */
+static gboolean
+parse_hex_color (SchemesRGBA *rgba,
+                 const char  *value,
+                 gsize        len)
+{
+  int c[4] = { 0, 0, 0, 255 };
+
+  if ((len != 7 && len != 9) || value[0] != '#')
+    return FALSE;
+
+  for (guint i = 0; i < (len - 1) / 2; i++)
+    {
+      if ((c[i] = hex_byte (&value[1 + i * 2])) < 0)
+        return FALSE;
+    }
+
+  rgba->red = (c[0] * 257) / 65535.0;
+  rgba->green = (c[1] * 257) / 65535.0;
+  rgba->blue = (c[2] * 257) / 65535.0;
+  rgba->alpha = (c[3] * 257) / 65535.0;
+
+  return TRUE;
+}
+
+static void
+load_color_attribute (SchemesScheme             *self,
+                      guint                      row,
+                      SchemesStyleColor          which,
+                      const SchemesXmlAttribute *attribute)
+{
+  g_autofree char *heap = NULL;
+  SchemesRGBA rgba;
+  char buf[128];
+
+  if (attribute == NULL)
+    return;
+
+  if (!attribute->has_entities && parse_hex_color (&rgba, attribute->value, attribute->len))
+    schemes_style_table_set_color (self->styles, row, which, &rgba);
+  else
+    parse_color (self, row, which, attribute_to_string (attribute, buf, sizeof buf, &heap));
+}
+
+static void
+load_boolean_attribute (SchemesScheme             *self,
+                        guint                      row,
+                        SchemesStyleAttribute      attribute,
+                        const SchemesXmlAttribute *value)
+{
+  g_autofree char *heap = NULL;
+  char buf[32];
+  gboolean b;
+
+  if (value == NULL || value->len == 0)
+    return;
+
+  /* Only the first character is looked at */
+  if (parse_boolean_string (&b, value->value))
+    schemes_style_table_set_boolean (self->styles, row, attribute, b);
+  else
+    parse_boolean (self, row, attribute, attribute_to_string (value, buf, sizeof buf, &heap));
+}
+
+static void
+load_enum_attribute (SchemesScheme             *self,
+                     guint                      row,
+                     GEnumClass                *klass,
+                     const SchemesXmlAttribute *attribute)
+{
+  g_autofree char *heap = NULL;
+  char buf[32];
+
+  if (attribute == NULL || attribute->len == 0)
+    return;
+
+  for (guint i = 0; i < klass->n_values; i++)
+    {
+      const char *nick = klass->values[i].value_nick;
+
+      if (strncmp (nick, attribute->value, attribute->len) == 0 && nick[attribute->len] == 0)
+        {
+          set_enum (self, row, G_TYPE_FROM_CLASS (klass), klass->values[i].value);
+          return;
+        }
+    }
+
+  parse_enum (self, row, G_TYPE_FROM_CLASS (klass), attribute_to_string (attribute, buf, sizeof buf, &heap));
+}
+
+static void
+load_style (SchemesScheme              *self,
+            const SchemesXmlAttribute **values,
+            GEnumClass                 *weight_class,
+            GEnumClass                 *underline_class)
+{
+  g_autofree char *name_heap = NULL;
+  g_autofree char *scale_heap = NULL;
+  g_autofree char *use_style_heap = NULL;
+  char name_buf[128];
+  char scale_buf[32];
+  char use_style_buf[128];
+  const char *name;
+  guint row;
+
+  name = attribute_to_string (values[XML_NAME], name_buf, sizeof name_buf, &name_heap);
+  row = schemes_style_table_ensure (self->styles, name);
+
+  load_color_attribute (self, row, SCHEMES_STYLE_COLOR_FOREGROUND, values[XML_FOREGROUND]);
+  load_color_attribute (self, row, SCHEMES_STYLE_COLOR_BACKGROUND, values[XML_BACKGROUND]);
+  load_color_attribute (self, row, SCHEMES_STYLE_COLOR_LINE_BACKGROUND, values[XML_LINE_BACKGROUND]);
+  load_color_attribute (self, row, SCHEMES_STYLE_COLOR_UNDERLINE, values[XML_UNDERLINE_COLOR]);
+  load_boolean_attribute (self, row, SCHEMES_STYLE_ATTRIBUTE_BOLD, values[XML_BOLD]);
+  load_boolean_attribute (self, row, SCHEMES_STYLE_ATTRIBUTE_ITALIC, values[XML_ITALIC]);
+  load_boolean_attribute (self, row, SCHEMES_STYLE_ATTRIBUTE_STRIKETHROUGH, values[XML_STRIKETHROUGH]);
+  load_enum_attribute (self, row, weight_class, values[XML_WEIGHT]);
+  load_enum_attribute (self, row, underline_class, values[XML_UNDERLINE]);
+  parse_scale (self, row, attribute_to_string (values[XML_SCALE], scale_buf, sizeof scale_buf, &scale_heap));
+
+  if (values[XML_USE_STYLE] != NULL && values[XML_USE_STYLE]->len > 0)
+    schemes_style_table_set_use_style (self->styles, row,
+                                       attribute_to_string (values[XML_USE_STYLE],
+                                                            use_style_buf, sizeof use_style_buf,
+                                                            &use_style_heap));
+}
+
+static void
+load_text (SchemesScheme         *self,
+           guint                  element,
+           const SchemesXmlToken *token)
+{
+  g_autofree char *unescaped = NULL;
+  const char *text = token->text;
+  gsize len = token->len;
+
+  if (token->has_entities)
+    {
+      unescaped = g_malloc (len);
+      len = schemes_xml_unescape (unescaped, text, len);
+      text = unescaped;
+    }
+
+  /* Same handling as with GMarkup, which does not use the context */
+  if (element == XML_PROPERTY)
+    metadata_text (NULL, text, len, self, NULL);
+  else
+    {
+      self->element_name = g_intern_static_string (xml_vocabulary[element - 1]);
+      text_parser_text (NULL, text, len, self, NULL);
+      self->element_name = NULL;
+    }
+}
+
+/* Returns %FALSE, leaving @self untouched, if @contents needs GMarkup */
+static gboolean
+schemes_scheme_load_tokens (SchemesScheme *self,
+                            const char    *contents,
+                            gsize          len,
+                            LoadProgress  *progress,
+                            GCancellable  *cancellable)
+{
+  g_autoptr(GArray) tokens = NULL;
+  g_autoptr(GArray) attributes = NULL;
+  g_autoptr(GEnumClass) weight_class = NULL;
+  g_autoptr(GEnumClass) underline_class = NULL;
+  guint element = XML_NONE;
+
+  g_assert (SCHEMES_IS_SCHEME (self));
+
+  if (fast_parser_disabled)
+    return FALSE;
+
+  /* Roughly one element per line of a typical scheme */
+  tokens = g_array_sized_new (FALSE, FALSE, sizeof (SchemesXmlToken), len / 32 + 16);
+  attributes = g_array_sized_new (FALSE, FALSE, sizeof (SchemesXmlAttribute), len / 32 + 16);
+
+  if (!schemes_xml_tokenize (contents, len, xml_vocabulary, tokens, attributes) ||
+      !validate_tokens (tokens, attributes))
+    return FALSE;
+
+  weight_class = g_type_class_ref (PANGO_TYPE_WEIGHT);
+  underline_class = g_type_class_ref (PANGO_TYPE_UNDERLINE);
+
+  for (guint i = 0; i < tokens->len; i++)
+    {
+      const SchemesXmlToken *token = &g_array_index (tokens, SchemesXmlToken, i);
+      const SchemesXmlAttribute *values[XML_N_NAMES] = {0};
+      char buf[4][128];
+      char *heap[4] = {0};
+
+      /* The caller notices cancellation, the scheme is discarded */
+      if (i % LOAD_SLICE_TOKENS == 0 && i > 0)
+        {
+          if (g_cancellable_is_cancelled (cancellable))
+            break;
+
+          load_progress_report (progress, (double)(token->text - contents) / len);
+        }
+
+      if (token->kind == SCHEMES_XML_TOKEN_TEXT)
+        {
+          if (element == XML_AUTHOR ||
+              element == XML__DESCRIPTION ||
+              element == XML_DESCRIPTION ||
+              element == XML_PROPERTY)
+            load_text (self, element, token);
+          continue;
+        }
+
+      if (token->kind == SCHEMES_XML_TOKEN_END)
+        {
+          if (token->id == XML_PROPERTY)
+            self->property_name = NULL;
+          element = xml_elements[token->id].parent;
+          continue;
+        }
+
+      element = token->id;
+
+      for (guint j = 0; j < token->n_attributes; j++)
+        {
+          const SchemesXmlAttribute *attribute = &g_array_index (attributes, SchemesXmlAttribute, token->first_attribute + j);
+          values[attribute->id] = attribute;
+        }
+
+      switch (token->id)
+        {
+        case XML_STYLE_SCHEME:
+          load_scheme_attributes (self,
+                                  attribute_to_string (values[XML_ID], buf[0], sizeof buf[0], &heap[0]),
+                                  attribute_to_string (values[XML__NAME], buf[1], sizeof buf[1], &heap[1]),
+                                  attribute_to_string (values[XML_NAME], buf[2], sizeof buf[2], &heap[2]),
+                                  attribute_to_string (values[XML_VERSION], buf[3], sizeof buf[3], &heap[3]));
+          break;
+
+        case XML_PROPERTY:
+          self->property_name = g_intern_string (attribute_to_string (values[XML_NAME], buf[0], sizeof buf[0], &heap[0]));
+          break;
+
+        case XML_COLOR:
+          if (!load_color (self,
+                           attribute_to_string (values[XML_NAME], buf[0], sizeof buf[0], &heap[0]),
+                           attribute_to_string (values[XML_VALUE], buf[1], sizeof buf[1], &heap[1])) &&
+              !self->parse_failure.failed)
+            {
+              self->parse_failure.failed = TRUE;
+              self->parse_failure.line_pos = 1;
+              self->parse_failure.char_pos = 1;
+              schemes_xml_advance_position (contents,
+                                            token->text,
+                                            &self->parse_failure.line_pos,
+                                            &self->parse_failure.char_pos);
+            }
+          break;
+
+        case XML_STYLE:
+          self->parse_position.pos = token->text;
+          load_style (self, values, weight_class, underline_class);
+          break;
+
+        default:
+          break;
+        }
+
+      for (guint j = 0; j < G_N_ELEMENTS (heap); j++)
+        g_free (heap[j]);
+    }
+
+  return TRUE;
+}
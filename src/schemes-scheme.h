@@ -20,7 +20,7 @@
 
 #pragma once
 
-#include <gtksourceview/gtksource.h>
+#include <gio/gio.h>
 
 #include "schemes-color.h"
 #include "schemes-style.h"
@@ -28,10 +28,38 @@
 G_BEGIN_DECLS
 
 #define SCHEMES_TYPE_SCHEME (schemes_scheme_get_type())
+#define SCHEMES_TYPE_SCHEME_SNAPSHOT (schemes_scheme_snapshot_get_type())
 
 G_DECLARE_FINAL_TYPE (SchemesScheme, schemes_scheme, SCHEMES, SCHEME, GObject)
 
+typedef struct _SchemesSchemeSnapshot SchemesSchemeSnapshot;
+
+/* Summary of what changed, passed to the "changed" signal */
+typedef enum _SchemesSchemeChanges
+{
+  SCHEMES_SCHEME_CHANGES_NONE     = 0,
+  SCHEMES_SCHEME_CHANGES_METADATA = 1 << 0,
+  SCHEMES_SCHEME_CHANGES_COLORS   = 1 << 1,
+  SCHEMES_SCHEME_CHANGES_STYLES   = 1 << 2,
+} SchemesSchemeChanges;
+
+typedef const char *(*SchemesLanguageNameFunc) (const char *language_id);
+typedef void        (*SchemesSchemeProgressFunc) (double   fraction,
+                                                  gpointer user_data);
+
+void schemes_scheme_set_language_name_func  (SchemesLanguageNameFunc  func);
+void schemes_scheme_set_fast_parser_enabled (gboolean                 enabled);
+
 SchemesScheme        *schemes_scheme_new             (void);
+void                  schemes_scheme_begin_update    (SchemesScheme  *self);
+void                  schemes_scheme_end_update      (SchemesScheme  *self);
+gboolean              schemes_scheme_undo            (SchemesScheme  *self);
+gboolean              schemes_scheme_redo            (SchemesScheme  *self);
+gboolean              schemes_scheme_can_undo        (SchemesScheme  *self);
+gboolean              schemes_scheme_can_redo        (SchemesScheme  *self);
+void                  schemes_scheme_clear_history   (SchemesScheme  *self);
+void                  schemes_scheme_set_max_history (SchemesScheme  *self,
+                                                      gsize           max_size);
 GFile                *schemes_scheme_get_file        (SchemesScheme  *self);
 void                  schemes_scheme_set_file        (SchemesScheme  *self,
                                                       GFile          *file);
@@ -55,7 +83,7 @@ void                  schemes_scheme_set_dark        (SchemesScheme  *self,
                                                       gboolean        dark);
 gboolean              schemes_scheme_get_named_color (SchemesScheme  *self,
                                                       const char     *name,
-                                                      GdkRGBA        *rgba);
+                                                      SchemesRGBA    *rgba);
 GListModel           *schemes_scheme_get_colors      (SchemesScheme  *self);
 void                  schemes_scheme_add_color       (SchemesScheme  *self,
                                                       SchemesColor   *color);
@@ -65,13 +93,51 @@ gboolean              schemes_scheme_import_palette  (SchemesScheme  *self,
                                                       const char     *data,
                                                       gssize          len,
                                                       GError        **error);
-SchemesStyle         *schemes_scheme_get_style       (SchemesScheme  *self,
+SchemesStyle         *schemes_scheme_dup_style       (SchemesScheme  *self,
                                                       const char     *name);
+gboolean              schemes_scheme_get_style_data  (SchemesScheme    *self,
+                                                      const char       *name,
+                                                      SchemesStyleData *data);
 char                 *schemes_scheme_to_string       (SchemesScheme  *self);
-GtkSourceStyleScheme *schemes_scheme_preview         (SchemesScheme  *self);
 gboolean              schemes_scheme_is_pristine     (SchemesScheme  *self);
 gboolean              schemes_scheme_load_from_file  (SchemesScheme  *self,
                                                       GFile          *file,
                                                       GError        **error);
+void                  schemes_scheme_load_from_file_async  (SchemesScheme             *self,
+                                                            GFile                     *file,
+                                                            SchemesSchemeProgressFunc  progress_func,
+                                                            gpointer                   progress_data,
+                                                            GCancellable              *cancellable,
+                                                            GAsyncReadyCallback        callback,
+                                                            gpointer                   user_data);
+gboolean              schemes_scheme_load_from_file_finish (SchemesScheme  *self,
+                                                            GAsyncResult   *result,
+                                                            GError        **error);
+void                  schemes_scheme_save_async      (SchemesScheme        *self,
+                                                      GFile                *file,
+                                                      gboolean              make_backup,
+                                                      GCancellable         *cancellable,
+                                                      GAsyncReadyCallback   callback,
+                                                      gpointer              user_data);
+gboolean              schemes_scheme_save_finish     (SchemesScheme  *self,
+                                                      GAsyncResult   *result,
+                                                      GError        **error);
+
+GType                  schemes_scheme_snapshot_get_type  (void) G_GNUC_CONST;
+SchemesSchemeSnapshot *schemes_scheme_snapshot           (SchemesScheme         *self);
+SchemesSchemeSnapshot *schemes_scheme_snapshot_ref       (SchemesSchemeSnapshot *self);
+void                   schemes_scheme_snapshot_unref     (SchemesSchemeSnapshot *self);
+const char            *schemes_scheme_snapshot_get_id    (SchemesSchemeSnapshot *self);
+const char            *schemes_scheme_snapshot_get_name  (SchemesSchemeSnapshot *self);
+char                  *schemes_scheme_snapshot_to_string (SchemesSchemeSnapshot *self);
+gboolean               schemes_scheme_snapshot_write     (SchemesSchemeSnapshot  *self,
+                                                          GOutputStream          *stream,
+                                                          GCancellable           *cancellable,
+                                                          GError                **error);
+guint                  schemes_scheme_snapshot_hash      (gconstpointer          data);
+gboolean               schemes_scheme_snapshot_equal     (gconstpointer          a,
+                                                          gconstpointer          b);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (SchemesSchemeSnapshot, schemes_scheme_snapshot_unref)
 
 G_END_DECLS
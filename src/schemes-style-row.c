@@ -44,8 +44,11 @@ null_to_transparent (GBinding     *binding,
                      GValue       *to_value,
                      gpointer      user_data)
 {
-  const GdkRGBA transparent = {0};
+  const SchemesRGBA transparent = {0};
 
+  /* Binds SchemesRGBA on the style to GdkRGBA on the button, which
+   * share the same layout.
+   */
   if (g_value_get_boxed (from_value) == NULL)
     g_value_set_boxed (to_value, &transparent);
   else
@@ -62,9 +65,9 @@ unset_cb (GtkWidget    *widget,
   const char *property_set = g_object_get_data (G_OBJECT (widget), "PROPERTY_SET");
   GParamSpec *pspec = g_object_class_find_property (G_OBJECT_GET_CLASS (style), property);
 
-  if (g_type_is_a (pspec->value_type, GDK_TYPE_RGBA))
+  if (g_type_is_a (pspec->value_type, SCHEMES_TYPE_RGBA))
     {
-      static const GdkRGBA transparent = {0};
+      static const SchemesRGBA transparent = {0};
       g_object_set (style, property, &transparent, NULL);
     }
   else if (G_IS_PARAM_SPEC_BOOLEAN (pspec))
@@ -103,6 +106,7 @@ on_color_clicked_cb (GtkButton       *button,
   SchemesScheme *scheme;
   GListModel *colors;
   GtkWidget *window;
+  GPtrArray *palette;
   guint n_colors;
 
   g_assert (GTK_IS_BUTTON (button));
@@ -110,6 +114,7 @@ on_color_clicked_cb (GtkButton       *button,
 
   chooser = GTK_COLOR_CHOOSER (gtk_widget_get_parent (GTK_WIDGET (button)));
   color_ar = g_array_new (FALSE, FALSE, sizeof (GdkRGBA));
+  palette = g_ptr_array_new_with_free_func (g_object_unref);
 
   window = gtk_widget_get_ancestor (GTK_WIDGET (self), SCHEMES_TYPE_WINDOW);
   scheme = schemes_window_get_scheme (SCHEMES_WINDOW (window));
@@ -119,11 +124,17 @@ on_color_clicked_cb (GtkButton       *button,
   for (guint i = 0; i < n_colors; i++)
     {
       g_autoptr(SchemesColor) color = g_list_model_get_item (colors, i);
-      const GdkRGBA *rgba = schemes_color_get_color (color);
+      const SchemesRGBA *rgba = schemes_color_get_color (color);
+      GdkRGBA gdk_rgba = { rgba->red, rgba->green, rgba->blue, rgba->alpha };
 
-      g_array_append_vals (color_ar, rgba, 1);
+      g_array_append_val (color_ar, gdk_rgba);
+      g_ptr_array_add (palette, g_steal_pointer (&color));
     }
 
+  /* Remembered so that picking from the palette links to the color */
+  g_object_set_data_full (G_OBJECT (chooser), "PALETTE", palette,
+                          (GDestroyNotify)g_ptr_array_unref);
+
   if (color_ar->len > 0)
     {
       gtk_color_chooser_add_palette (chooser, GTK_ORIENTATION_HORIZONTAL, 10, 0, NULL);
@@ -132,6 +143,41 @@ on_color_clicked_cb (GtkButton       *button,
     }
 }
 
+static void
+on_color_set_cb (GtkColorButton  *button,
+                 SchemesStyleRow *self)
+{
+  GPtrArray *palette = g_object_get_data (G_OBJECT (button), "PALETTE");
+  SchemesStyleColor which = GPOINTER_TO_UINT (g_object_get_data (G_OBJECT (button), "WHICH"));
+  SchemesColor *color = NULL;
+  GdkRGBA gdk_rgba;
+  SchemesRGBA rgba;
+
+  g_assert (GTK_IS_COLOR_BUTTON (button));
+  g_assert (SCHEMES_IS_STYLE_ROW (self));
+
+  gtk_color_chooser_get_rgba (GTK_COLOR_CHOOSER (button), &gdk_rgba);
+  rgba = (SchemesRGBA) { gdk_rgba.red, gdk_rgba.green, gdk_rgba.blue, gdk_rgba.alpha };
+
+  /* Palette entries may share a value, keep following the same one */
+  if ((color = schemes_style_get_color_ref (self->style, which)) &&
+      !schemes_rgba_equal (&rgba, schemes_color_get_color (color)))
+    color = NULL;
+
+  for (guint i = 0; color == NULL && palette != NULL && i < palette->len; i++)
+    {
+      SchemesColor *item = g_ptr_array_index (palette, i);
+
+      if (schemes_rgba_equal (&rgba, schemes_color_get_color (item)))
+        color = item;
+    }
+
+  if (color != NULL)
+    schemes_style_set_color_ref (self->style, which, color);
+  else
+    schemes_style_set_color (self->style, which, &rgba);
+}
+
 static GtkWidget *
 create_unset_button (const char *title)
 {
@@ -150,11 +196,12 @@ create_unset_button (const char *title)
 }
 
 static void
-add_color (SchemesStyleRow *self,
-           guint            row,
-           const char      *title,
-           const char      *property,
-           const char      *property_set)
+add_color (SchemesStyleRow   *self,
+           guint              row,
+           const char        *title,
+           SchemesStyleColor  which,
+           const char        *property,
+           const char        *property_set)
 {
   GtkWidget *color;
   GtkWidget *label;
@@ -174,6 +221,12 @@ add_color (SchemesStyleRow *self,
                            G_CALLBACK (on_color_clicked_cb),
                            self,
                            0);
+  g_object_set_data (G_OBJECT (color), "WHICH", GUINT_TO_POINTER (which));
+  g_signal_connect_object (color,
+                           "color-set",
+                           G_CALLBACK (on_color_set_cb),
+                           self,
+                           0);
 
   gtk_color_chooser_set_use_alpha (GTK_COLOR_CHOOSER (color), TRUE);
   gtk_widget_set_valign (color, GTK_ALIGN_CENTER);
@@ -187,9 +240,10 @@ add_color (SchemesStyleRow *self,
 
   connect_unset (unset, self->style, property, property_set);
 
+  /* Written back from on_color_set_cb(), which knows the palette */
   g_object_bind_property_full (self->style, property,
                                color, "rgba",
-                               G_BINDING_SYNC_CREATE | G_BINDING_BIDIRECTIONAL,
+                               G_BINDING_SYNC_CREATE,
                                null_to_transparent, NULL, NULL, NULL);
   g_object_bind_property (self->style, property_set,
                           unset, "sensitive",
@@ -372,16 +426,20 @@ add_controls (SchemesStyleRow     *self,
   guint row = 0;
 
   if (options & SCHEMES_STYLE_OPTIONS_HAS_BACKGROUND)
-    add_color (self, row++, _("Background"), "background", "background-set");
+    add_color (self, row++, _("Background"),
+               SCHEMES_STYLE_COLOR_BACKGROUND, "background", "background-set");
 
   if (options & SCHEMES_STYLE_OPTIONS_HAS_FOREGROUND)
-    add_color (self, row++, _("Foreground"), "foreground", "foreground-set");
+    add_color (self, row++, _("Foreground"),
+               SCHEMES_STYLE_COLOR_FOREGROUND, "foreground", "foreground-set");
 
   if (options & SCHEMES_STYLE_OPTIONS_HAS_UNDERLINE_COLOR)
-    add_color (self, row++, _("Underline Color"), "underline-color", "underline-color-set");
+    add_color (self, row++, _("Underline Color"),
+               SCHEMES_STYLE_COLOR_UNDERLINE, "underline-color", "underline-color-set");
 
   if (options & SCHEMES_STYLE_OPTIONS_HAS_LINE_BACKGROUND)
-    add_color (self, row++, _("Paragraph Background"), "line-background", "line-background-set");
+    add_color (self, row++, _("Paragraph Background"),
+               SCHEMES_STYLE_COLOR_LINE_BACKGROUND, "line-background", "line-background-set");
 
   if (options & SCHEMES_STYLE_OPTIONS_HAS_BOLD)
     add_toggle (self, row++, _("Bold"), "bold", "bold-set");
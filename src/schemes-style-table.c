@@ -0,0 +1,1272 @@
+/* schemes-style-table.c
+ *
+ * Copyright 2022 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+
+#include "config.h"
+
+#include <math.h>
+#include <string.h>
+
+#include "schemes-style-table.h"
+#include "schemes-xml.h"
+
+#define FLAG_BOLD          (1 << 0)
+#define FLAG_ITALIC        (1 << 1)
+#define FLAG_STRIKETHROUGH (1 << 2)
+
+/* Styles are stored as columns indexed by row so that a scheme with
+ * thousands of styles costs a few contiguous allocations rather than
+ * an object each. SchemesStyle is only a view onto a row, created when
+ * something needs to bind to it.
+ *
+ * Only styles with attributes set have a row. Looking at a style does
+ * not add one, and a row is recycled once its last attribute is unset.
+ */
+struct _SchemesStyleTable
+{
+  /* Name to row + 1, keys are the interned names */
+  GHashTable *rows;
+
+  /* Name to view, weak as views remove themselves when finalized. Views
+   * may exist for names without a row.
+   */
+  GHashTable *views;
+
+  /* Rows emptied and available to be reused */
+  GArray *free_rows;
+
+  SchemesStyleTableFunc changed_func;
+  gpointer changed_data;
+
+  guint n_rows;
+  guint n_allocated;
+
+  /* Interned strings */
+  const char **names;
+  const char **languages;
+  const char **use_styles;
+
+  /* 1 << SchemesStyleAttribute for each attribute that is set */
+  guint16 *set;
+  guint8 *flags;
+  SchemesRGBA *colors[SCHEMES_STYLE_N_COLORS];
+  SchemesColor **refs[SCHEMES_STYLE_N_COLORS];
+  guint8 *underlines;
+  guint16 *weights;
+  double *scales;
+};
+
+static const char *attribute_names[SCHEMES_STYLE_N_ATTRIBUTES] = {
+  [SCHEMES_STYLE_ATTRIBUTE_FOREGROUND] = "foreground",
+  [SCHEMES_STYLE_ATTRIBUTE_BACKGROUND] = "background",
+  [SCHEMES_STYLE_ATTRIBUTE_LINE_BACKGROUND] = "line-background",
+  [SCHEMES_STYLE_ATTRIBUTE_UNDERLINE_COLOR] = "underline-color",
+  [SCHEMES_STYLE_ATTRIBUTE_BOLD] = "bold",
+  [SCHEMES_STYLE_ATTRIBUTE_ITALIC] = "italic",
+  [SCHEMES_STYLE_ATTRIBUTE_STRIKETHROUGH] = "strikethrough",
+  [SCHEMES_STYLE_ATTRIBUTE_UNDERLINE] = "underline",
+  [SCHEMES_STYLE_ATTRIBUTE_WEIGHT] = "weight",
+  [SCHEMES_STYLE_ATTRIBUTE_SCALE] = "scale",
+  [SCHEMES_STYLE_ATTRIBUTE_USE_STYLE] = "use-style",
+};
+
+static const char *attribute_set_names[SCHEMES_STYLE_N_ATTRIBUTES] = {
+  [SCHEMES_STYLE_ATTRIBUTE_FOREGROUND] = "foreground-set",
+  [SCHEMES_STYLE_ATTRIBUTE_BACKGROUND] = "background-set",
+  [SCHEMES_STYLE_ATTRIBUTE_LINE_BACKGROUND] = "line-background-set",
+  [SCHEMES_STYLE_ATTRIBUTE_UNDERLINE_COLOR] = "underline-color-set",
+  [SCHEMES_STYLE_ATTRIBUTE_BOLD] = "bold-set",
+  [SCHEMES_STYLE_ATTRIBUTE_ITALIC] = "italic-set",
+  [SCHEMES_STYLE_ATTRIBUTE_STRIKETHROUGH] = "strikethrough-set",
+  [SCHEMES_STYLE_ATTRIBUTE_UNDERLINE] = "underline-set",
+  [SCHEMES_STYLE_ATTRIBUTE_WEIGHT] = "weight-set",
+  [SCHEMES_STYLE_ATTRIBUTE_SCALE] = "scale-set",
+  [SCHEMES_STYLE_ATTRIBUTE_USE_STYLE] = "use-style-set",
+};
+
+const char *
+schemes_style_attribute_get_name (SchemesStyleAttribute attribute)
+{
+  g_return_val_if_fail (attribute < SCHEMES_STYLE_N_ATTRIBUTES, NULL);
+
+  return attribute_names[attribute];
+}
+
+const char *
+schemes_style_attribute_get_set_name (SchemesStyleAttribute attribute)
+{
+  g_return_val_if_fail (attribute < SCHEMES_STYLE_N_ATTRIBUTES, NULL);
+
+  return attribute_set_names[attribute];
+}
+
+static inline guint8
+flag_for_attribute (SchemesStyleAttribute attribute)
+{
+  switch (attribute)
+    {
+    case SCHEMES_STYLE_ATTRIBUTE_BOLD:
+      return FLAG_BOLD;
+
+    case SCHEMES_STYLE_ATTRIBUTE_ITALIC:
+      return FLAG_ITALIC;
+
+    case SCHEMES_STYLE_ATTRIBUTE_STRIKETHROUGH:
+      return FLAG_STRIKETHROUGH;
+
+    case SCHEMES_STYLE_ATTRIBUTE_FOREGROUND:
+    case SCHEMES_STYLE_ATTRIBUTE_BACKGROUND:
+    case SCHEMES_STYLE_ATTRIBUTE_LINE_BACKGROUND:
+    case SCHEMES_STYLE_ATTRIBUTE_UNDERLINE_COLOR:
+    case SCHEMES_STYLE_ATTRIBUTE_UNDERLINE:
+    case SCHEMES_STYLE_ATTRIBUTE_WEIGHT:
+    case SCHEMES_STYLE_ATTRIBUTE_SCALE:
+    case SCHEMES_STYLE_ATTRIBUTE_USE_STYLE:
+    case SCHEMES_STYLE_N_ATTRIBUTES:
+    default:
+      return 0;
+    }
+}
+
+static inline gboolean
+row_is_set (SchemesStyleTable     *self,
+            guint                  row,
+            SchemesStyleAttribute  attribute)
+{
+  return (self->set[row] & (1 << attribute)) != 0;
+}
+
+/* Marks @attribute of @row as set, returning %TRUE if it was not */
+static inline gboolean
+row_mark_set (SchemesStyleTable     *self,
+              guint                  row,
+              SchemesStyleAttribute  attribute)
+{
+  gboolean was_set = row_is_set (self, row, attribute);
+  self->set[row] |= (1 << attribute);
+  return !was_set;
+}
+
+/* The row is left in place so that the rows of other styles, which
+ * callers may hold on to, do not move.
+ */
+static void
+row_collect (SchemesStyleTable *self,
+             guint              row)
+{
+  g_assert (self->set[row] == 0);
+
+  g_hash_table_remove (self->rows, self->names[row]);
+  self->names[row] = NULL;
+  self->languages[row] = NULL;
+  for (guint i = 0; i < SCHEMES_STYLE_N_COLORS; i++)
+    g_clear_object (&self->refs[i][row]);
+
+  g_array_append_val (self->free_rows, row);
+}
+
+static void
+row_get_value (SchemesStyleTable     *self,
+               guint                  row,
+               SchemesStyleAttribute  attribute,
+               SchemesStyleValue     *value)
+{
+  value->is_set = row_is_set (self, row, attribute);
+  value->color = NULL;
+
+  switch (attribute)
+    {
+    case SCHEMES_STYLE_ATTRIBUTE_FOREGROUND:
+    case SCHEMES_STYLE_ATTRIBUTE_BACKGROUND:
+    case SCHEMES_STYLE_ATTRIBUTE_LINE_BACKGROUND:
+    case SCHEMES_STYLE_ATTRIBUTE_UNDERLINE_COLOR:
+      value->v.rgba = self->colors[attribute][row];
+      value->color = self->refs[attribute][row];
+      break;
+
+    case SCHEMES_STYLE_ATTRIBUTE_BOLD:
+    case SCHEMES_STYLE_ATTRIBUTE_ITALIC:
+    case SCHEMES_STYLE_ATTRIBUTE_STRIKETHROUGH:
+      value->v.boolean = !!(self->flags[row] & flag_for_attribute (attribute));
+      break;
+
+    case SCHEMES_STYLE_ATTRIBUTE_UNDERLINE:
+      value->v.underline = self->underlines[row];
+      break;
+
+    case SCHEMES_STYLE_ATTRIBUTE_WEIGHT:
+      value->v.weight = self->weights[row];
+      break;
+
+    case SCHEMES_STYLE_ATTRIBUTE_SCALE:
+      value->v.scale = self->scales[row];
+      break;
+
+    case SCHEMES_STYLE_ATTRIBUTE_USE_STYLE:
+      value->v.use_style = self->use_styles[row];
+      break;
+
+    case SCHEMES_STYLE_N_ATTRIBUTES:
+    default:
+      g_assert_not_reached ();
+    }
+}
+
+static void
+row_changed (SchemesStyleTable       *self,
+             guint                    row,
+             SchemesStyleAttribute    attribute,
+             gboolean                 set_changed,
+             const SchemesStyleValue *previous)
+{
+  GObject *view = g_hash_table_lookup (self->views, self->names[row]);
+
+  if (view != NULL)
+    {
+      g_object_freeze_notify (view);
+      g_object_notify (view, attribute_names[attribute]);
+      if (set_changed)
+        {
+          g_object_notify (view, attribute_set_names[attribute]);
+          g_object_notify (view, "is-empty");
+        }
+      g_object_thaw_notify (view);
+    }
+
+  if (self->changed_func != NULL)
+    self->changed_func (self, row, attribute, set_changed, previous, self->changed_data);
+
+  if (set_changed && self->set[row] == 0)
+    row_collect (self, row);
+}
+
+static void
+schemes_style_table_finalize (SchemesStyleTable *self)
+{
+  for (guint i = 0; i < SCHEMES_STYLE_N_COLORS; i++)
+    {
+      for (guint row = 0; row < self->n_rows; row++)
+        g_clear_object (&self->refs[i][row]);
+
+      g_clear_pointer (&self->colors[i], g_free);
+      g_clear_pointer (&self->refs[i], g_free);
+    }
+
+  g_clear_pointer (&self->rows, g_hash_table_unref);
+  g_clear_pointer (&self->views, g_hash_table_unref);
+  g_clear_pointer (&self->free_rows, g_array_unref);
+  g_clear_pointer (&self->names, g_free);
+  g_clear_pointer (&self->languages, g_free);
+  g_clear_pointer (&self->use_styles, g_free);
+  g_clear_pointer (&self->set, g_free);
+  g_clear_pointer (&self->flags, g_free);
+  g_clear_pointer (&self->underlines, g_free);
+  g_clear_pointer (&self->weights, g_free);
+  g_clear_pointer (&self->scales, g_free);
+}
+
+SchemesStyleTable *
+schemes_style_table_new (void)
+{
+  SchemesStyleTable *self;
+
+  self = g_rc_box_new0 (SchemesStyleTable);
+  self->rows = g_hash_table_new (g_str_hash, g_str_equal);
+  self->views = g_hash_table_new (g_str_hash, g_str_equal);
+  self->free_rows = g_array_new (FALSE, FALSE, sizeof (guint));
+
+  return self;
+}
+
+SchemesStyleTable *
+schemes_style_table_ref (SchemesStyleTable *self)
+{
+  g_return_val_if_fail (self != NULL, NULL);
+
+  return g_rc_box_acquire (self);
+}
+
+void
+schemes_style_table_unref (SchemesStyleTable *self)
+{
+  g_return_if_fail (self != NULL);
+
+  g_rc_box_release_full (self, (GDestroyNotify)schemes_style_table_finalize);
+}
+
+void
+schemes_style_table_set_changed_func (SchemesStyleTable     *self,
+                                      SchemesStyleTableFunc  func,
+                                      gpointer               user_data)
+{
+  g_return_if_fail (self != NULL);
+
+  self->changed_func = func;
+  self->changed_data = user_data;
+}
+
+/* Includes rows waiting to be reused, which have no name and are empty */
+guint
+schemes_style_table_get_n_rows (SchemesStyleTable *self)
+{
+  g_return_val_if_fail (self != NULL, 0);
+
+  return self->n_rows;
+}
+
+/* Returns the row for @name or %SCHEMES_STYLE_TABLE_INVALID_ROW */
+guint
+schemes_style_table_lookup (SchemesStyleTable *self,
+                            const char        *name)
+{
+  g_return_val_if_fail (self != NULL, SCHEMES_STYLE_TABLE_INVALID_ROW);
+  g_return_val_if_fail (name != NULL, SCHEMES_STYLE_TABLE_INVALID_ROW);
+
+  return GPOINTER_TO_UINT (g_hash_table_lookup (self->rows, name)) - 1;
+}
+
+static void
+schemes_style_table_grow (SchemesStyleTable *self)
+{
+  guint n = MAX (16, self->n_allocated * 2);
+
+  self->names = g_renew (const char *, self->names, n);
+  self->languages = g_renew (const char *, self->languages, n);
+  self->use_styles = g_renew (const char *, self->use_styles, n);
+  self->set = g_renew (guint16, self->set, n);
+  self->flags = g_renew (guint8, self->flags, n);
+  for (guint i = 0; i < SCHEMES_STYLE_N_COLORS; i++)
+    {
+      self->colors[i] = g_renew (SchemesRGBA, self->colors[i], n);
+      self->refs[i] = g_renew (SchemesColor *, self->refs[i], n);
+    }
+  self->underlines = g_renew (guint8, self->underlines, n);
+  self->weights = g_renew (guint16, self->weights, n);
+  self->scales = g_renew (double, self->scales, n);
+
+  self->n_allocated = n;
+}
+
+/* Returns the row for @name, adding an empty one if necessary */
+guint
+schemes_style_table_ensure (SchemesStyleTable *self,
+                            const char        *name)
+{
+  const char *colon;
+  guint row;
+
+  g_return_val_if_fail (self != NULL, SCHEMES_STYLE_TABLE_INVALID_ROW);
+  g_return_val_if_fail (name != NULL, SCHEMES_STYLE_TABLE_INVALID_ROW);
+
+  if ((row = GPOINTER_TO_UINT (g_hash_table_lookup (self->rows, name))))
+    return row - 1;
+
+  name = g_intern_string (name);
+
+  if (self->free_rows->len > 0)
+    {
+      row = g_array_index (self->free_rows, guint, self->free_rows->len - 1);
+      g_array_set_size (self->free_rows, self->free_rows->len - 1);
+    }
+  else
+    {
+      if (self->n_rows == self->n_allocated)
+        schemes_style_table_grow (self);
+
+      row = self->n_rows++;
+    }
+
+  self->names[row] = name;
+  self->languages[row] = NULL;
+  if ((colon = strchr (name, ':')))
+    {
+      g_autofree char *language = g_strndup (name, colon - name);
+      self->languages[row] = g_intern_string (language);
+    }
+  self->use_styles[row] = NULL;
+  self->set[row] = 0;
+  self->flags[row] = 0;
+  for (guint i = 0; i < SCHEMES_STYLE_N_COLORS; i++)
+    {
+      self->colors[i][row] = (SchemesRGBA) {0};
+      self->refs[i][row] = NULL;
+    }
+  self->underlines[row] = PANGO_UNDERLINE_NONE;
+  self->weights[row] = PANGO_WEIGHT_NORMAL;
+  self->scales[row] = 1.0;
+
+  g_hash_table_insert (self->rows, (gpointer)name, GUINT_TO_POINTER (row + 1));
+
+  return row;
+}
+
+/* Releases the rows which have nothing set, which the loader leaves
+ * behind for empty styles or unresolved color references.
+ */
+void
+schemes_style_table_collect (SchemesStyleTable *self)
+{
+  g_return_if_fail (self != NULL);
+
+  for (guint row = 0; row < self->n_rows; row++)
+    {
+      if (self->names[row] != NULL && self->set[row] == 0)
+        row_collect (self, row);
+    }
+}
+
+GObject *
+schemes_style_table_get_view (SchemesStyleTable *self,
+                              const char        *name)
+{
+  g_return_val_if_fail (self != NULL, NULL);
+  g_return_val_if_fail (name != NULL, NULL);
+
+  return g_hash_table_lookup (self->views, name);
+}
+
+/* @view is not referenced and must unset itself before it is finalized.
+ * It is notified of changes to the attributes of @name by property name.
+ */
+void
+schemes_style_table_set_view (SchemesStyleTable *self,
+                              const char        *name,
+                              GObject           *view)
+{
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (name != NULL);
+  g_return_if_fail (!view || G_IS_OBJECT (view));
+
+  if (view == NULL)
+    g_hash_table_remove (self->views, name);
+  else
+    g_hash_table_insert (self->views, (gpointer)g_intern_string (name), view);
+}
+
+const char *
+schemes_style_table_get_name (SchemesStyleTable *self,
+                              guint              row)
+{
+  g_return_val_if_fail (self != NULL, NULL);
+  g_return_val_if_fail (row < self->n_rows, NULL);
+
+  return self->names[row];
+}
+
+const char *
+schemes_style_table_get_language (SchemesStyleTable *self,
+                                  guint              row)
+{
+  g_return_val_if_fail (self != NULL, NULL);
+  g_return_val_if_fail (row < self->n_rows, NULL);
+
+  return self->languages[row];
+}
+
+gboolean
+schemes_style_table_is_empty (SchemesStyleTable *self,
+                              guint              row)
+{
+  g_return_val_if_fail (self != NULL, TRUE);
+  g_return_val_if_fail (row < self->n_rows, TRUE);
+
+  return self->set[row] == 0;
+}
+
+gboolean
+schemes_style_table_is_set (SchemesStyleTable     *self,
+                            guint                  row,
+                            SchemesStyleAttribute  attribute)
+{
+  g_return_val_if_fail (self != NULL, FALSE);
+  g_return_val_if_fail (row < self->n_rows, FALSE);
+  g_return_val_if_fail (attribute < SCHEMES_STYLE_N_ATTRIBUTES, FALSE);
+
+  return row_is_set (self, row, attribute);
+}
+
+/* Unsetting a color attribute also stops following its named color */
+void
+schemes_style_table_set_is_set (SchemesStyleTable     *self,
+                                guint                  row,
+                                SchemesStyleAttribute  attribute,
+                                gboolean               is_set)
+{
+  g_autoptr(SchemesColor) old_ref = NULL;
+  SchemesStyleValue previous;
+
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (row < self->n_rows);
+  g_return_if_fail (attribute < SCHEMES_STYLE_N_ATTRIBUTES);
+
+  if (!!is_set == row_is_set (self, row, attribute))
+    return;
+
+  row_get_value (self, row, attribute, &previous);
+
+  if (is_set)
+    self->set[row] |= (1 << attribute);
+  else
+    self->set[row] &= ~(1 << attribute);
+
+  /* Kept alive until the changed func has seen previous */
+  if (!is_set && attribute < (SchemesStyleAttribute)SCHEMES_STYLE_N_COLORS)
+    old_ref = g_steal_pointer (&self->refs[attribute][row]);
+
+  row_changed (self, row, attribute, TRUE, &previous);
+}
+
+void
+schemes_style_table_get_value (SchemesStyleTable     *self,
+                               guint                  row,
+                               SchemesStyleAttribute  attribute,
+                               SchemesStyleValue     *value)
+{
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (row < self->n_rows);
+  g_return_if_fail (attribute < SCHEMES_STYLE_N_ATTRIBUTES);
+  g_return_if_fail (value != NULL);
+
+  row_get_value (self, row, attribute, value);
+}
+
+/* Restores a value from schemes_style_table_get_value(). A color that
+ * followed a named color follows it again, taking its current value.
+ */
+void
+schemes_style_table_set_value (SchemesStyleTable       *self,
+                               guint                    row,
+                               SchemesStyleAttribute    attribute,
+                               const SchemesStyleValue *value)
+{
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (row < self->n_rows);
+  g_return_if_fail (attribute < SCHEMES_STYLE_N_ATTRIBUTES);
+  g_return_if_fail (value != NULL);
+
+  if (!value->is_set)
+    {
+      schemes_style_table_set_is_set (self, row, attribute, FALSE);
+      return;
+    }
+
+  switch (attribute)
+    {
+    case SCHEMES_STYLE_ATTRIBUTE_FOREGROUND:
+    case SCHEMES_STYLE_ATTRIBUTE_BACKGROUND:
+    case SCHEMES_STYLE_ATTRIBUTE_LINE_BACKGROUND:
+    case SCHEMES_STYLE_ATTRIBUTE_UNDERLINE_COLOR:
+      if (value->color != NULL)
+        {
+          schemes_style_table_set_color_ref (self, row, (SchemesStyleColor)attribute, value->color);
+        }
+      else
+        {
+          schemes_style_table_set_color_ref (self, row, (SchemesStyleColor)attribute, NULL);
+          schemes_style_table_set_color (self, row, (SchemesStyleColor)attribute, &value->v.rgba);
+        }
+      break;
+
+    case SCHEMES_STYLE_ATTRIBUTE_BOLD:
+    case SCHEMES_STYLE_ATTRIBUTE_ITALIC:
+    case SCHEMES_STYLE_ATTRIBUTE_STRIKETHROUGH:
+      schemes_style_table_set_boolean (self, row, attribute, value->v.boolean);
+      break;
+
+    case SCHEMES_STYLE_ATTRIBUTE_UNDERLINE:
+      schemes_style_table_set_underline (self, row, value->v.underline);
+      break;
+
+    case SCHEMES_STYLE_ATTRIBUTE_WEIGHT:
+      schemes_style_table_set_weight (self, row, value->v.weight);
+      break;
+
+    case SCHEMES_STYLE_ATTRIBUTE_SCALE:
+      schemes_style_table_set_scale (self, row, value->v.scale);
+      break;
+
+    case SCHEMES_STYLE_ATTRIBUTE_USE_STYLE:
+      schemes_style_table_set_use_style (self, row, value->v.use_style);
+      break;
+
+    case SCHEMES_STYLE_N_ATTRIBUTES:
+    default:
+      g_assert_not_reached ();
+    }
+}
+
+/* Returns the value of the color attribute @which, or %NULL if unset */
+const SchemesRGBA *
+schemes_style_table_get_color (SchemesStyleTable *self,
+                               guint              row,
+                               SchemesStyleColor  which)
+{
+  g_return_val_if_fail (self != NULL, NULL);
+  g_return_val_if_fail (row < self->n_rows, NULL);
+  g_return_val_if_fail (which < SCHEMES_STYLE_N_COLORS, NULL);
+
+  if (!row_is_set (self, row, (SchemesStyleAttribute)which))
+    return NULL;
+
+  return &self->colors[which][row];
+}
+
+/* Sets @which to a literal value. This stops following the named
+ * color, unless it is the same value such as when bindings copy it
+ * back.
+ */
+void
+schemes_style_table_set_color (SchemesStyleTable *self,
+                               guint              row,
+                               SchemesStyleColor  which,
+                               const SchemesRGBA *rgba)
+{
+  g_autoptr(SchemesColor) old_ref = NULL;
+  SchemesStyleValue previous;
+  SchemesRGBA *slot;
+  SchemesColor **ref;
+  gboolean changed = FALSE;
+  gboolean set_changed;
+
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (row < self->n_rows);
+  g_return_if_fail (which < SCHEMES_STYLE_N_COLORS);
+  g_return_if_fail (rgba != NULL);
+
+  row_get_value (self, row, (SchemesStyleAttribute)which, &previous);
+
+  slot = &self->colors[which][row];
+  ref = &self->refs[which][row];
+
+  if (*ref != NULL && !schemes_rgba_equal (rgba, schemes_color_get_color (*ref)))
+    {
+      old_ref = g_steal_pointer (ref);
+      changed = TRUE;
+    }
+
+  if (!schemes_rgba_equal (slot, rgba))
+    {
+      *slot = *rgba;
+      changed = TRUE;
+    }
+
+  set_changed = row_mark_set (self, row, (SchemesStyleAttribute)which);
+
+  if (changed || set_changed)
+    row_changed (self, row, (SchemesStyleAttribute)which, set_changed, &previous);
+}
+
+/* Returns the named color @which follows, or %NULL for a literal */
+SchemesColor *
+schemes_style_table_get_color_ref (SchemesStyleTable *self,
+                                   guint              row,
+                                   SchemesStyleColor  which)
+{
+  g_return_val_if_fail (self != NULL, NULL);
+  g_return_val_if_fail (row < self->n_rows, NULL);
+  g_return_val_if_fail (which < SCHEMES_STYLE_N_COLORS, NULL);
+
+  return self->refs[which][row];
+}
+
+/* Makes @which follow @color, taking its current value. Setting it to
+ * %NULL keeps the current value as a literal.
+ */
+void
+schemes_style_table_set_color_ref (SchemesStyleTable *self,
+                                   guint              row,
+                                   SchemesStyleColor  which,
+                                   SchemesColor      *color)
+{
+  g_autoptr(SchemesColor) old_ref = NULL;
+  SchemesStyleValue previous;
+  const SchemesRGBA *rgba;
+  SchemesRGBA *slot;
+  gboolean changed;
+  gboolean set_changed;
+
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (row < self->n_rows);
+  g_return_if_fail (which < SCHEMES_STYLE_N_COLORS);
+  g_return_if_fail (!color || SCHEMES_IS_COLOR (color));
+
+  row_get_value (self, row, (SchemesStyleAttribute)which, &previous);
+
+  if (color == NULL)
+    {
+      if (self->refs[which][row] == NULL)
+        return;
+
+      old_ref = g_steal_pointer (&self->refs[which][row]);
+      row_changed (self, row, (SchemesStyleAttribute)which, FALSE, &previous);
+      return;
+    }
+
+  slot = &self->colors[which][row];
+  rgba = schemes_color_get_color (color);
+  changed = !schemes_rgba_equal (slot, rgba);
+  old_ref = g_steal_pointer (&self->refs[which][row]);
+  changed |= old_ref != color;
+  self->refs[which][row] = g_object_ref (color);
+  *slot = *rgba;
+  set_changed = row_mark_set (self, row, (SchemesStyleAttribute)which);
+
+  if (changed || set_changed)
+    row_changed (self, row, (SchemesStyleAttribute)which, set_changed, &previous);
+}
+
+gboolean
+schemes_style_table_get_boolean (SchemesStyleTable     *self,
+                                 guint                  row,
+                                 SchemesStyleAttribute  attribute)
+{
+  g_return_val_if_fail (self != NULL, FALSE);
+  g_return_val_if_fail (row < self->n_rows, FALSE);
+  g_return_val_if_fail (flag_for_attribute (attribute) != 0, FALSE);
+
+  return (self->flags[row] & flag_for_attribute (attribute)) != 0;
+}
+
+void
+schemes_style_table_set_boolean (SchemesStyleTable     *self,
+                                 guint                  row,
+                                 SchemesStyleAttribute  attribute,
+                                 gboolean               value)
+{
+  SchemesStyleValue previous;
+  guint8 flag;
+  gboolean changed;
+  gboolean set_changed;
+
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (row < self->n_rows);
+  g_return_if_fail (flag_for_attribute (attribute) != 0);
+
+  row_get_value (self, row, attribute, &previous);
+
+  flag = flag_for_attribute (attribute);
+  changed = !!value != !!(self->flags[row] & flag);
+
+  if (value)
+    self->flags[row] |= flag;
+  else
+    self->flags[row] &= ~flag;
+
+  set_changed = row_mark_set (self, row, attribute);
+
+  if (changed || set_changed)
+    row_changed (self, row, attribute, set_changed, &previous);
+}
+
+PangoUnderline
+schemes_style_table_get_underline (SchemesStyleTable *self,
+                                   guint              row)
+{
+  g_return_val_if_fail (self != NULL, PANGO_UNDERLINE_NONE);
+  g_return_val_if_fail (row < self->n_rows, PANGO_UNDERLINE_NONE);
+
+  return self->underlines[row];
+}
+
+void
+schemes_style_table_set_underline (SchemesStyleTable *self,
+                                   guint              row,
+                                   PangoUnderline     underline)
+{
+  SchemesStyleValue previous;
+  gboolean changed;
+  gboolean set_changed;
+
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (row < self->n_rows);
+
+  row_get_value (self, row, SCHEMES_STYLE_ATTRIBUTE_UNDERLINE, &previous);
+
+  changed = self->underlines[row] != underline;
+  self->underlines[row] = underline;
+  set_changed = row_mark_set (self, row, SCHEMES_STYLE_ATTRIBUTE_UNDERLINE);
+
+  if (changed || set_changed)
+    row_changed (self, row, SCHEMES_STYLE_ATTRIBUTE_UNDERLINE, set_changed, &previous);
+}
+
+PangoWeight
+schemes_style_table_get_weight (SchemesStyleTable *self,
+                                guint              row)
+{
+  g_return_val_if_fail (self != NULL, PANGO_WEIGHT_NORMAL);
+  g_return_val_if_fail (row < self->n_rows, PANGO_WEIGHT_NORMAL);
+
+  return self->weights[row];
+}
+
+void
+schemes_style_table_set_weight (SchemesStyleTable *self,
+                                guint              row,
+                                PangoWeight        weight)
+{
+  SchemesStyleValue previous;
+  gboolean changed;
+  gboolean set_changed;
+
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (row < self->n_rows);
+
+  row_get_value (self, row, SCHEMES_STYLE_ATTRIBUTE_WEIGHT, &previous);
+
+  changed = self->weights[row] != weight;
+  self->weights[row] = weight;
+  set_changed = row_mark_set (self, row, SCHEMES_STYLE_ATTRIBUTE_WEIGHT);
+
+  if (changed || set_changed)
+    row_changed (self, row, SCHEMES_STYLE_ATTRIBUTE_WEIGHT, set_changed, &previous);
+}
+
+double
+schemes_style_table_get_scale (SchemesStyleTable *self,
+                               guint              row)
+{
+  g_return_val_if_fail (self != NULL, 1.0);
+  g_return_val_if_fail (row < self->n_rows, 1.0);
+
+  return self->scales[row];
+}
+
+void
+schemes_style_table_set_scale (SchemesStyleTable *self,
+                               guint              row,
+                               double             scale)
+{
+  SchemesStyleValue previous;
+  gboolean changed;
+  gboolean set_changed;
+
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (row < self->n_rows);
+
+  row_get_value (self, row, SCHEMES_STYLE_ATTRIBUTE_SCALE, &previous);
+
+  changed = self->scales[row] != scale;
+  self->scales[row] = scale;
+  set_changed = row_mark_set (self, row, SCHEMES_STYLE_ATTRIBUTE_SCALE);
+
+  if (changed || set_changed)
+    row_changed (self, row, SCHEMES_STYLE_ATTRIBUTE_SCALE, set_changed, &previous);
+}
+
+/* Returns the style @row uses, or %NULL if unset */
+const char *
+schemes_style_table_get_use_style (SchemesStyleTable *self,
+                                   guint              row)
+{
+  g_return_val_if_fail (self != NULL, NULL);
+  g_return_val_if_fail (row < self->n_rows, NULL);
+
+  if (!row_is_set (self, row, SCHEMES_STYLE_ATTRIBUTE_USE_STYLE))
+    return NULL;
+
+  return self->use_styles[row];
+}
+
+/* Setting %NULL unsets use-style */
+void
+schemes_style_table_set_use_style (SchemesStyleTable *self,
+                                   guint              row,
+                                   const char        *use_style)
+{
+  SchemesStyleValue previous;
+  gboolean changed;
+  gboolean set_changed;
+
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (row < self->n_rows);
+
+  if (use_style == NULL)
+    {
+      schemes_style_table_set_is_set (self, row, SCHEMES_STYLE_ATTRIBUTE_USE_STYLE, FALSE);
+      return;
+    }
+
+  row_get_value (self, row, SCHEMES_STYLE_ATTRIBUTE_USE_STYLE, &previous);
+
+  use_style = g_intern_string (use_style);
+  changed = self->use_styles[row] != use_style;
+  self->use_styles[row] = use_style;
+  set_changed = row_mark_set (self, row, SCHEMES_STYLE_ATTRIBUTE_USE_STYLE);
+
+  if (changed || set_changed)
+    row_changed (self, row, SCHEMES_STYLE_ATTRIBUTE_USE_STYLE, set_changed, &previous);
+}
+
+/* Fills @data from @row. Strings are interned so @data stays valid
+ * after the table changes or is freed.
+ */
+void
+schemes_style_table_peek_data (SchemesStyleTable *self,
+                               guint              row,
+                               SchemesStyleData  *data)
+{
+  guint16 set;
+  guint8 flags;
+
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (row < self->n_rows);
+  g_return_if_fail (data != NULL);
+
+  set = self->set[row];
+  flags = self->flags[row];
+
+  data->name = self->names[row];
+  data->language = self->languages[row];
+  data->use_style = self->use_styles[row];
+  data->foreground = self->colors[SCHEMES_STYLE_COLOR_FOREGROUND][row];
+  data->background = self->colors[SCHEMES_STYLE_COLOR_BACKGROUND][row];
+  data->line_background = self->colors[SCHEMES_STYLE_COLOR_LINE_BACKGROUND][row];
+  data->underline_color = self->colors[SCHEMES_STYLE_COLOR_UNDERLINE][row];
+  data->underline = self->underlines[row];
+  data->weight = self->weights[row];
+  data->scale = self->scales[row];
+  for (guint i = 0; i < SCHEMES_STYLE_N_COLORS; i++)
+    data->color_names[i] = self->refs[i][row] ? g_intern_string (schemes_color_get_name (self->refs[i][row])) : NULL;
+  data->bold = !!(flags & FLAG_BOLD);
+  data->italic = !!(flags & FLAG_ITALIC);
+  data->strikethrough = !!(flags & FLAG_STRIKETHROUGH);
+
+#define DATA_SET(field, attribute) \
+  data->field##_set = !!(set & (1 << SCHEMES_STYLE_ATTRIBUTE_##attribute))
+  DATA_SET (foreground, FOREGROUND);
+  DATA_SET (background, BACKGROUND);
+  DATA_SET (line_background, LINE_BACKGROUND);
+  DATA_SET (underline_color, UNDERLINE_COLOR);
+  DATA_SET (bold, BOLD);
+  DATA_SET (italic, ITALIC);
+  DATA_SET (strikethrough, STRIKETHROUGH);
+  DATA_SET (underline, UNDERLINE);
+  DATA_SET (weight, WEIGHT);
+  DATA_SET (scale, SCALE);
+  DATA_SET (use_style, USE_STYLE);
+#undef DATA_SET
+}
+
+static void
+write_color_attribute (SchemesXmlWriter  *writer,
+                       const char        *key,
+                       const SchemesRGBA *color,
+                       const char        *name)
+{
+  char alpha[G_ASCII_DTOSTR_BUF_SIZE];
+  char hash_color_str[64];
+
+  g_assert (writer != NULL);
+  g_assert (key != NULL);
+  g_assert (color != NULL);
+
+  if (name != NULL)
+    {
+      schemes_xml_writer_add_attribute (writer, key, name);
+      return;
+    }
+
+  if (color->alpha >= 1.0)
+    {
+      schemes_xml_writer_add_hex_attribute (writer, key, color);
+      return;
+    }
+
+  /* Same as "#" followed by schemes_rgba_to_string() */
+  g_ascii_formatd (alpha, sizeof alpha, "%g", CLAMP (color->alpha, 0, 1));
+  g_snprintf (hash_color_str, sizeof hash_color_str,
+              color->alpha > 0.999 ? "#rgb(%d,%d,%d)" : "#rgba(%d,%d,%d,%s)",
+              (int)(0.5 + CLAMP (color->red, 0., 1.) * 255.),
+              (int)(0.5 + CLAMP (color->green, 0., 1.) * 255.),
+              (int)(0.5 + CLAMP (color->blue, 0., 1.) * 255.),
+              alpha);
+
+  schemes_xml_writer_add_attribute (writer, key, hash_color_str);
+}
+
+static void
+write_weight_attribute (SchemesXmlWriter *writer,
+                        const char       *key,
+                        PangoWeight       weight)
+{
+  char numeric[16];
+  const char *str = NULL;
+
+  switch (weight)
+    {
+    case PANGO_WEIGHT_THIN:
+      str = "thin";
+      break;
+
+    case PANGO_WEIGHT_BOLD:
+      str = "bold";
+      break;
+
+    case PANGO_WEIGHT_ULTRABOLD:
+      str = "ultrabold";
+      break;
+
+    case PANGO_WEIGHT_ULTRAHEAVY:
+      str = "ultraheavy";
+      break;
+
+    case PANGO_WEIGHT_ULTRALIGHT:
+      str = "ultralight";
+      break;
+
+    case PANGO_WEIGHT_LIGHT:
+      str = "light";
+      break;
+
+    case PANGO_WEIGHT_HEAVY:
+      str = "heavy";
+      break;
+
+    case PANGO_WEIGHT_NORMAL:
+      str = "normal";
+      break;
+
+    case PANGO_WEIGHT_SEMIBOLD:
+      str = "semibold";
+      break;
+
+    case PANGO_WEIGHT_SEMILIGHT:
+      str = "semilight";
+      break;
+
+    case PANGO_WEIGHT_BOOK:
+      str = "book";
+      break;
+
+    case PANGO_WEIGHT_MEDIUM:
+      str = "medium";
+      break;
+
+    default:
+      g_snprintf (numeric, sizeof numeric, "%d", weight);
+      str = numeric;
+      break;
+    }
+
+  schemes_xml_writer_add_attribute (writer, key, str);
+}
+
+static inline void
+write_enum_attribute (SchemesXmlWriter *writer,
+                      GType             type,
+                      const char       *name,
+                      int               value)
+{
+  GEnumClass *klass = g_type_class_ref (type);
+  const GEnumValue *eval = g_enum_get_value (klass, value);
+
+  if (eval != NULL)
+    schemes_xml_writer_add_attribute (writer, name, eval->value_nick);
+
+  g_type_class_unref (klass);
+}
+
+static inline void
+write_boolean_attribute (SchemesXmlWriter *writer,
+                         const char       *name,
+                         gboolean          value)
+{
+  const char *valstr = value ? "true" : "false";
+  schemes_xml_writer_add_attribute (writer, name, valstr);
+}
+
+static inline void
+write_double_attribute (SchemesXmlWriter *writer,
+                        const char       *name,
+                        double            value)
+{
+  char str[G_ASCII_DTOSTR_BUF_SIZE];
+  g_ascii_dtostr (str, sizeof str, value);
+  schemes_xml_writer_add_attribute (writer, name, str);
+}
+
+gboolean
+schemes_style_data_is_empty (const SchemesStyleData *data)
+{
+  g_return_val_if_fail (data != NULL, TRUE);
+
+  return !(data->background_set ||
+           data->foreground_set ||
+           data->italic_set ||
+           data->bold_set ||
+           data->scale_set ||
+           data->line_background_set ||
+           data->use_style_set ||
+           data->strikethrough_set ||
+           data->underline_set ||
+           data->underline_color_set ||
+           data->weight_set);
+}
+
+/* Only attributes which are set take part in hashing and comparison,
+ * matching what would be serialized.
+ */
+guint
+schemes_style_data_hash (const SchemesStyleData *data)
+{
+  guint hash;
+
+  g_return_val_if_fail (data != NULL, 0);
+
+  hash = data->name ? g_str_hash (data->name) : 0;
+
+#define HASH_FIELD(field, value) \
+  hash = (hash << 5) - hash + (data->field##_set ? (guint)(value) + 1 : 0)
+  HASH_FIELD (foreground, schemes_rgba_hash (&data->foreground));
+  HASH_FIELD (background, schemes_rgba_hash (&data->background));
+  HASH_FIELD (line_background, schemes_rgba_hash (&data->line_background));
+  HASH_FIELD (underline_color, schemes_rgba_hash (&data->underline_color));
+  HASH_FIELD (underline, data->underline);
+  HASH_FIELD (weight, data->weight);
+  HASH_FIELD (scale, data->scale * 1000.);
+  HASH_FIELD (bold, data->bold);
+  HASH_FIELD (italic, data->italic);
+  HASH_FIELD (strikethrough, data->strikethrough);
+  HASH_FIELD (use_style, data->use_style ? g_str_hash (data->use_style) : 0);
+#undef HASH_FIELD
+
+  for (guint i = 0; i < SCHEMES_STYLE_N_COLORS; i++)
+    hash = (hash << 5) - hash + (data->color_names[i] ? g_str_hash (data->color_names[i]) : 0);
+
+  return hash;
+}
+
+static inline gboolean
+rgba_equal_if_set (gboolean           a_set,
+                   const SchemesRGBA *a,
+                   gboolean           b_set,
+                   const SchemesRGBA *b)
+{
+  return a_set == b_set && (!a_set || schemes_rgba_equal (a, b));
+}
+
+gboolean
+schemes_style_data_equal (const SchemesStyleData *a,
+                          const SchemesStyleData *b)
+{
+  g_return_val_if_fail (a != NULL, FALSE);
+  g_return_val_if_fail (b != NULL, FALSE);
+
+  if (a == b)
+    return TRUE;
+
+  for (guint i = 0; i < SCHEMES_STYLE_N_COLORS; i++)
+    {
+      if (g_strcmp0 (a->color_names[i], b->color_names[i]) != 0)
+        return FALSE;
+    }
+
+#define FIELD_EQUAL(field) \
+  (a->field##_set == b->field##_set && (!a->field##_set || a->field == b->field))
+  return g_strcmp0 (a->name, b->name) == 0 &&
+         rgba_equal_if_set (a->foreground_set, &a->foreground, b->foreground_set, &b->foreground) &&
+         rgba_equal_if_set (a->background_set, &a->background, b->background_set, &b->background) &&
+         rgba_equal_if_set (a->line_background_set, &a->line_background, b->line_background_set, &b->line_background) &&
+         rgba_equal_if_set (a->underline_color_set, &a->underline_color, b->underline_color_set, &b->underline_color) &&
+         FIELD_EQUAL (underline) &&
+         FIELD_EQUAL (weight) &&
+         FIELD_EQUAL (scale) &&
+         FIELD_EQUAL (bold) &&
+         FIELD_EQUAL (italic) &&
+         FIELD_EQUAL (strikethrough) &&
+         a->use_style_set == b->use_style_set &&
+         (!a->use_style_set || g_strcmp0 (a->use_style, b->use_style) == 0);
+#undef FIELD_EQUAL
+}
+
+void
+schemes_style_data_serialize (const SchemesStyleData *data,
+                              SchemesXmlWriter       *writer,
+                              guint                   longest_style_name)
+{
+  guint name_len;
+
+  g_return_if_fail (data != NULL);
+  g_return_if_fail (writer != NULL);
+
+  if (schemes_style_data_is_empty (data))
+    return;
+
+  schemes_xml_writer_begin_open_element (writer, "style");
+  schemes_xml_writer_add_attribute (writer, "name", data->name);
+
+  /* Align first attribute (which is often all we have) */
+  name_len = strlen (data->name);
+  if (name_len < longest_style_name)
+    schemes_xml_writer_write_padding (writer, longest_style_name - name_len);
+
+  schemes_style_data_serialize_attributes (data, writer);
+}
+
+/* Writes what follows the name and its padding, which does not depend
+ * on the other styles of the scheme.
+ */
+void
+schemes_style_data_serialize_attributes (const SchemesStyleData *data,
+                                         SchemesXmlWriter       *writer)
+{
+  g_return_if_fail (data != NULL);
+  g_return_if_fail (writer != NULL);
+
+  if (data->background_set)
+    write_color_attribute (writer, "background", &data->background,
+                           data->color_names[SCHEMES_STYLE_COLOR_BACKGROUND]);
+
+  if (data->foreground_set)
+    write_color_attribute (writer, "foreground", &data->foreground,
+                           data->color_names[SCHEMES_STYLE_COLOR_FOREGROUND]);
+
+  if (data->line_background_set)
+    write_color_attribute (writer, "line-background", &data->line_background,
+                           data->color_names[SCHEMES_STYLE_COLOR_LINE_BACKGROUND]);
+
+  if (data->bold_set)
+    write_boolean_attribute (writer, "bold", data->bold);
+
+  if (data->weight_set)
+    write_weight_attribute (writer, "weight", data->weight);
+
+  if (data->italic_set)
+    write_boolean_attribute (writer, "italic", data->italic);
+
+  if (data->underline_set)
+    write_enum_attribute (writer, PANGO_TYPE_UNDERLINE, "underline", data->underline);
+
+  if (data->underline_color_set)
+    write_color_attribute (writer, "underline-color", &data->underline_color,
+                           data->color_names[SCHEMES_STYLE_COLOR_UNDERLINE]);
+
+  if (data->scale_set)
+    write_double_attribute (writer, "scale", data->scale);
+
+  if (data->strikethrough_set)
+    write_boolean_attribute (writer, "strikethrough", data->strikethrough);
+
+  if (data->use_style_set)
+    schemes_xml_writer_add_attribute (writer, "use-style", data->use_style);
+
+  schemes_xml_writer_end_open_element (writer, FALSE);
+}
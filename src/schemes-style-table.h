@@ -0,0 +1,226 @@
+/* schemes-style-table.h
+ *
+ * Copyright 2022 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+
+#pragma once
+
+#include <pango/pango.h>
+
+#include "schemes-color.h"
+#include "schemes-rgba.h"
+#include "schemes-xml.h"
+
+G_BEGIN_DECLS
+
+#define SCHEMES_STYLE_TABLE_INVALID_ROW G_MAXUINT
+
+typedef struct _SchemesStyleTable SchemesStyleTable;
+
+typedef enum _SchemesStyleColor
+{
+  SCHEMES_STYLE_COLOR_FOREGROUND,
+  SCHEMES_STYLE_COLOR_BACKGROUND,
+  SCHEMES_STYLE_COLOR_LINE_BACKGROUND,
+  SCHEMES_STYLE_COLOR_UNDERLINE,
+  SCHEMES_STYLE_N_COLORS
+} SchemesStyleColor;
+
+/* The color attributes come first so that a SchemesStyleColor may be
+ * used wherever an attribute is expected.
+ */
+typedef enum _SchemesStyleAttribute
+{
+  SCHEMES_STYLE_ATTRIBUTE_FOREGROUND = SCHEMES_STYLE_COLOR_FOREGROUND,
+  SCHEMES_STYLE_ATTRIBUTE_BACKGROUND = SCHEMES_STYLE_COLOR_BACKGROUND,
+  SCHEMES_STYLE_ATTRIBUTE_LINE_BACKGROUND = SCHEMES_STYLE_COLOR_LINE_BACKGROUND,
+  SCHEMES_STYLE_ATTRIBUTE_UNDERLINE_COLOR = SCHEMES_STYLE_COLOR_UNDERLINE,
+  SCHEMES_STYLE_ATTRIBUTE_BOLD,
+  SCHEMES_STYLE_ATTRIBUTE_ITALIC,
+  SCHEMES_STYLE_ATTRIBUTE_STRIKETHROUGH,
+  SCHEMES_STYLE_ATTRIBUTE_UNDERLINE,
+  SCHEMES_STYLE_ATTRIBUTE_WEIGHT,
+  SCHEMES_STYLE_ATTRIBUTE_SCALE,
+  SCHEMES_STYLE_ATTRIBUTE_USE_STYLE,
+  SCHEMES_STYLE_N_ATTRIBUTES
+} SchemesStyleAttribute;
+
+/* Plain copy of the attributes of a style, which unlike SchemesStyle
+ * may be shared with other threads. Strings are interned.
+ */
+typedef struct _SchemesStyleData
+{
+  const char     *name;
+  const char     *language;
+  const char     *use_style;
+  SchemesRGBA     foreground;
+  SchemesRGBA     background;
+  SchemesRGBA     line_background;
+  SchemesRGBA     underline_color;
+  PangoUnderline  underline;
+  PangoWeight     weight;
+  double          scale;
+
+  /* Names of the colors followed by the attributes, or %NULL */
+  const char     *color_names[SCHEMES_STYLE_N_COLORS];
+
+  guint bold : 1;
+  guint italic : 1;
+  guint strikethrough : 1;
+
+  guint strikethrough_set : 1;
+  guint background_set : 1;
+  guint bold_set : 1;
+  guint foreground_set : 1;
+  guint italic_set : 1;
+  guint line_background_set : 1;
+  guint scale_set : 1;
+  guint underline_color_set : 1;
+  guint underline_set : 1;
+  guint weight_set : 1;
+  guint use_style_set : 1;
+} SchemesStyleData;
+
+/* The value of a single attribute. Which member of @v is used depends
+ * on the attribute. @color is the named color a color attribute
+ * follows, which is not owned.
+ */
+typedef struct _SchemesStyleValue
+{
+  union {
+    SchemesRGBA     rgba;
+    gboolean        boolean;
+    PangoUnderline  underline;
+    PangoWeight     weight;
+    double          scale;
+    const char     *use_style;
+  } v;
+  SchemesColor *color;
+  guint is_set : 1;
+} SchemesStyleValue;
+
+/* Called after an attribute of @row changed. @set_changed is %TRUE if
+ * whether the attribute is set changed as well. @previous is the value
+ * from before the change.
+ */
+typedef void (*SchemesStyleTableFunc) (SchemesStyleTable       *table,
+                                       guint                    row,
+                                       SchemesStyleAttribute    attribute,
+                                       gboolean                 set_changed,
+                                       const SchemesStyleValue *previous,
+                                       gpointer                 user_data);
+
+SchemesStyleTable  *schemes_style_table_new                (void);
+SchemesStyleTable  *schemes_style_table_ref                (SchemesStyleTable     *self);
+void                schemes_style_table_unref              (SchemesStyleTable     *self);
+void                schemes_style_table_set_changed_func   (SchemesStyleTable     *self,
+                                                            SchemesStyleTableFunc  func,
+                                                            gpointer               user_data);
+guint               schemes_style_table_get_n_rows         (SchemesStyleTable     *self);
+guint               schemes_style_table_lookup             (SchemesStyleTable     *self,
+                                                            const char            *name);
+guint               schemes_style_table_ensure             (SchemesStyleTable     *self,
+                                                            const char            *name);
+void                schemes_style_table_collect            (SchemesStyleTable     *self);
+GObject            *schemes_style_table_get_view           (SchemesStyleTable     *self,
+                                                            const char            *name);
+void                schemes_style_table_set_view           (SchemesStyleTable     *self,
+                                                            const char            *name,
+                                                            GObject               *view);
+const char         *schemes_style_table_get_name           (SchemesStyleTable     *self,
+                                                            guint                  row);
+const char         *schemes_style_table_get_language       (SchemesStyleTable     *self,
+                                                            guint                  row);
+gboolean            schemes_style_table_is_empty           (SchemesStyleTable     *self,
+                                                            guint                  row);
+gboolean            schemes_style_table_is_set             (SchemesStyleTable     *self,
+                                                            guint                  row,
+                                                            SchemesStyleAttribute  attribute);
+void                schemes_style_table_set_is_set         (SchemesStyleTable     *self,
+                                                            guint                  row,
+                                                            SchemesStyleAttribute  attribute,
+                                                            gboolean               is_set);
+void                schemes_style_table_get_value          (SchemesStyleTable     *self,
+                                                            guint                  row,
+                                                            SchemesStyleAttribute  attribute,
+                                                            SchemesStyleValue     *value);
+void                schemes_style_table_set_value          (SchemesStyleTable     *self,
+                                                            guint                  row,
+                                                            SchemesStyleAttribute  attribute,
+                                                            const SchemesStyleValue *value);
+const SchemesRGBA  *schemes_style_table_get_color          (SchemesStyleTable     *self,
+                                                            guint                  row,
+                                                            SchemesStyleColor      which);
+void                schemes_style_table_set_color          (SchemesStyleTable     *self,
+                                                            guint                  row,
+                                                            SchemesStyleColor      which,
+                                                            const SchemesRGBA     *rgba);
+SchemesColor       *schemes_style_table_get_color_ref      (SchemesStyleTable     *self,
+                                                            guint                  row,
+                                                            SchemesStyleColor      which);
+void                schemes_style_table_set_color_ref      (SchemesStyleTable     *self,
+                                                            guint                  row,
+                                                            SchemesStyleColor      which,
+                                                            SchemesColor          *color);
+gboolean            schemes_style_table_get_boolean        (SchemesStyleTable     *self,
+                                                            guint                  row,
+                                                            SchemesStyleAttribute  attribute);
+void                schemes_style_table_set_boolean        (SchemesStyleTable     *self,
+                                                            guint                  row,
+                                                            SchemesStyleAttribute  attribute,
+                                                            gboolean               value);
+PangoUnderline      schemes_style_table_get_underline      (SchemesStyleTable     *self,
+                                                            guint                  row);
+void                schemes_style_table_set_underline      (SchemesStyleTable     *self,
+                                                            guint                  row,
+                                                            PangoUnderline         underline);
+PangoWeight         schemes_style_table_get_weight         (SchemesStyleTable     *self,
+                                                            guint                  row);
+void                schemes_style_table_set_weight         (SchemesStyleTable     *self,
+                                                            guint                  row,
+                                                            PangoWeight            weight);
+double              schemes_style_table_get_scale          (SchemesStyleTable     *self,
+                                                            guint                  row);
+void                schemes_style_table_set_scale          (SchemesStyleTable     *self,
+                                                            guint                  row,
+                                                            double                 scale);
+const char         *schemes_style_table_get_use_style      (SchemesStyleTable     *self,
+                                                            guint                  row);
+void                schemes_style_table_set_use_style      (SchemesStyleTable     *self,
+                                                            guint                  row,
+                                                            const char            *use_style);
+void                schemes_style_table_peek_data          (SchemesStyleTable     *self,
+                                                            guint                  row,
+                                                            SchemesStyleData      *data);
+const char         *schemes_style_attribute_get_name       (SchemesStyleAttribute  attribute);
+const char         *schemes_style_attribute_get_set_name   (SchemesStyleAttribute  attribute);
+
+gboolean      schemes_style_data_is_empty             (const SchemesStyleData *data);
+guint         schemes_style_data_hash                 (const SchemesStyleData *data);
+gboolean      schemes_style_data_equal                (const SchemesStyleData *a,
+                                                       const SchemesStyleData *b);
+void          schemes_style_data_serialize            (const SchemesStyleData *data,
+                                                       SchemesXmlWriter       *writer,
+                                                       guint                   longest_style_name);
+void          schemes_style_data_serialize_attributes (const SchemesStyleData *data,
+                                                       SchemesXmlWriter       *writer);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (SchemesStyleTable, schemes_style_table_unref)
+
+G_END_DECLS
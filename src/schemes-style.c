@@ -20,40 +20,21 @@
 
 #include "config.h"
 
-#include <math.h>
+#include <string.h>
 
 #include "schemes-style.h"
-#include "schemes-xml.h"
 
+/* A view onto the row named @name. The row only exists while some
+ * attribute is set, and may be recycled for another style once it is
+ * empty, so @row is a cache which is checked before use.
+ */
 struct _SchemesStyle
 {
   GObject parent_instance;
-  char *name;
-  char *language;
-  char *use_style;
-  GdkRGBA foreground;
-  GdkRGBA background;
-  GdkRGBA line_background;
-  GdkRGBA underline_color;
-  PangoUnderline underline;
-  PangoWeight weight;
-  double scale;
-
-  guint bold : 1;
-  guint italic : 1;
-  guint strikethrough : 1;
-
-  guint strikethrough_set : 1;
-  guint background_set : 1;
-  guint bold_set : 1;
-  guint foreground_set : 1;
-  guint italic_set : 1;
-  guint line_background_set : 1;
-  guint scale_set : 1;
-  guint underline_color_set : 1;
-  guint underline_set : 1;
-  guint weight_set : 1;
-  guint use_style_set : 1;
+  SchemesStyleTable *table;
+  const char *name;
+  const char *language;
+  guint row;
 };
 
 G_DEFINE_FINAL_TYPE (SchemesStyle, schemes_style, G_TYPE_OBJECT)
@@ -89,24 +70,116 @@ enum {
 
 static GParamSpec *properties [N_PROPS];
 
+static const struct {
+  guint prop_id;
+  guint set_prop_id;
+} attribute_props[SCHEMES_STYLE_N_ATTRIBUTES] = {
+  [SCHEMES_STYLE_ATTRIBUTE_FOREGROUND] = { PROP_FOREGROUND, PROP_FOREGROUND_SET },
+  [SCHEMES_STYLE_ATTRIBUTE_BACKGROUND] = { PROP_BACKGROUND, PROP_BACKGROUND_SET },
+  [SCHEMES_STYLE_ATTRIBUTE_LINE_BACKGROUND] = { PROP_LINE_BACKGROUND, PROP_LINE_BACKGROUND_SET },
+  [SCHEMES_STYLE_ATTRIBUTE_UNDERLINE_COLOR] = { PROP_UNDERLINE_COLOR, PROP_UNDERLINE_COLOR_SET },
+  [SCHEMES_STYLE_ATTRIBUTE_BOLD] = { PROP_BOLD, PROP_BOLD_SET },
+  [SCHEMES_STYLE_ATTRIBUTE_ITALIC] = { PROP_ITALIC, PROP_ITALIC_SET },
+  [SCHEMES_STYLE_ATTRIBUTE_STRIKETHROUGH] = { PROP_STRIKETHROUGH, PROP_STRIKETHROUGH_SET },
+  [SCHEMES_STYLE_ATTRIBUTE_UNDERLINE] = { PROP_UNDERLINE, PROP_UNDERLINE_SET },
+  [SCHEMES_STYLE_ATTRIBUTE_WEIGHT] = { PROP_WEIGHT, PROP_WEIGHT_SET },
+  [SCHEMES_STYLE_ATTRIBUTE_SCALE] = { PROP_SCALE, PROP_SCALE_SET },
+  [SCHEMES_STYLE_ATTRIBUTE_USE_STYLE] = { PROP_USE_STYLE, PROP_USE_STYLE_SET },
+};
+
 static gboolean
-set_rgba (GdkRGBA       *rgba,
-          const GdkRGBA *val)
+attribute_from_prop_id (guint                  prop_id,
+                        SchemesStyleAttribute *attribute,
+                        gboolean              *is_set_prop)
+{
+  for (guint i = 0; i < SCHEMES_STYLE_N_ATTRIBUTES; i++)
+    {
+      if (attribute_props[i].prop_id == prop_id ||
+          attribute_props[i].set_prop_id == prop_id)
+        {
+          *attribute = i;
+          *is_set_prop = attribute_props[i].set_prop_id == prop_id;
+          return TRUE;
+        }
+    }
+
+  return FALSE;
+}
+
+static void
+attach (SchemesStyle      *self,
+        SchemesStyleTable *table,
+        const char        *name)
+{
+  const char *colon;
+
+  g_assert (SCHEMES_IS_STYLE (self));
+  g_assert (self->table == NULL);
+  g_assert (schemes_style_table_get_view (table, name) == NULL);
+
+  self->table = schemes_style_table_ref (table);
+  self->name = g_intern_string (name);
+  self->row = schemes_style_table_lookup (table, name);
+
+  if ((colon = strchr (name, ':')))
+    {
+      g_autofree char *language = g_strndup (name, colon - name);
+      self->language = g_intern_string (language);
+    }
+
+  schemes_style_table_set_view (table, name, G_OBJECT (self));
+}
+
+static guint
+lookup_row (SchemesStyle *self)
 {
-  if (val == NULL)
-    return FALSE;
-  *rgba = *val;
-  return TRUE;
+  if (self->row == SCHEMES_STYLE_TABLE_INVALID_ROW ||
+      self->row >= schemes_style_table_get_n_rows (self->table) ||
+      schemes_style_table_get_name (self->table, self->row) != self->name)
+    self->row = schemes_style_table_lookup (self->table, self->name);
+
+  return self->row;
+}
+
+/* Gives the style a row, which is needed before setting attributes */
+static guint
+ensure_row (SchemesStyle *self)
+{
+  if (lookup_row (self) == SCHEMES_STYLE_TABLE_INVALID_ROW)
+    self->row = schemes_style_table_ensure (self->table, self->name);
+
+  return self->row;
 }
 
 SchemesStyle *
 schemes_style_new (const char *name)
 {
+  g_return_val_if_fail (name != NULL, NULL);
+
   return g_object_new (SCHEMES_TYPE_STYLE,
                        "name", name,
                        NULL);
 }
 
+/* Creates the view of @name. Names have at most one view at a time,
+ * see schemes_style_table_get_view().
+ */
+SchemesStyle *
+schemes_style_new_for_name (SchemesStyleTable *table,
+                            const char        *name)
+{
+  SchemesStyle *self;
+
+  g_return_val_if_fail (table != NULL, NULL);
+  g_return_val_if_fail (name != NULL, NULL);
+  g_return_val_if_fail (schemes_style_table_get_view (table, name) == NULL, NULL);
+
+  self = g_object_new (SCHEMES_TYPE_STYLE, NULL);
+  attach (self, table, name);
+
+  return self;
+}
+
 const char *
 schemes_style_get_name (SchemesStyle *self)
 {
@@ -115,137 +188,158 @@ schemes_style_get_name (SchemesStyle *self)
   return self->name;
 }
 
-static void
-on_notify_cb (SchemesStyle *self,
-              GParamSpec   *pspec)
-{
-  if (g_str_has_suffix (pspec->name, "-set"))
-    g_object_notify_by_pspec (G_OBJECT (self), properties [PROP_IS_EMPTY]);
-}
-
 static void
 schemes_style_finalize (GObject *object)
 {
   SchemesStyle *self = (SchemesStyle *)object;
 
-  g_clear_pointer (&self->name, g_free);
-  g_clear_pointer (&self->language, g_free);
-  g_clear_pointer (&self->use_style, g_free);
+  if (self->table != NULL)
+    {
+      if (schemes_style_table_get_view (self->table, self->name) == G_OBJECT (self))
+        schemes_style_table_set_view (self->table, self->name, NULL);
+      g_clear_pointer (&self->table, schemes_style_table_unref);
+    }
 
   G_OBJECT_CLASS (schemes_style_parent_class)->finalize (object);
 }
 
 static void
-schemes_style_get_property (GObject    *object,
-                            guint       prop_id,
-                            GValue     *value,
-                            GParamSpec *pspec)
+get_attribute_value (SchemesStyle          *self,
+                     guint                  row,
+                     SchemesStyleAttribute  attribute,
+                     GValue                *value)
 {
-  SchemesStyle *self = SCHEMES_STYLE (object);
-
-  switch (prop_id)
+  switch (attribute)
     {
-    case PROP_NAME:
-      g_value_set_string (value, self->name);
-      break;
-
-    case PROP_IS_EMPTY:
-      g_value_set_boolean (value, schemes_style_is_empty (self));
-      break;
-
-    case PROP_BACKGROUND:
-      if (self->background_set)
-        g_value_set_boxed (value, &self->background);
-      break;
-
-    case PROP_BACKGROUND_SET:
-      g_value_set_boolean (value, self->background_set);
-      break;
-
-    case PROP_BOLD:
-      g_value_set_boolean (value, self->bold);
+    case SCHEMES_STYLE_ATTRIBUTE_FOREGROUND:
+    case SCHEMES_STYLE_ATTRIBUTE_BACKGROUND:
+    case SCHEMES_STYLE_ATTRIBUTE_LINE_BACKGROUND:
+    case SCHEMES_STYLE_ATTRIBUTE_UNDERLINE_COLOR:
+      g_value_set_boxed (value, schemes_style_table_get_color (self->table, row, (SchemesStyleColor)attribute));
       break;
 
-    case PROP_BOLD_SET:
-      g_value_set_boolean (value, self->bold_set);
+    case SCHEMES_STYLE_ATTRIBUTE_BOLD:
+    case SCHEMES_STYLE_ATTRIBUTE_ITALIC:
+    case SCHEMES_STYLE_ATTRIBUTE_STRIKETHROUGH:
+      g_value_set_boolean (value, schemes_style_table_get_boolean (self->table, row, attribute));
       break;
 
-    case PROP_FOREGROUND:
-      if (self->foreground_set)
-        g_value_set_boxed (value, &self->foreground);
+    case SCHEMES_STYLE_ATTRIBUTE_UNDERLINE:
+      g_value_set_enum (value, schemes_style_table_get_underline (self->table, row));
       break;
 
-    case PROP_FOREGROUND_SET:
-      g_value_set_boolean (value, self->foreground_set);
+    case SCHEMES_STYLE_ATTRIBUTE_WEIGHT:
+      g_value_set_enum (value, schemes_style_table_get_weight (self->table, row));
       break;
 
-    case PROP_ITALIC:
-      g_value_set_boolean (value, self->italic);
+    case SCHEMES_STYLE_ATTRIBUTE_SCALE:
+      g_value_set_double (value, schemes_style_table_get_scale (self->table, row));
       break;
 
-    case PROP_ITALIC_SET:
-      g_value_set_boolean (value, self->italic_set);
+    case SCHEMES_STYLE_ATTRIBUTE_USE_STYLE:
+      g_value_set_string (value, schemes_style_table_get_use_style (self->table, row));
       break;
 
-    case PROP_STRIKETHROUGH:
-      g_value_set_boolean (value, self->strikethrough);
-      break;
+    case SCHEMES_STYLE_N_ATTRIBUTES:
+    default:
+      g_assert_not_reached ();
+    }
+}
 
-    case PROP_STRIKETHROUGH_SET:
-      g_value_set_boolean (value, self->strikethrough_set);
-      break;
+static void
+set_attribute_value (SchemesStyle          *self,
+                     SchemesStyleAttribute  attribute,
+                     const GValue          *value)
+{
+  guint row = lookup_row (self);
 
-    case PROP_LINE_BACKGROUND:
-      if (self->line_background_set)
-        g_value_set_boxed (value, &self->line_background);
-      break;
+  /* Unsetting an attribute of a style without a row changes nothing */
+  if (row == SCHEMES_STYLE_TABLE_INVALID_ROW)
+    {
+      if ((G_VALUE_HOLDS_BOXED (value) && g_value_get_boxed (value) == NULL) ||
+          (G_VALUE_HOLDS_STRING (value) && g_value_get_string (value) == NULL) ||
+          (attribute == SCHEMES_STYLE_ATTRIBUTE_WEIGHT && g_value_get_enum (value) == PANGO_WEIGHT_NORMAL))
+        return;
 
-    case PROP_LINE_BACKGROUND_SET:
-      g_value_set_boolean (value, self->line_background_set);
-      break;
+      row = ensure_row (self);
+    }
 
-    case PROP_SCALE:
-      g_value_set_double (value, self->scale);
+  switch (attribute)
+    {
+    case SCHEMES_STYLE_ATTRIBUTE_FOREGROUND:
+    case SCHEMES_STYLE_ATTRIBUTE_BACKGROUND:
+    case SCHEMES_STYLE_ATTRIBUTE_LINE_BACKGROUND:
+    case SCHEMES_STYLE_ATTRIBUTE_UNDERLINE_COLOR:
+      if (g_value_get_boxed (value) == NULL)
+        schemes_style_table_set_is_set (self->table, row, attribute, FALSE);
+      else
+        schemes_style_table_set_color (self->table, row,
+                                       (SchemesStyleColor)attribute,
+                                       g_value_get_boxed (value));
       break;
 
-    case PROP_SCALE_SET:
-      g_value_set_boolean (value, self->scale_set);
+    case SCHEMES_STYLE_ATTRIBUTE_BOLD:
+    case SCHEMES_STYLE_ATTRIBUTE_ITALIC:
+    case SCHEMES_STYLE_ATTRIBUTE_STRIKETHROUGH:
+      schemes_style_table_set_boolean (self->table, row, attribute, g_value_get_boolean (value));
       break;
 
-    case PROP_UNDERLINE_COLOR:
-      g_value_set_boxed (value, &self->underline_color);
+    case SCHEMES_STYLE_ATTRIBUTE_UNDERLINE:
+      schemes_style_table_set_underline (self->table, row, g_value_get_enum (value));
       break;
 
-    case PROP_UNDERLINE:
-      g_value_set_enum (value, self->underline);
+    case SCHEMES_STYLE_ATTRIBUTE_WEIGHT:
+      /* The weight row selects the current value when it is built,
+       * which must not mark an unset weight as set.
+       */
+      if (g_value_get_enum (value) != schemes_style_table_get_weight (self->table, row))
+        schemes_style_table_set_weight (self->table, row, g_value_get_enum (value));
       break;
 
-    case PROP_UNDERLINE_SET:
-      g_value_set_boolean (value, self->underline_set);
+    case SCHEMES_STYLE_ATTRIBUTE_SCALE:
+      schemes_style_table_set_scale (self->table, row, g_value_get_double (value));
       break;
 
-    case PROP_UNDERLINE_COLOR_SET:
-      g_value_set_boolean (value, self->underline_color_set);
+    case SCHEMES_STYLE_ATTRIBUTE_USE_STYLE:
+      schemes_style_table_set_use_style (self->table, row, g_value_get_string (value));
       break;
 
-    case PROP_WEIGHT:
-      g_value_set_enum (value, self->weight);
-      break;
+    case SCHEMES_STYLE_N_ATTRIBUTES:
+    default:
+      g_assert_not_reached ();
+    }
+}
 
-    case PROP_WEIGHT_SET:
-      g_value_set_boolean (value, self->weight_set);
-      break;
+static void
+schemes_style_get_property (GObject    *object,
+                            guint       prop_id,
+                            GValue     *value,
+                            GParamSpec *pspec)
+{
+  SchemesStyle *self = SCHEMES_STYLE (object);
+  SchemesStyleAttribute attribute;
+  gboolean is_set_prop;
+  guint row;
 
-    case PROP_USE_STYLE:
-      g_value_set_string (value, self->use_style);
+  switch (prop_id)
+    {
+    case PROP_NAME:
+      g_value_set_string (value, schemes_style_get_name (self));
       break;
 
-    case PROP_USE_STYLE_SET:
-      g_value_set_boolean (value, self->use_style_set);
+    case PROP_IS_EMPTY:
+      g_value_set_boolean (value, schemes_style_is_empty (self));
       break;
 
     default:
-      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      if (!attribute_from_prop_id (prop_id, &attribute, &is_set_prop))
+        G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      else if ((row = lookup_row (self)) == SCHEMES_STYLE_TABLE_INVALID_ROW)
+        g_param_value_set_default (pspec, value);
+      else if (is_set_prop)
+        g_value_set_boolean (value, schemes_style_table_is_set (self->table, row, attribute));
+      else
+        get_attribute_value (self, row, attribute, value);
     }
 }
 
@@ -256,127 +350,29 @@ schemes_style_set_property (GObject      *object,
                             GParamSpec   *pspec)
 {
   SchemesStyle *self = SCHEMES_STYLE (object);
+  SchemesStyleAttribute attribute;
+  gboolean is_set_prop;
 
   switch (prop_id)
     {
     case PROP_NAME:
-      self->name = g_value_dup_string (value);
-      if (strchr (self->name, ':'))
-        self->language = g_strndup (self->name, strchr (self->name, ':') - self->name);
-      break;
-
-    case PROP_BACKGROUND:
-      self->background_set = set_rgba (&self->background, g_value_get_boxed (value));
-      g_object_notify_by_pspec (G_OBJECT (self), properties [PROP_BACKGROUND_SET]);
-      break;
-
-    case PROP_FOREGROUND:
-      self->foreground_set = set_rgba (&self->foreground, g_value_get_boxed (value));
-      g_object_notify_by_pspec (G_OBJECT (self), properties [PROP_FOREGROUND_SET]);
-      break;
-
-    case PROP_UNDERLINE_COLOR:
-      self->underline_color_set = set_rgba (&self->underline_color, g_value_get_boxed (value));
-      g_object_notify_by_pspec (G_OBJECT (self), properties [PROP_UNDERLINE_COLOR_SET]);
-      break;
-
-    case PROP_BOLD:
-      self->bold = g_value_get_boolean (value);
-      self->bold_set = TRUE;
-      g_object_notify_by_pspec (G_OBJECT (self), properties [PROP_BOLD_SET]);
-      break;
-
-    case PROP_ITALIC:
-      self->italic = g_value_get_boolean (value);
-      self->italic_set = TRUE;
-      g_object_notify_by_pspec (G_OBJECT (self), properties [PROP_ITALIC_SET]);
-      break;
-
-    case PROP_LINE_BACKGROUND:
-      self->line_background_set = set_rgba (&self->line_background, g_value_get_boxed (value));
-      g_object_notify_by_pspec (G_OBJECT (self), properties [PROP_LINE_BACKGROUND_SET]);
-      break;
-
-    case PROP_SCALE:
-      self->scale = g_value_get_double (value);
-      self->scale_set = TRUE;
-      g_object_notify_by_pspec (G_OBJECT (self), properties [PROP_SCALE_SET]);
-      break;
-
-    case PROP_STRIKETHROUGH:
-      self->strikethrough = g_value_get_boolean (value);
-      self->strikethrough_set = TRUE;
-      g_object_notify_by_pspec (G_OBJECT (self), properties [PROP_STRIKETHROUGH_SET]);
-      break;
-
-    case PROP_UNDERLINE:
-      self->underline = g_value_get_enum (value);
-      self->underline_set = TRUE;
-      g_object_notify_by_pspec (G_OBJECT (self), properties [PROP_UNDERLINE_SET]);
-      break;
-
-    case PROP_WEIGHT:
-      if (g_value_get_enum (value) != self->weight)
+      /* Views of a scheme are attached by schemes_style_new_for_name() */
+      if (g_value_get_string (value) != NULL)
         {
-          self->weight = g_value_get_enum (value);
-          self->weight_set = TRUE;
-          g_object_notify_by_pspec (G_OBJECT (self), properties [PROP_WEIGHT_SET]);
+          g_autoptr(SchemesStyleTable) table = schemes_style_table_new ();
+          attach (self, table, g_value_get_string (value));
         }
       break;
 
-    case PROP_BACKGROUND_SET:
-      self->background_set = g_value_get_boolean (value);
-      break;
-
-    case PROP_BOLD_SET:
-      self->bold_set = g_value_get_boolean (value);
-      break;
-
-    case PROP_FOREGROUND_SET:
-      self->foreground_set = g_value_get_boolean (value);
-      break;
-
-    case PROP_UNDERLINE_SET:
-      self->underline_set = g_value_get_boolean (value);
-      break;
-
-    case PROP_UNDERLINE_COLOR_SET:
-      self->underline_color_set = g_value_get_boolean (value);
-      break;
-
-    case PROP_ITALIC_SET:
-      self->italic_set = g_value_get_boolean (value);
-      break;
-
-    case PROP_STRIKETHROUGH_SET:
-      self->strikethrough_set = g_value_get_boolean (value);
-      break;
-
-    case PROP_LINE_BACKGROUND_SET:
-      self->line_background_set = g_value_get_boolean (value);
-      break;
-
-    case PROP_SCALE_SET:
-      self->scale_set = g_value_get_boolean (value);
-      break;
-
-    case PROP_WEIGHT_SET:
-      self->weight_set = g_value_get_boolean (value);
-      break;
-
-    case PROP_USE_STYLE:
-      g_free (self->use_style);
-      self->use_style = g_value_dup_string (value);
-      self->use_style_set = TRUE;
-      g_object_notify_by_pspec (G_OBJECT (self), properties [PROP_USE_STYLE_SET]);
-      break;
-
-    case PROP_USE_STYLE_SET:
-      self->use_style_set = g_value_get_boolean (value);
-      break;
-
     default:
-      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      if (!attribute_from_prop_id (prop_id, &attribute, &is_set_prop))
+        G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      else if (!is_set_prop)
+        set_attribute_value (self, attribute, value);
+      else if (g_value_get_boolean (value))
+        schemes_style_table_set_is_set (self->table, ensure_row (self), attribute, TRUE);
+      else if (lookup_row (self) != SCHEMES_STYLE_TABLE_INVALID_ROW)
+        schemes_style_table_set_is_set (self->table, self->row, attribute, FALSE);
     }
 }
 
@@ -411,12 +407,12 @@ schemes_style_class_init (SchemesStyleClass *klass)
 
   properties [PROP_FOREGROUND] =
     g_param_spec_boxed ("foreground", NULL, NULL,
-                        GDK_TYPE_RGBA,
+                        SCHEMES_TYPE_RGBA,
                         (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
   properties [PROP_BACKGROUND] =
     g_param_spec_boxed ("background", NULL, NULL,
-                        GDK_TYPE_RGBA,
+                        SCHEMES_TYPE_RGBA,
                         (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
   properties [PROP_BACKGROUND_SET] =
@@ -426,7 +422,7 @@ schemes_style_class_init (SchemesStyleClass *klass)
 
   properties [PROP_LINE_BACKGROUND] =
     g_param_spec_boxed ("line-background", NULL, NULL,
-                        GDK_TYPE_RGBA,
+                        SCHEMES_TYPE_RGBA,
                         (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
   properties [PROP_LINE_BACKGROUND_SET] =
@@ -471,7 +467,7 @@ schemes_style_class_init (SchemesStyleClass *klass)
 
   properties [PROP_UNDERLINE_COLOR] =
     g_param_spec_boxed ("underline-color", NULL, NULL,
-                        GDK_TYPE_RGBA,
+                        SCHEMES_TYPE_RGBA,
                         (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
   properties [PROP_UNDERLINE_COLOR_SET] =
@@ -517,280 +513,239 @@ schemes_style_class_init (SchemesStyleClass *klass)
 static void
 schemes_style_init (SchemesStyle *self)
 {
-  self->scale = 1.0;
-  self->weight = PANGO_WEIGHT_NORMAL;
-
-  g_signal_connect (self,
-                    "notify",
-                    G_CALLBACK (on_notify_cb),
-                    NULL);
 }
 
 gboolean
 schemes_style_is_empty (SchemesStyle *self)
 {
+  guint row;
+
   g_return_val_if_fail (SCHEMES_IS_STYLE (self), FALSE);
 
-  /* TODO */
-
-  return !(self->background_set ||
-           self->foreground_set ||
-           self->italic_set ||
-           self->bold_set ||
-           self->scale_set ||
-           self->line_background_set ||
-           self->use_style_set ||
-           self->strikethrough_set ||
-           self->underline_set ||
-           self->underline_color_set ||
-           self->weight_set);
+  if ((row = lookup_row (self)) == SCHEMES_STYLE_TABLE_INVALID_ROW)
+    return TRUE;
+
+  return schemes_style_table_is_empty (self->table, row);
 }
 
-static void
-write_color_attribute (GString       *string,
-                       const char    *key,
-                       const GdkRGBA *color,
-                       GHashTable    *colors)
+/* Fills @data with interned strings, nothing needs to be released */
+void
+schemes_style_get_data (SchemesStyle     *self,
+                        SchemesStyleData *data)
 {
-  g_autofree char *color_str = NULL;
-  g_autofree char *hash_color_str = NULL;
-  const char *name;
+  guint row;
 
-  g_assert (string != NULL);
-  g_assert (key != NULL);
-  g_assert (color != NULL);
-  g_assert (colors != NULL);
-
-  color_str = gdk_rgba_to_string (color);
+  g_return_if_fail (SCHEMES_IS_STYLE (self));
+  g_return_if_fail (data != NULL);
 
-  if ((name = g_hash_table_lookup (colors, color_str)))
+  if ((row = lookup_row (self)) != SCHEMES_STYLE_TABLE_INVALID_ROW)
     {
-      schemes_xml_writer_add_attribute (string, key, name);
+      schemes_style_table_peek_data (self->table, row, data);
       return;
     }
 
-  if (color->alpha >= 1.0)
-    hash_color_str = g_strdup_printf ("#%02X%02X%02X",
-                                      (int)roundf (color->red*255.0),
-                                      (int)roundf (color->green*255.0),
-                                      (int)roundf (color->blue*255.0));
-  else
-    hash_color_str = g_strdup_printf ("#%s", color_str);
-
-  schemes_xml_writer_add_attribute (string, key, hash_color_str);
+  memset (data, 0, sizeof *data);
+  data->name = self->name;
+  data->language = self->language;
+  data->weight = PANGO_WEIGHT_NORMAL;
+  data->scale = 1.0;
 }
 
-static void
-write_weight_attribute (GString      *string,
-                        const char   *key,
-                        PangoWeight   weight)
+void
+schemes_style_serialize (SchemesStyle     *self,
+                         SchemesXmlWriter *writer,
+                         guint             longest_style_name)
 {
-  g_autofree char *freeme = NULL;
-  const char *str = NULL;
+  SchemesStyleData data;
 
-  switch (weight)
-    {
-    case PANGO_WEIGHT_THIN:
-      str = "thin";
-      break;
+  g_return_if_fail (SCHEMES_IS_STYLE (self));
+  g_return_if_fail (writer != NULL);
 
-    case PANGO_WEIGHT_BOLD:
-      str = "bold";
-      break;
+  schemes_style_get_data (self, &data);
+  schemes_style_data_serialize (&data, writer, longest_style_name);
+}
 
-    case PANGO_WEIGHT_ULTRABOLD:
-      str = "ultrabold";
-      break;
+const char *
+schemes_style_get_language (SchemesStyle *self)
+{
+  g_return_val_if_fail (SCHEMES_IS_STYLE (self), NULL);
 
-    case PANGO_WEIGHT_ULTRAHEAVY:
-      str = "ultraheavy";
-      break;
+  return self->language;
+}
 
-    case PANGO_WEIGHT_ULTRALIGHT:
-      str = "ultralight";
-      break;
+/* Returns the value of the color attribute @which, or %NULL if unset */
+const SchemesRGBA *
+schemes_style_get_color (SchemesStyle      *self,
+                         SchemesStyleColor  which)
+{
+  guint row;
 
-    case PANGO_WEIGHT_LIGHT:
-      str = "light";
-      break;
+  g_return_val_if_fail (SCHEMES_IS_STYLE (self), NULL);
 
-    case PANGO_WEIGHT_HEAVY:
-      str = "heavy";
-      break;
+  if ((row = lookup_row (self)) == SCHEMES_STYLE_TABLE_INVALID_ROW)
+    return NULL;
 
-    case PANGO_WEIGHT_NORMAL:
-      str = "normal";
-      break;
+  return schemes_style_table_get_color (self->table, row, which);
+}
 
-    case PANGO_WEIGHT_SEMIBOLD:
-      str = "semibold";
-      break;
+/* Sets @which to a literal value */
+void
+schemes_style_set_color (SchemesStyle      *self,
+                         SchemesStyleColor  which,
+                         const SchemesRGBA *rgba)
+{
+  g_return_if_fail (SCHEMES_IS_STYLE (self));
+  g_return_if_fail (rgba != NULL);
 
-    case PANGO_WEIGHT_SEMILIGHT:
-      str = "semilight";
-      break;
+  schemes_style_table_set_color (self->table, ensure_row (self), which, rgba);
+}
 
-    case PANGO_WEIGHT_BOOK:
-      str = "book";
-      break;
+/* Returns the named color @which follows, or %NULL for a literal */
+SchemesColor *
+schemes_style_get_color_ref (SchemesStyle      *self,
+                             SchemesStyleColor  which)
+{
+  guint row;
 
-    case PANGO_WEIGHT_MEDIUM:
-      str = "medium";
-      break;
+  g_return_val_if_fail (SCHEMES_IS_STYLE (self), NULL);
 
-    default:
-      str = freeme = g_strdup_printf ("%d", weight);
-      break;
-    }
+  if ((row = lookup_row (self)) == SCHEMES_STYLE_TABLE_INVALID_ROW)
+    return NULL;
 
-  schemes_xml_writer_add_attribute (string, key, str);
+  return schemes_style_table_get_color_ref (self->table, row, which);
 }
 
-static inline void
-write_enum_attribute (GString    *string,
-                      GType       type,
-                      const char *name,
-                      int         value)
+/* Makes @which follow @color, taking its current value. Setting it to
+ * %NULL keeps the current value as a literal.
+ */
+void
+schemes_style_set_color_ref (SchemesStyle      *self,
+                             SchemesStyleColor  which,
+                             SchemesColor      *color)
 {
-  GEnumClass *klass = g_type_class_ref (type);
-  const GEnumValue *eval = g_enum_get_value (klass, value);
+  g_return_if_fail (SCHEMES_IS_STYLE (self));
 
-  if (eval != NULL)
-    schemes_xml_writer_add_attribute (string, name, eval->value_nick);
+  if (color == NULL && lookup_row (self) == SCHEMES_STYLE_TABLE_INVALID_ROW)
+    return;
 
-  g_type_class_unref (klass);
+  schemes_style_table_set_color_ref (self->table, ensure_row (self), which, color);
 }
 
-static inline void
-write_boolean_attribute (GString    *string,
-                         const char *name,
-                         gboolean    value)
+const char *
+schemes_style_get_use_style (SchemesStyle *self)
 {
-  const char *valstr = value ? "true" : "false";
-  schemes_xml_writer_add_attribute (string, name, valstr);
-}
+  guint row;
 
-static inline void
-write_double_attribute (GString    *string,
-                        const char *name,
-                        double      value)
-{
-  char str[G_ASCII_DTOSTR_BUF_SIZE];
-  g_ascii_dtostr (str, sizeof str, value);
-  schemes_xml_writer_add_attribute (string, name, str);
+  g_return_val_if_fail (SCHEMES_IS_STYLE (self), NULL);
+
+  if ((row = lookup_row (self)) == SCHEMES_STYLE_TABLE_INVALID_ROW)
+    return NULL;
+
+  return schemes_style_table_get_use_style (self->table, row);
 }
 
+/* The typed setters below do the same as setting the property, without
+ * looking it up or boxing the value in a GValue.
+ */
 void
-schemes_style_serialize (SchemesStyle *self,
-                         GString      *string,
-                         GHashTable   *colors,
-                         guint         longest_style_name)
+schemes_style_set_boolean (SchemesStyle          *self,
+                           SchemesStyleAttribute  attribute,
+                           gboolean               value)
 {
-  guint name_len;
-
   g_return_if_fail (SCHEMES_IS_STYLE (self));
-  g_return_if_fail (string != NULL);
-
-  if (schemes_style_is_empty (self))
-    return;
+  g_return_if_fail (attribute == SCHEMES_STYLE_ATTRIBUTE_BOLD ||
+                    attribute == SCHEMES_STYLE_ATTRIBUTE_ITALIC ||
+                    attribute == SCHEMES_STYLE_ATTRIBUTE_STRIKETHROUGH);
 
-  schemes_xml_writer_begin_open_element (string, "style");
-  schemes_xml_writer_add_attribute (string, "name", self->name);
-
-  /* Align first attribute (which is often all we have) */
-  name_len = strlen (self->name);
-  if (name_len < longest_style_name)
-    {
-      guint diff = longest_style_name - name_len;
-      for (guint i = 0; i < diff; i++)
-        g_string_append_c (string, ' ');
-    }
-
-  if (self->background_set)
-    write_color_attribute (string, "background", &self->background, colors);
-
-  if (self->foreground_set)
-    write_color_attribute (string, "foreground", &self->foreground, colors);
-
-  if (self->line_background_set)
-    write_color_attribute (string, "line-background", &self->line_background, colors);
+  schemes_style_table_set_boolean (self->table, ensure_row (self), attribute, value);
+}
 
-  if (self->bold_set)
-    write_boolean_attribute (string, "bold", self->bold);
+void
+schemes_style_set_underline (SchemesStyle   *self,
+                             PangoUnderline  underline)
+{
+  g_return_if_fail (SCHEMES_IS_STYLE (self));
 
-  if (self->weight_set)
-    write_weight_attribute (string, "weight", self->weight);
+  schemes_style_table_set_underline (self->table, ensure_row (self), underline);
+}
 
-  if (self->italic_set)
-    write_boolean_attribute (string, "italic", self->italic);
+void
+schemes_style_set_weight (SchemesStyle *self,
+                          PangoWeight   weight)
+{
+  g_return_if_fail (SCHEMES_IS_STYLE (self));
 
-  if (self->underline_set)
-    write_enum_attribute (string, PANGO_TYPE_UNDERLINE, "underline", self->underline);
+  schemes_style_table_set_weight (self->table, ensure_row (self), weight);
+}
 
-  if (self->underline_color_set)
-    write_color_attribute (string, "underline-color", &self->underline_color, colors);
+void
+schemes_style_set_scale (SchemesStyle *self,
+                         double        scale)
+{
+  g_return_if_fail (SCHEMES_IS_STYLE (self));
 
-  if (self->scale_set)
-    write_double_attribute (string, "scale", self->scale);
+  schemes_style_table_set_scale (self->table, ensure_row (self), scale);
+}
 
-  if (self->strikethrough_set)
-    write_boolean_attribute (string, "strikethrough", self->strikethrough);
+void
+schemes_style_set_use_style (SchemesStyle *self,
+                             const char   *use_style)
+{
+  g_return_if_fail (SCHEMES_IS_STYLE (self));
 
-  if (self->use_style_set)
-    schemes_xml_writer_add_attribute (string, "use-style", self->use_style);
+  if (use_style == NULL && lookup_row (self) == SCHEMES_STYLE_TABLE_INVALID_ROW)
+    return;
 
-  schemes_xml_writer_end_open_element (string, FALSE);
+  schemes_style_table_set_use_style (self->table, ensure_row (self), use_style);
 }
 
-const char *
-schemes_style_get_language (SchemesStyle *self)
+void
+schemes_style_unset (SchemesStyle          *self,
+                     SchemesStyleAttribute  attribute)
 {
-  g_return_val_if_fail (SCHEMES_IS_STYLE (self), NULL);
+  guint row;
 
-  return self->language;
+  g_return_if_fail (SCHEMES_IS_STYLE (self));
+  g_return_if_fail (attribute < SCHEMES_STYLE_N_ATTRIBUTES);
+
+  if ((row = lookup_row (self)) != SCHEMES_STYLE_TABLE_INVALID_ROW)
+    schemes_style_table_set_is_set (self->table, row, attribute, FALSE);
 }
 
+/* Sets or unsets each attribute in @attributes->mask, with one notify
+ * per changed property. Within schemes_scheme_begin_update() the
+ * scheme also emits "changed" once for all of them.
+ */
 void
-schemes_style_replace_color (SchemesStyle  *self,
-                             const GdkRGBA *previous_color,
-                             const GdkRGBA *new_color)
+schemes_style_apply (SchemesStyle                 *self,
+                     const SchemesStyleAttributes *attributes)
 {
   g_return_if_fail (SCHEMES_IS_STYLE (self));
-  g_return_if_fail (previous_color != NULL);
-  g_return_if_fail (new_color != NULL);
+  g_return_if_fail (attributes != NULL);
 
-  if (gdk_rgba_equal (&self->foreground, previous_color))
-    {
-      self->foreground = *new_color;
-      g_object_notify_by_pspec (G_OBJECT (self), properties [PROP_FOREGROUND]);
-    }
+  g_object_freeze_notify (G_OBJECT (self));
 
-  if (gdk_rgba_equal (&self->background, previous_color))
+  /* Values are set before anything is unset, as a row without any
+   * attributes left is released by the table.
+   */
+  for (guint i = 0; i < SCHEMES_STYLE_N_ATTRIBUTES; i++)
     {
-      self->background = *new_color;
-      g_object_notify_by_pspec (G_OBJECT (self), properties [PROP_BACKGROUND]);
-    }
+      const SchemesStyleValue *value = &attributes->values[i];
 
-  if (gdk_rgba_equal (&self->line_background, previous_color))
-    {
-      self->line_background = *new_color;
-      g_object_notify_by_pspec (G_OBJECT (self), properties [PROP_LINE_BACKGROUND]);
+      if (!(attributes->mask & (1 << i)) || !value->is_set)
+        continue;
+
+      if (i < SCHEMES_STYLE_N_COLORS && value->color == NULL)
+        schemes_style_table_set_color (self->table, ensure_row (self), i, &value->v.rgba);
+      else
+        schemes_style_table_set_value (self->table, ensure_row (self), i, value);
     }
 
-  if (gdk_rgba_equal (&self->underline_color, previous_color))
+  for (guint i = 0; i < SCHEMES_STYLE_N_ATTRIBUTES; i++)
     {
-      self->underline_color = *new_color;
-      g_object_notify_by_pspec (G_OBJECT (self), properties [PROP_UNDERLINE_COLOR]);
+      if ((attributes->mask & (1 << i)) && !attributes->values[i].is_set)
+        schemes_style_unset (self, i);
     }
-}
-
-const char *
-schemes_style_get_use_style (SchemesStyle *self)
-{
-  g_return_val_if_fail (SCHEMES_IS_STYLE (self), NULL);
-
-  if (self->use_style_set)
-    return self->use_style;
 
-  return NULL;
+  g_object_thaw_notify (G_OBJECT (self));
 }
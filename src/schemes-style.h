@@ -20,7 +20,7 @@
 
 #pragma once
 
-#include <gtk/gtk.h>
+#include "schemes-style-table.h"
 
 G_BEGIN_DECLS
 
@@ -28,17 +28,63 @@ G_BEGIN_DECLS
 
 G_DECLARE_FINAL_TYPE (SchemesStyle, schemes_style, SCHEMES, STYLE, GObject)
 
-SchemesStyle *schemes_style_new           (const char    *name);
-const char   *schemes_style_get_name      (SchemesStyle  *self);
-const char   *schemes_style_get_language  (SchemesStyle  *self);
-gboolean      schemes_style_is_empty      (SchemesStyle  *self);
-void          schemes_style_serialize     (SchemesStyle  *self,
-                                           GString       *string,
-                                           GHashTable    *colors,
-                                           guint          longest_style_name);
-const char   *schemes_style_get_use_style (SchemesStyle  *self);
-void          schemes_style_replace_color (SchemesStyle  *self,
-                                           const GdkRGBA *previous_color,
-                                           const GdkRGBA *new_color);
+/* Attributes for schemes_style_apply(). Those in @mask, as bits of
+ * 1 << SchemesStyleAttribute, are set to their value or unset if the
+ * value is not set. A color value follows its named color if it has
+ * one, otherwise its literal value is used.
+ */
+typedef struct _SchemesStyleAttributes
+{
+  guint             mask;
+  SchemesStyleValue values[SCHEMES_STYLE_N_ATTRIBUTES];
+} SchemesStyleAttributes;
+
+/* Adds @attribute to @self as set, returning the value to fill in */
+static inline SchemesStyleValue *
+schemes_style_attributes_add (SchemesStyleAttributes *self,
+                              SchemesStyleAttribute   attribute)
+{
+  self->mask |= 1 << attribute;
+  self->values[attribute].is_set = TRUE;
+  return &self->values[attribute];
+}
+
+SchemesStyle      *schemes_style_new           (const char        *name);
+SchemesStyle      *schemes_style_new_for_name  (SchemesStyleTable *table,
+                                                const char        *name);
+const char        *schemes_style_get_name      (SchemesStyle      *self);
+const char        *schemes_style_get_language  (SchemesStyle      *self);
+gboolean           schemes_style_is_empty      (SchemesStyle      *self);
+void               schemes_style_serialize     (SchemesStyle      *self,
+                                                SchemesXmlWriter  *writer,
+                                                guint              longest_style_name);
+const char        *schemes_style_get_use_style (SchemesStyle      *self);
+const SchemesRGBA *schemes_style_get_color     (SchemesStyle      *self,
+                                                SchemesStyleColor  which);
+void               schemes_style_set_color     (SchemesStyle      *self,
+                                                SchemesStyleColor  which,
+                                                const SchemesRGBA *rgba);
+SchemesColor      *schemes_style_get_color_ref (SchemesStyle      *self,
+                                                SchemesStyleColor  which);
+void               schemes_style_set_color_ref (SchemesStyle      *self,
+                                                SchemesStyleColor  which,
+                                                SchemesColor      *color);
+void               schemes_style_set_boolean   (SchemesStyle          *self,
+                                                SchemesStyleAttribute  attribute,
+                                                gboolean               value);
+void               schemes_style_set_underline (SchemesStyle      *self,
+                                                PangoUnderline     underline);
+void               schemes_style_set_weight    (SchemesStyle      *self,
+                                                PangoWeight        weight);
+void               schemes_style_set_scale     (SchemesStyle      *self,
+                                                double             scale);
+void               schemes_style_set_use_style (SchemesStyle      *self,
+                                                const char        *use_style);
+void               schemes_style_unset         (SchemesStyle          *self,
+                                                SchemesStyleAttribute  attribute);
+void               schemes_style_apply         (SchemesStyle                 *self,
+                                                const SchemesStyleAttributes *attributes);
+void               schemes_style_get_data      (SchemesStyle      *self,
+                                                SchemesStyleData  *data);
 
 G_END_DECLS
@@ -23,6 +23,7 @@
 #include <libpanel.h>
 
 #include "schemes-color-row.h"
+#include "schemes-preview.h"
 #include "schemes-scheme.h"
 #include "schemes-style-row.h"
 #include "schemes-window.h"
@@ -54,9 +55,27 @@ struct _SchemesWindow
   AdwViewStackPage    *styles;
   GMenu               *doc_types_menu;
   AdwPreferencesGroup *lang_group;
+  AdwToastOverlay     *toasts;
+  GtkProgressBar      *progress;
 
   GHashTable          *style_groups;
+  SchemesPreview      *previewer;
+  GSettings           *settings;
+
+  /* Files being opened from this window, shown with the progress bar.
+   * An unused window is replaced once all of them have loaded.
+   */
+  GPtrArray           *loads;
+  GCancellable        *loads_cancellable;
+  guint                n_opened;
+  guint                preview_tick;
   guint                preview_timeout;
+  gint64               preview_cost;
+  gint64               preview_average_cost;
+  gint64               last_preview;
+  gint64               preview_begin;
+
+  guint                style_previewed : 1;
 };
 
 G_DEFINE_TYPE (SchemesWindow, schemes_window, ADW_TYPE_APPLICATION_WINDOW)
@@ -66,11 +85,20 @@ enum {
   PROP_DRAW_SPACES,
   PROP_SCHEME,
   PROP_LANGUAGE,
+  PROP_PREVIEW_COST,
   N_PROPS
 };
 
+/* Previews cheaper than this are applied on the next frame */
+#define PREVIEW_FRAME_BUDGET (G_USEC_PER_SEC / 120)
+/* Expensive previews may use at most 1/PREVIEW_DUTY_CYCLE of the time */
+#define PREVIEW_DUTY_CYCLE   4
+#define PREVIEW_MAX_DELAY    G_USEC_PER_SEC
+
 static GParamSpec *properties[N_PROPS];
 
+static void schemes_window_queue_preview (SchemesWindow *self);
+
 static int
 compare_section (gconstpointer a,
                  gconstpointer b)
@@ -150,7 +178,7 @@ load_scheme_styles (SchemesWindow *self)
 
 #define SCHEMES_STYLE(group_name, name, title, subtitle, flags)              \
   G_STMT_START {                                                             \
-    SchemesStyle *style;                                                     \
+    g_autoptr(SchemesStyle) style = NULL;                                    \
                                                                              \
     if (!(group = g_hash_table_lookup (self->style_groups, group_name)))     \
       {                                                                      \
@@ -160,7 +188,7 @@ load_scheme_styles (SchemesWindow *self)
                                   ADW_PREFERENCES_GROUP (group));            \
       }                                                                      \
                                                                              \
-    style = schemes_scheme_get_style (self->scheme, name);                   \
+    style = schemes_scheme_dup_style (self->scheme, name);                   \
     row = schemes_style_row_new (title, subtitle, flags, style);             \
     adw_preferences_group_add (ADW_PREFERENCES_GROUP (group), row);          \
   } G_STMT_END
@@ -180,7 +208,7 @@ load_scheme_styles (SchemesWindow *self)
   for (guint i = 0; style_ids[i]; i++)
     {
       const char *name = gtk_source_language_get_style_name (def, style_ids[i]);
-      g_autoptr(SchemesStyle) style = schemes_scheme_get_style (self->scheme, style_ids[i]);
+      g_autoptr(SchemesStyle) style = schemes_scheme_dup_style (self->scheme, style_ids[i]);
       row = schemes_style_row_new (style_ids[i], name, SCHEMES_STYLE_OPTIONS_HAS_ALL, style);
       adw_preferences_group_add (ADW_PREFERENCES_GROUP (group), row);
     }
@@ -211,13 +239,13 @@ validate_color_cb (GtkEditable   *editable,
                    SchemesWindow *self)
 {
   const char *text;
-  GdkRGBA color;
+  SchemesRGBA color;
 
   g_assert (GTK_IS_EDITABLE (editable));
 
   text = gtk_editable_get_text (editable);
 
-  if (text && text[0] && !gdk_rgba_parse (&color, text))
+  if (text && text[0] && !schemes_rgba_parse (&color, text))
     gtk_widget_add_css_class (GTK_WIDGET (editable), "error");
   else
     gtk_widget_remove_css_class (GTK_WIDGET (editable), "error");
@@ -253,7 +281,7 @@ do_add_color (SchemesWindow *self)
 {
   g_autoptr(SchemesColor) color = NULL;
   const char *name;
-  GdkRGBA rgba;
+  SchemesRGBA rgba;
 
   g_assert (SCHEMES_IS_WINDOW (self));
 
@@ -261,7 +289,7 @@ do_add_color (SchemesWindow *self)
     return;
 
   name = gtk_editable_get_text (GTK_EDITABLE (self->color_name));
-  gdk_rgba_parse (&rgba, gtk_editable_get_text (GTK_EDITABLE (self->color_rgba)));
+  schemes_rgba_parse (&rgba, gtk_editable_get_text (GTK_EDITABLE (self->color_rgba)));
 
   color = schemes_color_new (name, &rgba);
   schemes_scheme_add_color (self->scheme, color);
@@ -353,24 +381,47 @@ import_palette_cb (GtkWidget  *widget,
   gtk_native_dialog_show (GTK_NATIVE_DIALOG (dialog));
 }
 
+static void
+do_save_cb (GObject      *object,
+            GAsyncResult *result,
+            gpointer      user_data)
+{
+  SchemesScheme *scheme = (SchemesScheme *)object;
+  g_autoptr(SchemesWindow) self = user_data;
+  g_autoptr(GError) error = NULL;
+
+  g_assert (SCHEMES_IS_SCHEME (scheme));
+  g_assert (G_IS_ASYNC_RESULT (result));
+  g_assert (SCHEMES_IS_WINDOW (self));
+
+  if (!schemes_scheme_save_finish (scheme, result, &error))
+    {
+      g_autofree char *title = g_strdup_printf (_("Failed to save: %s"), error->message);
+      AdwToast *toast = adw_toast_new (title);
+
+      adw_toast_set_priority (toast, ADW_TOAST_PRIORITY_HIGH);
+      adw_toast_overlay_add_toast (self->toasts, toast);
+    }
+}
+
 static void
 do_save (SchemesWindow *self,
          GFile         *file,
          SchemesScheme *scheme)
 {
-  g_autoptr(GError) error = NULL;
-  g_autofree char *contents = NULL;
-  gsize len;
-
   g_assert (SCHEMES_IS_WINDOW (self));
   g_assert (G_IS_FILE (file));
   g_assert (SCHEMES_IS_SCHEME (scheme));
 
-  contents = schemes_scheme_to_string (scheme);
-  len = strlen (contents);
+  schemes_scheme_save_async (scheme,
+                             file,
+                             g_settings_get_boolean (self->settings, "create-backups"),
+                             NULL,
+                             do_save_cb,
+                             g_object_ref (self));
 
-  if (!g_file_replace_contents (file, contents, len, NULL, FALSE, G_FILE_CREATE_NONE, NULL, NULL, &error))
-    g_warning ("Failed to save file: %s", error->message);
+  /* Replace any incremental updates with the saved scheme */
+  schemes_window_queue_preview (self);
 }
 
 static void
@@ -450,16 +501,122 @@ new_cb (GtkWidget  *widget,
   gtk_window_present (GTK_WINDOW (new_window));
 }
 
+static void
+undo_cb (GtkWidget  *widget,
+         const char *action_name,
+         GVariant   *param)
+{
+  SchemesWindow *self = (SchemesWindow *)widget;
+
+  g_assert (SCHEMES_IS_WINDOW (self));
+
+  schemes_scheme_undo (self->scheme);
+}
+
+static void
+redo_cb (GtkWidget  *widget,
+         const char *action_name,
+         GVariant   *param)
+{
+  SchemesWindow *self = (SchemesWindow *)widget;
+
+  g_assert (SCHEMES_IS_WINDOW (self));
+
+  schemes_scheme_redo (self->scheme);
+}
+
+typedef struct
+{
+  SchemesWindow *self;
+  double         fraction;
+} OpenLoad;
+
+static void
+update_progress (SchemesWindow *self)
+{
+  double fraction = 0;
+
+  g_assert (SCHEMES_IS_WINDOW (self));
+
+  /* Nothing to show once the window is disposed */
+  if (self->loads == NULL)
+    return;
+
+  for (guint i = 0; i < self->loads->len; i++)
+    fraction += ((OpenLoad *)g_ptr_array_index (self->loads, i))->fraction;
+
+  if (self->loads->len > 0)
+    gtk_progress_bar_set_fraction (self->progress, fraction / self->loads->len);
+
+  gtk_widget_set_visible (GTK_WIDGET (self->progress), self->loads->len > 0);
+}
+
+static void
+open_progress_cb (double   fraction,
+                  gpointer user_data)
+{
+  OpenLoad *load = user_data;
+
+  load->fraction = fraction;
+  update_progress (load->self);
+}
+
+static void
+open_load_cb (GObject      *object,
+              GAsyncResult *result,
+              gpointer      user_data)
+{
+  SchemesScheme *scheme = (SchemesScheme *)object;
+  OpenLoad *load = user_data;
+  g_autoptr(SchemesWindow) self = load->self;
+  g_autoptr(GError) error = NULL;
+  SchemesWindow *new_window;
+
+  g_assert (SCHEMES_IS_SCHEME (scheme));
+  g_assert (G_IS_ASYNC_RESULT (result));
+  g_assert (SCHEMES_IS_WINDOW (self));
+
+  if (self->loads != NULL)
+    g_ptr_array_remove_fast (self->loads, load);
+  g_free (load);
+
+  update_progress (self);
+
+  if (!schemes_scheme_load_from_file_finish (scheme, result, &error))
+    {
+      if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+        g_warning ("%s", error->message);
+    }
+  else
+    {
+      new_window = g_object_new (SCHEMES_TYPE_WINDOW,
+                                 "application", g_application_get_default (),
+                                 "scheme", scheme,
+                                 NULL);
+      adw_view_stack_set_visible_child (new_window->stack,
+                                        adw_view_stack_page_get_child (new_window->styles));
+      gtk_window_present (GTK_WINDOW (new_window));
+
+      self->n_opened++;
+    }
+
+  /* Closing the window would cancel files still loading */
+  if (self->loads == NULL || self->loads->len > 0)
+    return;
+
+  if (self->n_opened > 0 && schemes_scheme_is_pristine (self->scheme))
+    gtk_window_destroy (GTK_WINDOW (self));
+
+  self->n_opened = 0;
+}
+
 static void
 open_response_cb (SchemesWindow        *self,
                   int                   response_code,
                   GtkFileChooserNative *dialog)
 {
-  SchemesWindow *new_window;
-  g_autoptr(GFile) file = NULL;
-  g_autoptr(SchemesScheme) scheme = NULL;
-  g_autoptr(GError) error = NULL;
-  gboolean close_window = FALSE;
+  g_autoptr(GListModel) files = NULL;
+  guint n_items;
 
   g_assert (SCHEMES_IS_WINDOW (self));
   g_assert (GTK_IS_FILE_CHOOSER_NATIVE (dialog));
@@ -467,32 +624,33 @@ open_response_cb (SchemesWindow        *self,
   if (response_code != GTK_RESPONSE_ACCEPT)
     goto failure;
 
-  if (!(file = gtk_file_chooser_get_file (GTK_FILE_CHOOSER (dialog))))
+  if (!(files = gtk_file_chooser_get_files (GTK_FILE_CHOOSER (dialog))))
     goto failure;
 
-  scheme = schemes_scheme_new ();
+  n_items = g_list_model_get_n_items (files);
 
-  if (!schemes_scheme_load_from_file (scheme, file, &error))
+  for (guint i = 0; i < n_items; i++)
     {
-      g_warning ("%s", error->message);
-      goto failure;
+      g_autoptr(GFile) file = g_list_model_get_item (files, i);
+      g_autoptr(SchemesScheme) scheme = schemes_scheme_new ();
+      OpenLoad *load = g_new0 (OpenLoad, 1);
+
+      load->self = g_object_ref (self);
+      g_ptr_array_add (self->loads, load);
+
+      schemes_scheme_load_from_file_async (scheme,
+                                           file,
+                                           open_progress_cb,
+                                           load,
+                                           self->loads_cancellable,
+                                           open_load_cb,
+                                           load);
     }
 
-  new_window = g_object_new (SCHEMES_TYPE_WINDOW,
-                             "application", g_application_get_default (),
-                             "scheme", scheme,
-                             NULL);
-  adw_view_stack_set_visible_child (new_window->stack,
-                                    adw_view_stack_page_get_child (new_window->styles));
-  gtk_window_present (GTK_WINDOW (new_window));
-
-  close_window = schemes_scheme_is_pristine (self->scheme);
+  update_progress (self);
 
 failure:
   gtk_native_dialog_destroy (GTK_NATIVE_DIALOG (dialog));
-
-  if (close_window)
-    gtk_window_destroy (GTK_WINDOW (self));
 }
 
 static void
@@ -516,6 +674,7 @@ open_cb (GtkWidget  *widget,
                                         _("Open"),
                                         _("Cancel"));
   gtk_file_chooser_add_filter (GTK_FILE_CHOOSER (dialog), filter);
+  gtk_file_chooser_set_select_multiple (GTK_FILE_CHOOSER (dialog), TRUE);
   g_signal_connect_object (dialog,
                            "response",
                            G_CALLBACK (open_response_cb),
@@ -574,7 +733,7 @@ schemes_window_set_language (SchemesWindow *self,
       const SchemesStyleOptions flags = SCHEMES_STYLE_OPTIONS_HAS_ALL;
       const char *name = style_ids[i];
       const char *fallback = gtk_source_language_get_style_fallback (l, style_ids[i]);
-      SchemesStyle *style = schemes_scheme_get_style (self->scheme, name);
+      g_autoptr(SchemesStyle) style = schemes_scheme_dup_style (self->scheme, name);
       const char *subtitle = gtk_source_language_get_style_name (l, name);
       g_autoptr(GString) title = g_string_new (name);
       GtkWidget *row;
@@ -592,9 +751,23 @@ schemes_window_dispose (GObject *object)
 {
   SchemesWindow *self = (SchemesWindow *)object;
 
-  g_clear_object (&self->scheme);
+  if (self->preview_tick != 0)
+    {
+      gtk_widget_remove_tick_callback (GTK_WIDGET (self), self->preview_tick);
+      self->preview_tick = 0;
+    }
+
   g_clear_handle_id (&self->preview_timeout, g_source_remove);
+
+  g_clear_object (&self->scheme);
   g_clear_pointer (&self->style_groups, g_hash_table_unref);
+  g_clear_object (&self->previewer);
+  g_clear_object (&self->settings);
+
+  /* Pending loads keep the window alive until they are cancelled */
+  g_cancellable_cancel (self->loads_cancellable);
+  g_clear_object (&self->loads_cancellable);
+  g_clear_pointer (&self->loads, g_ptr_array_unref);
 
   G_OBJECT_CLASS (schemes_window_parent_class)->dispose (object);
 }
@@ -629,6 +802,10 @@ schemes_window_get_property (GObject    *object,
       g_value_set_object (value, schemes_window_get_scheme (self));
       break;
 
+    case PROP_PREVIEW_COST:
+      g_value_set_int64 (value, self->preview_cost);
+      break;
+
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
     }
@@ -690,6 +867,13 @@ schemes_window_class_init (SchemesWindowClass *klass)
                          SCHEMES_TYPE_SCHEME,
                          (G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY | G_PARAM_STATIC_STRINGS));
 
+  properties [PROP_PREVIEW_COST] =
+    g_param_spec_int64 ("preview-cost",
+                        "Preview Cost",
+                        "Time spent on the last full preview, in microseconds",
+                        0, G_MAXINT64, 0,
+                        (G_PARAM_READABLE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS));
+
   g_object_class_install_properties (object_class, N_PROPS, properties);
 
   gtk_widget_class_set_template_from_resource (widget_class, "/ui/schemes-window.ui");
@@ -708,10 +892,12 @@ schemes_window_class_init (SchemesWindowClass *klass)
   gtk_widget_class_bind_template_child (widget_class, SchemesWindow, preview);
   gtk_widget_class_bind_template_child (widget_class, SchemesWindow, primary_menu);
   gtk_widget_class_bind_template_child (widget_class, SchemesWindow, primary_menu_button);
+  gtk_widget_class_bind_template_child (widget_class, SchemesWindow, progress);
   gtk_widget_class_bind_template_child (widget_class, SchemesWindow, stack);
   gtk_widget_class_bind_template_child (widget_class, SchemesWindow, styles);
   gtk_widget_class_bind_template_child (widget_class, SchemesWindow, styles_page);
   gtk_widget_class_bind_template_child (widget_class, SchemesWindow, theme_selector);
+  gtk_widget_class_bind_template_child (widget_class, SchemesWindow, toasts);
   gtk_widget_class_bind_template_child (widget_class, SchemesWindow, view);
   gtk_widget_class_bind_template_callback (widget_class, add_color_clicked_cb);
   gtk_widget_class_bind_template_callback (widget_class, on_color_activate_cb);
@@ -725,6 +911,8 @@ schemes_window_class_init (SchemesWindowClass *klass)
   gtk_widget_class_install_action (widget_class, "scheme.save", NULL, save_cb);
   gtk_widget_class_install_action (widget_class, "scheme.save-as", NULL, save_as_cb);
   gtk_widget_class_install_action (widget_class, "scheme.new", NULL, new_cb);
+  gtk_widget_class_install_action (widget_class, "scheme.undo", NULL, undo_cb);
+  gtk_widget_class_install_action (widget_class, "scheme.redo", NULL, redo_cb);
 
   g_type_ensure (SCHEMES_TYPE_COLOR_ROW);
 }
@@ -742,7 +930,18 @@ schemes_window_init (SchemesWindow *self)
 
   gtk_window_set_default_size (GTK_WINDOW (self), 1280, 768);
 
-  gtk_source_buffer_set_style_scheme (self->preview, NULL);
+  self->settings = g_settings_new ("me.hergert.Schemes");
+  self->loads = g_ptr_array_new ();
+  self->loads_cancellable = g_cancellable_new ();
+
+  self->previewer = schemes_preview_new ();
+  schemes_preview_set_buffer (self->previewer, self->preview);
+  g_signal_connect_object (self->previewer,
+                           "needs-rebuild",
+                           G_CALLBACK (schemes_window_queue_preview),
+                           self,
+                           G_CONNECT_SWAPPED);
+
   load_doc_types (self);
 
   popover = gtk_menu_button_get_popover (self->primary_menu_button);
@@ -772,6 +971,21 @@ on_colors_changed_cb (SchemesWindow *self,
     gtk_widget_show (GTK_WIDGET (self->colors_group));
 }
 
+static void
+on_notify_history_cb (SchemesWindow *self,
+                      GParamSpec    *pspec,
+                      SchemesScheme *scheme)
+{
+  g_assert (SCHEMES_IS_WINDOW (self));
+  g_assert (SCHEMES_IS_SCHEME (scheme));
+
+  if (scheme != self->scheme)
+    return;
+
+  gtk_widget_action_set_enabled (GTK_WIDGET (self), "scheme.undo", schemes_scheme_can_undo (scheme));
+  gtk_widget_action_set_enabled (GTK_WIDGET (self), "scheme.redo", schemes_scheme_can_redo (scheme));
+}
+
 static void
 remove_color_row_cb (SchemesWindow   *self,
                      SchemesColorRow *row)
@@ -804,17 +1018,100 @@ create_color_row_cb (gpointer item,
   return ret;
 }
 
+static gint64
+schemes_window_get_preview_delay (SchemesWindow *self)
+{
+  g_assert (SCHEMES_IS_WINDOW (self));
+
+  if (self->preview_average_cost <= PREVIEW_FRAME_BUDGET)
+    return 0;
+
+  return MIN (self->preview_average_cost * (PREVIEW_DUTY_CYCLE - 1), PREVIEW_MAX_DELAY);
+}
+
+static void
+schemes_window_preview_cb (GObject      *object,
+                           GAsyncResult *result,
+                           gpointer      user_data)
+{
+  SchemesPreview *previewer = (SchemesPreview *)object;
+  g_autoptr(SchemesWindow) self = user_data;
+  g_autoptr(GError) error = NULL;
+  gint64 end;
+
+  g_assert (SCHEMES_IS_PREVIEW (previewer));
+  g_assert (SCHEMES_IS_WINDOW (self));
+
+  if (!schemes_preview_update_finish (previewer, result, &error))
+    {
+      if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+        g_warning ("%s", error->message);
+      return;
+    }
+
+  end = g_get_monotonic_time ();
+
+  self->last_preview = end;
+
+  /* Smooth out the cost so a single slow build does not cause a stall */
+  if (self->preview_average_cost == 0)
+    self->preview_average_cost = end - self->preview_begin;
+  else
+    self->preview_average_cost = (self->preview_average_cost * 3 + (end - self->preview_begin)) / 4;
+
+  if (self->preview_cost != end - self->preview_begin)
+    {
+      self->preview_cost = end - self->preview_begin;
+      g_object_notify_by_pspec (G_OBJECT (self), properties [PROP_PREVIEW_COST]);
+    }
+}
+
 static gboolean
-preview_cb (gpointer data)
+preview_tick_cb (GtkWidget     *widget,
+                 GdkFrameClock *frame_clock,
+                 gpointer       user_data)
 {
-  SchemesWindow *self = data;
-  g_autoptr(GtkSourceStyleScheme) scheme = NULL;
+  SchemesWindow *self = (SchemesWindow *)widget;
+
+  g_assert (SCHEMES_IS_WINDOW (self));
+  g_assert (GDK_IS_FRAME_CLOCK (frame_clock));
+
+  self->preview_tick = 0;
+
+  if (self->scheme == NULL)
+    return G_SOURCE_REMOVE;
+
+  /* Any build still in flight is dropped once this one is requested */
+  self->preview_begin = g_get_monotonic_time ();
+  schemes_preview_update_async (self->previewer,
+                                self->scheme,
+                                NULL,
+                                schemes_window_preview_cb,
+                                g_object_ref (self));
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+schemes_window_add_preview_tick (SchemesWindow *self)
+{
+  g_assert (SCHEMES_IS_WINDOW (self));
+
+  if (self->preview_tick == 0)
+    self->preview_tick = gtk_widget_add_tick_callback (GTK_WIDGET (self),
+                                                       preview_tick_cb,
+                                                       NULL, NULL);
+}
+
+static gboolean
+preview_timeout_cb (gpointer user_data)
+{
+  SchemesWindow *self = user_data;
 
   g_assert (SCHEMES_IS_WINDOW (self));
 
   self->preview_timeout = 0;
-  scheme = schemes_scheme_preview (self->scheme);
-  gtk_source_buffer_set_style_scheme (self->preview, scheme);
+  schemes_window_add_preview_tick (self);
 
   return G_SOURCE_REMOVE;
 }
@@ -822,23 +1119,59 @@ preview_cb (gpointer data)
 static void
 schemes_window_queue_preview (SchemesWindow *self)
 {
+  gint64 remaining;
+
   g_assert (SCHEMES_IS_WINDOW (self));
 
-  if (self->preview_timeout == 0)
-    self->preview_timeout = g_timeout_add (500, preview_cb, self);
+  if (self->preview_tick != 0 || self->preview_timeout != 0)
+    return;
+
+  /* Coalesce edits until enough time has passed since the last preview,
+   * without keeping the frame clock running in the meantime.
+   */
+  remaining = self->last_preview + schemes_window_get_preview_delay (self) - g_get_monotonic_time ();
+
+  if (remaining > 0)
+    self->preview_timeout = g_timeout_add ((remaining + 999) / 1000, preview_timeout_cb, self);
+  else
+    schemes_window_add_preview_tick (self);
 }
 
 static void
-on_scheme_changed_cb (SchemesWindow *self,
-                      GParamSpec    *pspec,
-                      SchemesScheme *scheme)
+on_style_changed_cb (SchemesWindow *self,
+                     SchemesStyle  *style,
+                     SchemesScheme *scheme)
 {
   g_assert (SCHEMES_IS_WINDOW (self));
+  g_assert (SCHEMES_IS_STYLE (style));
   g_assert (SCHEMES_IS_SCHEME (scheme));
 
   if (scheme != self->scheme)
     return;
 
+  /* "changed" is emitted right after, and can skip the full preview
+   * if the tags of the preview buffer could be updated directly.
+   */
+  self->style_previewed = schemes_preview_update_style (self->previewer, scheme, style);
+}
+
+static void
+on_scheme_changed_cb (SchemesWindow        *self,
+                      SchemesSchemeChanges  changes,
+                      SchemesScheme        *scheme)
+{
+  g_assert (SCHEMES_IS_WINDOW (self));
+  g_assert (SCHEMES_IS_SCHEME (scheme));
+
+  if (scheme != self->scheme)
+    return;
+
+  if (self->style_previewed)
+    {
+      self->style_previewed = FALSE;
+      return;
+    }
+
   schemes_window_queue_preview (self);
 }
 
@@ -928,14 +1261,30 @@ schemes_window_set_scheme (SchemesWindow *self,
                                schemes_scheme_get_colors (scheme),
                                create_color_row_cb,
                                self, NULL);
+      g_signal_connect_object (self->scheme,
+                               "style-changed",
+                               G_CALLBACK (on_style_changed_cb),
+                               self,
+                               G_CONNECT_SWAPPED);
       g_signal_connect_object (self->scheme,
                                "changed",
                                G_CALLBACK (on_scheme_changed_cb),
                                self,
                                G_CONNECT_SWAPPED);
+      g_signal_connect_object (self->scheme,
+                               "notify::can-undo",
+                               G_CALLBACK (on_notify_history_cb),
+                               self,
+                               G_CONNECT_SWAPPED);
+      g_signal_connect_object (self->scheme,
+                               "notify::can-redo",
+                               G_CALLBACK (on_notify_history_cb),
+                               self,
+                               G_CONNECT_SWAPPED);
       load_scheme_styles (self);
       load_scheme_actions (self, scheme);
       on_colors_changed_cb (self, 0, 0, 0, colors);
+      on_notify_history_cb (self, NULL, self->scheme);
       schemes_window_set_language (self, "c");
     }
 
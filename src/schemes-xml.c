@@ -0,0 +1,684 @@
+/* schemes-xml.c
+ *
+ * Copyright 2022 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+
+#include "config.h"
+
+#include <math.h>
+
+#include "schemes-xml.h"
+
+static const char hex_digits[16] = "0123456789ABCDEF";
+
+/* Bytes g_markup_escape_text() would replace, other than those part of
+ * a C1 control character which need to look at the next byte too.
+ */
+static inline gboolean
+needs_escape (guchar c)
+{
+  switch (c)
+    {
+    case '&': case '<': case '>': case '\'': case '"':
+    case 0xC2:
+      return TRUE;
+
+    case '\t': case '\n': case '\r':
+      return FALSE;
+
+    default:
+      return c < 0x20 || c == 0x7F;
+    }
+}
+
+void
+schemes_xml_writer_init (SchemesXmlWriter *self,
+                         GOutputStream    *stream,
+                         GCancellable     *cancellable)
+{
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (G_IS_OUTPUT_STREAM (stream));
+  g_return_if_fail (!cancellable || G_IS_CANCELLABLE (cancellable));
+
+  self->stream = stream;
+  self->cancellable = cancellable;
+  self->error = NULL;
+  self->len = 0;
+  self->n_written = 0;
+}
+
+void
+schemes_xml_writer_flush (SchemesXmlWriter *self)
+{
+  gsize len = self->len;
+
+  self->len = 0;
+
+  if (len == 0 || self->error != NULL)
+    return;
+
+  if (g_output_stream_write_all (self->stream, self->buf, len, NULL, self->cancellable, &self->error))
+    self->n_written += len;
+}
+
+/* Flushes what is left. The stream is not closed. */
+gboolean
+schemes_xml_writer_finish (SchemesXmlWriter  *self,
+                           GError           **error)
+{
+  g_return_val_if_fail (self != NULL, FALSE);
+
+  schemes_xml_writer_flush (self);
+
+  if (self->error != NULL)
+    {
+      g_propagate_error (error, g_steal_pointer (&self->error));
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+void
+schemes_xml_writer_write_len (SchemesXmlWriter *self,
+                              const char       *str,
+                              gsize             len)
+{
+  while (len > 0)
+    {
+      gsize n;
+
+      if (self->len == sizeof self->buf)
+        schemes_xml_writer_flush (self);
+
+      n = MIN (len, sizeof self->buf - self->len);
+      memcpy (&self->buf[self->len], str, n);
+      self->len += n;
+      str += n;
+      len -= n;
+    }
+}
+
+static inline void
+write_char_ref (SchemesXmlWriter *self,
+                guint             c)
+{
+  schemes_xml_writer_write_len (self, "&#x", 3);
+  if (c > 0xF)
+    schemes_xml_writer_write_c (self, g_ascii_tolower (hex_digits[c >> 4]));
+  schemes_xml_writer_write_c (self, g_ascii_tolower (hex_digits[c & 0xF]));
+  schemes_xml_writer_write_c (self, ';');
+}
+
+/* Same output as g_markup_escape_text(), written as runs of the bytes
+ * which do not need escaping.
+ */
+void
+schemes_xml_writer_write_escaped (SchemesXmlWriter *self,
+                                  const char       *str)
+{
+  const char *run;
+
+  if (str == NULL)
+    return;
+
+  run = str;
+
+  for (const char *p = str; *p; p++)
+    {
+      guchar c = *p;
+
+      if G_LIKELY (!needs_escape (c))
+        continue;
+
+      /* Only the C1 controls other than U+0085 are escaped, other two
+       * byte sequences starting with 0xC2 are written as is.
+       */
+      if (c == 0xC2 && !((guchar)p[1] >= 0x80 && (guchar)p[1] <= 0x9F && (guchar)p[1] != 0x85))
+        continue;
+
+      schemes_xml_writer_write_len (self, run, p - run);
+
+      switch (c)
+        {
+        case '&':
+          schemes_xml_writer_write_len (self, "&amp;", 5);
+          break;
+
+        case '<':
+          schemes_xml_writer_write_len (self, "&lt;", 4);
+          break;
+
+        case '>':
+          schemes_xml_writer_write_len (self, "&gt;", 4);
+          break;
+
+        case '\'':
+          schemes_xml_writer_write_len (self, "&apos;", 6);
+          break;
+
+        case '"':
+          schemes_xml_writer_write_len (self, "&quot;", 6);
+          break;
+
+        case 0xC2:
+          p++;
+          write_char_ref (self, (guchar)*p);
+          break;
+
+        default:
+          write_char_ref (self, c);
+          break;
+        }
+
+      run = p + 1;
+    }
+
+  schemes_xml_writer_write_len (self, run, strlen (run));
+}
+
+void
+schemes_xml_writer_write_padding (SchemesXmlWriter *self,
+                                  gsize             n_spaces)
+{
+  static const char spaces[] = "                                ";
+
+  while (n_spaces > 0)
+    {
+      gsize n = MIN (n_spaces, sizeof spaces - 1);
+
+      schemes_xml_writer_write_len (self, spaces, n);
+      n_spaces -= n;
+    }
+}
+
+void
+schemes_xml_writer_write_uint (SchemesXmlWriter *self,
+                               guint             value)
+{
+  char str[16];
+  guint pos = sizeof str;
+
+  do
+    {
+      str[--pos] = '0' + value % 10;
+      value /= 10;
+    }
+  while (value > 0);
+
+  schemes_xml_writer_write_len (self, &str[pos], sizeof str - pos);
+}
+
+static inline guint
+color_to_byte (float value)
+{
+  return (guint)CLAMP (roundf (value * 255.f), 0, 255);
+}
+
+/* Writes #RRGGBB, ignoring alpha */
+void
+schemes_xml_writer_write_hex_color (SchemesXmlWriter  *self,
+                                    const SchemesRGBA *rgba)
+{
+  guint bytes[3] = {
+    color_to_byte (rgba->red),
+    color_to_byte (rgba->green),
+    color_to_byte (rgba->blue),
+  };
+  char str[7];
+
+  str[0] = '#';
+  for (guint i = 0; i < G_N_ELEMENTS (bytes); i++)
+    {
+      str[1 + i * 2] = hex_digits[bytes[i] >> 4];
+      str[2 + i * 2] = hex_digits[bytes[i] & 0xF];
+    }
+
+  schemes_xml_writer_write_len (self, str, sizeof str);
+}
+
+void
+schemes_xml_writer_open_element (SchemesXmlWriter *self,
+                                 const char       *element_name)
+{
+  schemes_xml_writer_write_c (self, '<');
+  schemes_xml_writer_write (self, element_name);
+  schemes_xml_writer_write_c (self, '>');
+}
+
+void
+schemes_xml_writer_begin_open_element (SchemesXmlWriter *self,
+                                       const char       *element_name)
+{
+  schemes_xml_writer_write_c (self, '<');
+  schemes_xml_writer_write (self, element_name);
+}
+
+void
+schemes_xml_writer_add_attribute (SchemesXmlWriter *self,
+                                  const char       *attribute_name,
+                                  const char       *attribute_value)
+{
+  if (attribute_value == NULL)
+    return;
+
+  schemes_xml_writer_write_c (self, ' ');
+  schemes_xml_writer_write (self, attribute_name);
+  schemes_xml_writer_write_len (self, "=\"", 2);
+  schemes_xml_writer_write_escaped (self, attribute_value);
+  schemes_xml_writer_write_c (self, '"');
+}
+
+void
+schemes_xml_writer_add_hex_attribute (SchemesXmlWriter  *self,
+                                      const char        *attribute_name,
+                                      const SchemesRGBA *rgba)
+{
+  schemes_xml_writer_write_c (self, ' ');
+  schemes_xml_writer_write (self, attribute_name);
+  schemes_xml_writer_write_len (self, "=\"", 2);
+  schemes_xml_writer_write_hex_color (self, rgba);
+  schemes_xml_writer_write_c (self, '"');
+}
+
+void
+schemes_xml_writer_end_open_element (SchemesXmlWriter *self,
+                                     gboolean          has_children)
+{
+  if (has_children)
+    schemes_xml_writer_write_c (self, '>');
+  else
+    schemes_xml_writer_write_len (self, "/>", 2);
+}
+
+void
+schemes_xml_writer_close_element (SchemesXmlWriter *self,
+                                  const char       *element_name)
+{
+  schemes_xml_writer_write_len (self, "</", 2);
+  schemes_xml_writer_write (self, element_name);
+  schemes_xml_writer_write_c (self, '>');
+}
+
+typedef struct
+{
+  const char *name;
+  guint       len;
+  char        c;
+} Entity;
+
+static const Entity entities[] = {
+  { "&amp;",  5, '&' },
+  { "&lt;",   4, '<' },
+  { "&gt;",   4, '>' },
+  { "&quot;", 6, '"' },
+  { "&apos;", 6, '\'' },
+};
+
+/* Character references are left to GMarkup, being rare in schemes */
+static const Entity *
+lookup_entity (const char *p,
+               const char *end)
+{
+  for (guint i = 0; i < G_N_ELEMENTS (entities); i++)
+    {
+      if ((gsize)(end - p) >= entities[i].len &&
+          memcmp (p, entities[i].name, entities[i].len) == 0)
+        return &entities[i];
+    }
+
+  return NULL;
+}
+
+static inline gboolean
+is_space (char c)
+{
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static inline gboolean
+is_name_start_char (char c)
+{
+  return g_ascii_isalpha (c) || c == '_' || c == ':';
+}
+
+static inline gboolean
+is_name_char (char c)
+{
+  return g_ascii_isalnum (c) || c == '_' || c == ':' || c == '-' || c == '.';
+}
+
+static inline const char *
+skip_space (const char *p,
+            const char *end)
+{
+  while (p < end && is_space (*p))
+    p++;
+  return p;
+}
+
+static const char *
+find (const char *p,
+      const char *end,
+      const char *needle)
+{
+  gsize len = strlen (needle);
+
+  for (; p + len <= end; p++)
+    {
+      if (*p == *needle && memcmp (p, needle, len) == 0)
+        return p;
+    }
+
+  return NULL;
+}
+
+static guint
+read_name (const char         **p,
+           const char          *end,
+           const char * const  *vocabulary)
+{
+  const char *begin = *p;
+  const char *q = begin;
+  gsize len;
+
+  if (q >= end || !is_name_start_char (*q))
+    return 0;
+
+  while (q < end && is_name_char (*q))
+    q++;
+
+  *p = q;
+  len = q - begin;
+
+  for (guint i = 0; vocabulary[i] != NULL; i++)
+    {
+      if (vocabulary[i][0] == begin[0] &&
+          strncmp (vocabulary[i], begin, len) == 0 &&
+          vocabulary[i][len] == 0)
+        return i + 1;
+    }
+
+  return 0;
+}
+
+/* Splits a document into tokens without copying any of it. Only the
+ * subset of XML used by style schemes is understood; anything else,
+ * including names missing from @vocabulary, makes it return %FALSE so
+ * that the caller may fall back to GMarkup. Documents accepted here are
+ * well-formed, with balanced tags, unique attributes and a single root.
+ */
+gboolean
+schemes_xml_tokenize (const char         *text,
+                      gsize               len,
+                      const char * const *vocabulary,
+                      GArray             *tokens,
+                      GArray             *attributes)
+{
+  const char *p = text;
+  const char *end = text + len;
+  guint stack[32];
+  guint depth = 0;
+  gboolean seen_root = FALSE;
+
+  g_return_val_if_fail (text != NULL || len == 0, FALSE);
+  g_return_val_if_fail (vocabulary != NULL, FALSE);
+  g_return_val_if_fail (tokens != NULL, FALSE);
+  g_return_val_if_fail (attributes != NULL, FALSE);
+
+  g_array_set_size (tokens, 0);
+  g_array_set_size (attributes, 0);
+
+  /* Also rejects nul bytes, like GMarkup */
+  if (!g_utf8_validate_len (text, len, NULL))
+    return FALSE;
+
+  while (p < end)
+    {
+      SchemesXmlToken token = {0};
+
+      if (*p != '<')
+        {
+          gboolean blank = TRUE;
+
+          token.kind = SCHEMES_XML_TOKEN_TEXT;
+          token.text = p;
+
+          for (; p < end && *p != '<'; p++)
+            {
+              if (*p == '&')
+                {
+                  const Entity *entity = lookup_entity (p, end);
+
+                  if (entity == NULL)
+                    return FALSE;
+
+                  token.has_entities = TRUE;
+                  blank = FALSE;
+                  p += entity->len - 1;
+                }
+              else if (!is_space (*p))
+                blank = FALSE;
+            }
+
+          if (blank)
+            continue;
+
+          if (depth == 0)
+            return FALSE;
+
+          token.len = p - token.text;
+          g_array_append_val (tokens, token);
+          continue;
+        }
+
+      if (end - p >= 4 && memcmp (p, "<!--", 4) == 0)
+        {
+          const char *close = find (p + 4, end, "-->");
+
+          if (close == NULL)
+            return FALSE;
+
+          p = close + 3;
+          continue;
+        }
+
+      if (end - p >= 5 && memcmp (p, "<?xml", 5) == 0 && !seen_root)
+        {
+          const char *close = find (p + 5, end, "?>");
+
+          if (close == NULL)
+            return FALSE;
+
+          p = close + 2;
+          continue;
+        }
+
+      if (end - p >= 2 && p[1] == '/')
+        {
+          p += 2;
+
+          token.kind = SCHEMES_XML_TOKEN_END;
+          token.text = p - 2;
+
+          if (!(token.id = read_name (&p, end, vocabulary)))
+            return FALSE;
+
+          p = skip_space (p, end);
+
+          if (p >= end || *p != '>' || depth == 0 || stack[depth - 1] != token.id)
+            return FALSE;
+
+          p++;
+          depth--;
+          g_array_append_val (tokens, token);
+          continue;
+        }
+
+      token.kind = SCHEMES_XML_TOKEN_START;
+      token.text = p++;
+      token.first_attribute = attributes->len;
+
+      if (!(token.id = read_name (&p, end, vocabulary)))
+        return FALSE;
+
+      if (depth == 0 && seen_root)
+        return FALSE;
+
+      seen_root = TRUE;
+
+      for (;;)
+        {
+          const char *after_name = p;
+          SchemesXmlAttribute attribute = {0};
+          char quote;
+
+          p = skip_space (p, end);
+
+          if (p >= end)
+            return FALSE;
+
+          if (*p == '>' || *p == '/')
+            break;
+
+          if (p == after_name)
+            return FALSE;
+
+          if (!(attribute.id = read_name (&p, end, vocabulary)))
+            return FALSE;
+
+          for (guint i = 0; i < token.n_attributes; i++)
+            {
+              if (g_array_index (attributes, SchemesXmlAttribute, token.first_attribute + i).id == attribute.id)
+                return FALSE;
+            }
+
+          p = skip_space (p, end);
+          if (p >= end || *p != '=')
+            return FALSE;
+
+          p = skip_space (p + 1, end);
+          if (p >= end || (*p != '"' && *p != '\''))
+            return FALSE;
+
+          quote = *p++;
+          attribute.value = p;
+
+          for (; p < end && *p != quote; p++)
+            {
+              if (*p == '<')
+                return FALSE;
+
+              if (*p == '&')
+                {
+                  const Entity *entity = lookup_entity (p, end);
+
+                  if (entity == NULL)
+                    return FALSE;
+
+                  attribute.has_entities = TRUE;
+                  p += entity->len - 1;
+                }
+            }
+
+          if (p >= end)
+            return FALSE;
+
+          attribute.len = p - attribute.value;
+          p++;
+
+          g_array_append_val (attributes, attribute);
+          token.n_attributes++;
+        }
+
+      g_array_append_val (tokens, token);
+
+      if (*p == '/')
+        {
+          if (end - p < 2 || p[1] != '>')
+            return FALSE;
+
+          p += 2;
+
+          token.kind = SCHEMES_XML_TOKEN_END;
+          token.first_attribute = 0;
+          token.n_attributes = 0;
+          g_array_append_val (tokens, token);
+        }
+      else
+        {
+          if (depth == G_N_ELEMENTS (stack))
+            return FALSE;
+
+          p++;
+          stack[depth++] = token.id;
+        }
+    }
+
+  return seen_root && depth == 0;
+}
+
+/* Replaces the entities accepted by schemes_xml_tokenize() in @src,
+ * writing at most @len bytes to @dest.
+ */
+gsize
+schemes_xml_unescape (char       *dest,
+                      const char *src,
+                      gsize       len)
+{
+  const char *end = src + len;
+  char *d = dest;
+
+  while (src < end)
+    {
+      const Entity *entity;
+
+      if (*src == '&' && (entity = lookup_entity (src, end)))
+        {
+          *d++ = entity->c;
+          src += entity->len;
+        }
+      else
+        *d++ = *src++;
+    }
+
+  return d - dest;
+}
+
+/* Moves @line and @column, which count from 1, from @from on to @to.
+ * Positions of several places in a document can be found in one pass
+ * by advancing from one to the next.
+ */
+void
+schemes_xml_advance_position (const char *from,
+                              const char *to,
+                              int        *line,
+                              int        *column)
+{
+  for (const char *p = from; p < to; p = g_utf8_next_char (p))
+    {
+      if (*p == '\n')
+        {
+          (*line)++;
+          *column = 1;
+        }
+      else
+        (*column)++;
+    }
+}
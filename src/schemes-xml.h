@@ -20,105 +20,121 @@
 
 #pragma once
 
-#include <glib.h>
+#include <gio/gio.h>
+#include <string.h>
 
-G_BEGIN_DECLS
-
-static inline void
-schemes_xml_writer_open_element (GString    *string,
-                                 const char *element_name)
-{
-  g_string_append_printf (string, "<%s>", element_name);
-}
-
-static inline void
-schemes_xml_writer_begin_open_element (GString    *string,
-                                       const char *element_name)
-{
-  g_string_append_printf (string, "<%s", element_name);
-}
+#include "schemes-rgba.h"
 
-static inline void
-schemes_xml_writer_add_attribute (GString    *string,
-                                  const char *attribute_name,
-                                  const char *attribute_value)
-{
-  if (attribute_value != NULL)
-    {
-      g_autofree char *escaped = g_markup_escape_text (attribute_value, -1);
+G_BEGIN_DECLS
 
-      g_string_append_c (string, ' ');
-      g_string_append (string, attribute_name);
-      g_string_append (string, "=\"");
-      g_string_append (string, escaped);
-      g_string_append_c (string, '"');
-    }
-}
+#define SCHEMES_XML_WRITER_BUFSIZE 8192
 
-static inline void
-schemes_xml_writer_add_attributes (GString            *string,
-                                   const char * const *attribute_names,
-                                   const char * const *attribute_values)
+/* Writes XML to a GOutputStream in chunks of SCHEMES_XML_WRITER_BUFSIZE
+ * without allocating. Escaping and formatting happen directly in the
+ * buffer. The first error stops further writes and is returned from
+ * schemes_xml_writer_finish().
+ */
+typedef struct _SchemesXmlWriter
 {
-  for (guint i = 0; attribute_names[i]; i++)
-    schemes_xml_writer_add_attribute(string, attribute_names[i], attribute_values[i]);
-}
-
-static inline void
-schemes_xml_writer_end_open_element (GString  *string,
-                                     gboolean  has_children)
+  GOutputStream *stream;
+  GCancellable  *cancellable;
+  GError        *error;
+  gsize          len;
+  gsize          n_written;
+  char           buf[SCHEMES_XML_WRITER_BUFSIZE];
+} SchemesXmlWriter;
+
+void     schemes_xml_writer_init               (SchemesXmlWriter   *self,
+                                                GOutputStream      *stream,
+                                                GCancellable       *cancellable);
+gboolean schemes_xml_writer_finish             (SchemesXmlWriter   *self,
+                                                GError            **error);
+void     schemes_xml_writer_flush              (SchemesXmlWriter   *self);
+void     schemes_xml_writer_write_len          (SchemesXmlWriter   *self,
+                                                const char         *str,
+                                                gsize               len);
+void     schemes_xml_writer_write_escaped      (SchemesXmlWriter   *self,
+                                                const char         *str);
+void     schemes_xml_writer_write_padding      (SchemesXmlWriter   *self,
+                                                gsize               n_spaces);
+void     schemes_xml_writer_write_uint         (SchemesXmlWriter   *self,
+                                                guint               value);
+void     schemes_xml_writer_write_hex_color    (SchemesXmlWriter   *self,
+                                                const SchemesRGBA  *rgba);
+void     schemes_xml_writer_open_element       (SchemesXmlWriter   *self,
+                                                const char         *element_name);
+void     schemes_xml_writer_begin_open_element (SchemesXmlWriter   *self,
+                                                const char         *element_name);
+void     schemes_xml_writer_add_attribute      (SchemesXmlWriter   *self,
+                                                const char         *attribute_name,
+                                                const char         *attribute_value);
+void     schemes_xml_writer_add_hex_attribute  (SchemesXmlWriter   *self,
+                                                const char         *attribute_name,
+                                                const SchemesRGBA  *rgba);
+void     schemes_xml_writer_end_open_element   (SchemesXmlWriter   *self,
+                                                gboolean            has_children);
+void     schemes_xml_writer_close_element      (SchemesXmlWriter   *self,
+                                                const char         *element_name);
+
+typedef enum _SchemesXmlTokenKind
 {
-  if (has_children)
-    g_string_append_c (string, '>');
-  else
-    g_string_append (string, "/>");
-}
-
-static inline void
-schemes_xml_writer_close_element (GString    *string,
-                                  const char *element_name)
+  SCHEMES_XML_TOKEN_START,
+  SCHEMES_XML_TOKEN_END,
+  SCHEMES_XML_TOKEN_TEXT,
+} SchemesXmlTokenKind;
+
+/* Tokens and attributes point into the document rather than copying
+ * from it. Names are replaced by their position in the vocabulary,
+ * starting from 1. Start tokens point at their '<' and own
+ * n_attributes attributes starting at first_attribute.
+ */
+typedef struct _SchemesXmlToken
 {
-  g_string_append_printf (string, "</%s>", element_name);
-}
-
-static inline void
-schemes_xml_writer_add_attributes_va (GString    *string,
-                                      const char *first_attribute,
-                                      ...)
+  const char *text;
+  gsize       len;
+  guint       first_attribute;
+  guint       n_attributes;
+  guint       kind : 2;
+  guint       has_entities : 1;
+  guint       id : 16;
+} SchemesXmlToken;
+
+typedef struct _SchemesXmlAttribute
 {
-  va_list args;
-
-  va_start (args, first_attribute);
-  while (first_attribute)
-    {
-      const char *value = va_arg (args, const char *);
-      if (value)
-        schemes_xml_writer_add_attribute (string, first_attribute, value);
-      first_attribute = va_arg (args, const char *);
-    }
-  va_end (args);
-}
+  const char *value;
+  gsize       len;
+  guint       id : 16;
+  guint       has_entities : 1;
+} SchemesXmlAttribute;
+
+gboolean schemes_xml_tokenize                  (const char         *text,
+                                                gsize               len,
+                                                const char * const *vocabulary,
+                                                GArray             *tokens,
+                                                GArray             *attributes);
+gsize    schemes_xml_unescape                  (char               *dest,
+                                                const char         *src,
+                                                gsize               len);
+void     schemes_xml_advance_position          (const char         *from,
+                                                const char         *to,
+                                                int                *line,
+                                                int                *column);
 
 static inline void
-schemes_xml_writer_write_escaped (GString    *string,
-                                  const char *str)
+schemes_xml_writer_write_c (SchemesXmlWriter *self,
+                            char              c)
 {
-  char *escaped;
-
-  if (str == NULL || *str == 0)
-    return;
+  if G_UNLIKELY (self->len == sizeof self->buf)
+    schemes_xml_writer_flush (self);
 
-  escaped = g_markup_escape_text (str, -1);
-  g_string_append (string, escaped);
-  g_free (escaped);
+  self->buf[self->len++] = c;
 }
 
 static inline void
-schemes_xml_writer_write_gstring_escaped (GString *string,
-                                          GString *to_write)
+schemes_xml_writer_write (SchemesXmlWriter *self,
+                          const char       *str)
 {
-  if (to_write)
-    schemes_xml_writer_write_escaped (string, to_write->str);
+  schemes_xml_writer_write_len (self, str, strlen (str));
 }
 
 G_END_DECLS